@@ -0,0 +1,400 @@
+#include "build.h"
+#include <algorithm>
+#include <filesystem>
+#include <set>
+#include "parser.h"
+#include "source.h"
+#include "thread_pool.h"
+#include "tokens.h"
+
+namespace fs = std::filesystem;
+
+namespace goop
+{
+
+namespace driver
+{
+
+std::optional<std::string> module_path(std::string_view go_mod)
+{
+    while (!go_mod.empty()) {
+        auto newline = go_mod.find('\n');
+        auto line = go_mod.substr(0, newline);
+        go_mod = newline == std::string_view::npos ? std::string_view{} : go_mod.substr(newline + 1);
+
+        auto start = line.find_first_not_of(" \t");
+        if (start == std::string_view::npos || line.substr(start, 6) != "module")
+            continue;
+
+        line = line.substr(start + 6);
+        start = line.find_first_not_of(" \t");
+        if (start == 0 || start == std::string_view::npos)
+            continue;
+
+        line = line.substr(start);
+        if (line[0] == '"') {
+            auto end = line.find('"', 1);
+            return std::string(line.substr(1, end == std::string_view::npos ? end : end - 1));
+        }
+
+        return std::string(line.substr(0, line.find_first_of(" \t\r")));
+    }
+
+    return std::nullopt;
+}
+
+static std::optional<std::string> read_module_path(const fs::path &go_mod)
+{
+    auto buffer = source::SourceBuffer::map_file(go_mod.string());
+    if (!buffer)
+        return std::nullopt;
+
+    return module_path(buffer->view());
+}
+
+// The import path of the directory at relative below where prefix starts
+static std::string import_path(const std::string &prefix, const std::string &relative)
+{
+    if (relative == ".")
+        return prefix.empty() ? std::string(".") : prefix;
+
+    if (prefix.empty())
+        return relative;
+
+    return prefix + '/' + relative;
+}
+
+Build::Build(support::ThreadPool &pool, Target target, bool parse_files):
+    pool{pool}, target{std::move(target)}, parse_files{parse_files} {}
+
+Build::~Build() = default;
+
+Package &Build::node(const std::string &path)
+{
+    auto &package = graph[path];
+    if (!package) {
+        package = std::make_unique<Package>();
+        package->path = path;
+    }
+
+    return *package;
+}
+
+// Lists one directory, handing each subdirectory to a task of its own
+// and the directory's files, if there are any, to another. Packages
+// below a vendor directory are named from there, and a directory with a
+// go.mod of its own is another module, left out like the go tool does.
+void Build::walk(std::string directory, std::string base, std::string prefix)
+{
+    std::vector<std::string> files;
+    std::error_code error;
+
+    for (auto it = fs::directory_iterator(directory, error);
+            !error && it != fs::directory_iterator();
+            it.increment(error)) {
+        auto name = it->path().filename().string();
+        if (name.empty() || name[0] == '.' || name[0] == '_')
+            continue;
+
+        std::error_code type_error;
+        if (it->is_directory(type_error)) {
+            if (name == "testdata" || fs::exists(it->path() / "go.mod", type_error))
+                continue;
+
+            auto sub = it->path().string();
+            auto sub_base = name == "vendor" ? sub : base;
+            auto sub_prefix = name == "vendor" ? std::string() : prefix;
+
+            walking.fetch_add(1, std::memory_order_relaxed);
+            group->run([this, sub, sub_base, sub_prefix] {
+                walk(sub, sub_base, sub_prefix);
+            });
+        } else if (name.ends_with(".go") && !name.ends_with("_test.go") && matches_name(name, target)
+                && it->is_regular_file(type_error)) {
+            files.push_back(it->path().string());
+        }
+    }
+
+    if (!files.empty()) {
+        std::sort(files.begin(), files.end());
+
+        auto relative = fs::path(directory).lexically_relative(base).generic_string();
+        auto path = import_path(prefix, relative);
+
+        Package *package;
+        {
+            std::lock_guard lock(mutex);
+            package = &node(path);
+            // The same import path twice, the first one found wins
+            if (!package->directory.empty()) {
+                package = nullptr;
+            } else {
+                package->directory = directory;
+                package->files = std::move(files);
+            }
+        }
+
+        if (package) {
+            group->run([this, package] {
+                load(*package);
+            });
+        }
+    }
+
+    if (walking.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        end_discovery();
+    }
+}
+
+// Whether the //go:build lines before the package clause allow a file
+static bool is_built(const tokens::FileHeader &header, std::string_view text, const Target &target)
+{
+    for (const auto &directive : header.directives) {
+        if (directive.kind == tokens::Directive::GO && directive.name(text) == "build"
+                && !evaluate(directive.arguments(text), target).value_or(false))
+            return false;
+    }
+
+    return true;
+}
+
+// What parsing one file of a package found
+struct FileSyntax {
+    size_t tokens = 0;
+    size_t nodes = 0;
+    std::vector<std::string> errors;
+};
+
+// The files of a package being parsed, one task each. The last task to
+// finish adds them all to the package, in file order.
+struct PackageSyntax {
+    std::vector<FileSyntax> files;
+    std::atomic<size_t> remaining;
+
+    explicit PackageSyntax(size_t count): files(count), remaining{count} {}
+};
+
+// Line and column of a byte of text, both starting at 1
+static std::pair<size_t, size_t> line_column(std::string_view text, size_t offset)
+{
+    auto before = text.substr(0, offset);
+    auto line = std::count(before.begin(), before.end(), '\n') + 1;
+    auto line_start = before.rfind('\n');
+    auto column = line_start == std::string_view::npos ? offset + 1 : offset - line_start;
+    return {static_cast<size_t>(line), column};
+}
+
+// Lexes and parses one file. The file is only mapped while it is parsed,
+// so a build keeps no more files open than it has tasks running.
+static void parse_file(const std::string &path, FileSyntax &syntax, support::ThreadPool &pool)
+{
+    auto buffer = source::SourceBuffer::map_file(path);
+    if (!buffer) {
+        syntax.errors.push_back(path + ": failed to read");
+        return;
+    }
+
+    auto text = buffer->view();
+    auto tokens = tokens::consume_tokens(text, tokens::CommentMode::DROP);
+    auto ast = parser::parse_parallel(tokens, pool);
+    syntax.tokens = tokens.size();
+    syntax.nodes = ast.size();
+
+    for (const auto &error : ast.errors()) {
+        auto offset = error.token < tokens.size() ? tokens.offsets()[error.token] : text.size();
+        auto [line, column] = line_column(text, offset);
+        syntax.errors.push_back(path + ':' + std::to_string(line) + ':' + std::to_string(column)
+            + ": expected " + std::string(error.expected));
+    }
+}
+
+// Reads the header of every file of a package for its imports, which go
+// into the graph before any file is read in full. Files whose build
+// constraints rule them out, or that need cgo without it, are dropped
+// from the package without being read any further. The rest are then
+// lexed and parsed by a task each, unless the build only finds imports,
+// and the package is finished once the last of them is.
+void Build::load(Package &package)
+{
+    std::vector<std::string> built;
+    std::set<std::string, std::less<>> imports;
+    std::string text;
+
+    for (const auto &path : package.files) {
+        auto header = tokens::read_header(path, text);
+        if (!header) {
+            package.errors.push_back(path + ": failed to read");
+            continue;
+        }
+
+        if (!is_built(*header, text, target))
+            continue;
+
+        // Files using cgo are only built with it
+        auto &paths = header->imports;
+        if (!target.cgo && std::find(paths.begin(), paths.end(), "C") != paths.end())
+            continue;
+
+        imports.insert(paths.begin(), paths.end());
+        built.push_back(path);
+    }
+
+    package.files = std::move(built);
+    package.imports.assign(imports.begin(), imports.end());
+    add_imports(package);
+
+    if (!parse_files || package.files.empty()) {
+        finish(package);
+        return;
+    }
+
+    auto syntax = std::make_shared<PackageSyntax>(package.files.size());
+    for (size_t i = 0; i < package.files.size(); ++i) {
+        group->run([this, &package, syntax, i] {
+            parse_file(package.files[i], syntax->files[i], pool);
+            if (syntax->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            for (auto &file : syntax->files) {
+                package.tokens += file.tokens;
+                package.nodes += file.nodes;
+                package.errors.insert(package.errors.end(),
+                        std::make_move_iterator(file.errors.begin()), std::make_move_iterator(file.errors.end()));
+            }
+
+            finish(package);
+        });
+    }
+}
+
+void Build::add_imports(Package &package)
+{
+    std::lock_guard lock(mutex);
+
+    for (const auto &path : package.imports) {
+        auto &dependency = node(path);
+        if (&dependency == &package)
+            continue;
+
+        // Once every directory is listed, a package nobody found is
+        // outside the build, and complete as far as it is concerned
+        if (discovered && dependency.directory.empty() && !dependency.complete) {
+            complete(dependency);
+        }
+
+        if (dependency.complete) {
+            if (!dependency.directory.empty()) {
+                package.level = std::max(package.level, dependency.level + 1);
+            }
+            continue;
+        }
+
+        dependency.dependents.push_back(&package);
+        package.waiting += 1;
+    }
+}
+
+void Build::finish(Package &package)
+{
+    std::lock_guard lock(mutex);
+    package.parsed = true;
+    if (!package.waiting) {
+        complete(package);
+    }
+}
+
+// Marks a package complete, and with it every parsed package that was
+// only waiting on it. The mutex is held.
+void Build::complete(Package &package)
+{
+    std::vector<Package *> ready{&package};
+
+    while (!ready.empty()) {
+        auto done = ready.back();
+        ready.pop_back();
+
+        done->complete = true;
+        bool in_build = !done->directory.empty();
+        if (in_build) {
+            completed.push_back(done);
+        }
+
+        for (auto dependent : done->dependents) {
+            if (in_build) {
+                dependent->level = std::max(dependent->level, done->level + 1);
+            }
+
+            dependent->waiting -= 1;
+            if (!dependent->waiting && dependent->parsed) {
+                ready.push_back(dependent);
+            }
+        }
+
+        done->dependents.clear();
+    }
+}
+
+void Build::end_discovery()
+{
+    std::lock_guard lock(mutex);
+    discovered = true;
+
+    for (auto &[path, package] : graph) {
+        if (package->directory.empty() && !package->complete) {
+            complete(*package);
+        }
+    }
+}
+
+bool Build::run(const std::string &directory)
+{
+    std::error_code error;
+    auto root = fs::weakly_canonical(fs::absolute(directory, error), error);
+    if (error || !fs::is_directory(root, error))
+        return false;
+
+    // Import paths start from the module the directory is in, or from
+    // the directory itself outside any module. The standard library's
+    // module is std, but its import paths have no prefix.
+    auto base = root;
+    std::string prefix;
+    for (auto dir = root; ; dir = dir.parent_path()) {
+        if (fs::exists(dir / "go.mod", error)) {
+            base = dir;
+            prefix = read_module_path(dir / "go.mod").value_or("");
+            break;
+        }
+
+        if (dir == dir.parent_path())
+            break;
+    }
+
+    if (prefix == "std") {
+        prefix.clear();
+    }
+
+    group = std::make_unique<support::TaskGroup>(pool);
+    walking.store(1, std::memory_order_relaxed);
+    group->run([this, root, base, prefix] {
+        walk(root.string(), base.string(), prefix);
+    });
+    group->wait();
+
+    return true;
+}
+
+std::vector<const Package *> Build::packages() const
+{
+    std::vector<const Package *> found;
+    for (const auto &[path, package] : graph) {
+        if (!package->directory.empty() && !package->files.empty()) {
+            found.push_back(package.get());
+        }
+    }
+
+    return found;
+}
+
+}
+
+}
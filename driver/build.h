@@ -0,0 +1,114 @@
+#ifndef DRIVER_BUILD_H
+#define DRIVER_BUILD_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "constraint.h"
+
+namespace goop
+{
+
+namespace support
+{
+
+class ThreadPool;
+class TaskGroup;
+
+}
+
+namespace driver
+{
+
+struct Package {
+    std::string path;
+    // Empty for a package that is imported but not part of the build
+    std::string directory;
+    // The files built for the target, sorted
+    std::vector<std::string> files;
+    // Every import of the package's files, sorted
+    std::vector<std::string> imports;
+
+    size_t tokens = 0;
+    size_t nodes = 0;
+    // Syntax errors, as path:line:col: message
+    std::vector<std::string> errors;
+
+    // Length of the longest chain of imports within the build starting
+    // here, set once the package is complete
+    uint32_t level = 0;
+    bool parsed = false;
+    // Parsed, and so is everything it imports from the build. Packages
+    // on an import cycle never are.
+    bool complete = false;
+
+    // Imports not complete yet, and the packages waiting on this one
+    size_t waiting = 0;
+    std::vector<Package *> dependents;
+};
+
+// Finds and parses every package below a directory, all on one pool. Each
+// directory is listed by a task of its own, and each file of a package is
+// lexed and parsed by another as soon as its directory has been listed,
+// so discovery, lexing and parsing overlap from the start. The import
+// graph is built as packages are loaded: the imports of a package's files
+// are read from their headers before any of them is parsed, and a package
+// is complete once everything it imports from the build is, which is
+// where anything that needs its dependencies done would start.
+class Build {
+    support::ThreadPool &pool;
+    Target target;
+    bool parse_files;
+    std::unique_ptr<support::TaskGroup> group;
+
+    // Guards the graph, and the order packages complete in
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Package>, std::less<>> graph;
+    std::vector<const Package *> completed;
+
+    // Directories still being listed
+    std::atomic<size_t> walking{0};
+    bool discovered = false;
+
+    Package &node(const std::string &path);
+    void walk(std::string directory, std::string base, std::string prefix);
+    void load(Package &package);
+    void add_imports(Package &package);
+    void finish(Package &package);
+    void complete(Package &package);
+    void end_discovery();
+
+    public:
+    // Without parse_files only the header of each file is read, which
+    // is all the import graph needs
+    explicit Build(support::ThreadPool &pool, Target target = host_target(), bool parse_files = true);
+    ~Build();
+
+    // Builds the module or package in directory, returning false if it
+    // can't be listed
+    bool run(const std::string &directory);
+
+    // Packages of the build, sorted by path. Those only imported, or
+    // without a file built for the target, are left out.
+    std::vector<const Package *> packages() const;
+
+    // Packages in the order they completed
+    const std::vector<const Package *> &completion_order() const {
+        return completed;
+    }
+};
+
+// The module path a go.mod declares
+std::optional<std::string> module_path(std::string_view go_mod);
+
+}
+
+}
+
+#endif
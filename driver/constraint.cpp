@@ -0,0 +1,217 @@
+#include "constraint.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+
+namespace goop
+{
+
+namespace driver
+{
+
+static constexpr std::array<std::string_view, 18> known_os = {
+    "aix", "android", "darwin", "dragonfly", "freebsd", "hurd", "illumos", "ios", "js",
+    "linux", "nacl", "netbsd", "openbsd", "plan9", "solaris", "wasip1", "windows", "zos",
+};
+
+static constexpr std::array<std::string_view, 12> unix_os = {
+    "aix", "android", "darwin", "dragonfly", "freebsd", "hurd", "illumos", "ios",
+    "linux", "netbsd", "openbsd", "solaris",
+};
+
+static constexpr std::array<std::string_view, 24> known_arch = {
+    "386", "amd64", "amd64p32", "arm", "armbe", "arm64", "arm64be", "loong64",
+    "mips", "mipsle", "mips64", "mips64le", "mips64p32", "mips64p32le", "ppc", "ppc64",
+    "ppc64le", "riscv", "riscv64", "s390", "s390x", "sparc", "sparc64", "wasm",
+};
+
+template<size_t N>
+static bool contains(const std::array<std::string_view, N> &names, std::string_view name)
+{
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+bool Target::has_tag(std::string_view tag) const
+{
+    if (tag == os || tag == arch || tag == "gc")
+        return true;
+
+    // Some systems are built as another one as well
+    if ((tag == "linux" && os == "android") || (tag == "solaris" && os == "illumos")
+            || (tag == "darwin" && os == "ios"))
+        return true;
+
+    if (tag == "unix")
+        return contains(unix_os, os);
+
+    if (tag == "cgo")
+        return cgo;
+
+    if (tag.starts_with("go1.")) {
+        unsigned minor = 0;
+        auto digits = tag.substr(4);
+        auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), minor);
+        return error == std::errc() && end == digits.data() + digits.size() && minor <= version;
+    }
+
+    return false;
+}
+
+Target host_target()
+{
+    Target target;
+
+#if defined(__APPLE__)
+    target.os = "darwin";
+#elif defined(_WIN32)
+    target.os = "windows";
+#elif defined(__FreeBSD__)
+    target.os = "freebsd";
+#else
+    target.os = "linux";
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+    target.arch = "arm64";
+#elif defined(__i386__) || defined(_M_IX86)
+    target.arch = "386";
+#else
+    target.arch = "amd64";
+#endif
+
+    return target;
+}
+
+bool matches_name(std::string_view file_name, const Target &target)
+{
+    if (!file_name.ends_with(".go"))
+        return false;
+
+    auto stem = file_name.substr(0, file_name.size() - 3);
+    if (stem.ends_with("_test")) {
+        stem.remove_suffix(5);
+    }
+
+    // Everything before the first _ is a name, never a constraint
+    auto first = stem.find('_');
+    if (first == std::string_view::npos)
+        return true;
+
+    stem = stem.substr(first);
+    auto last = stem.rfind('_');
+    auto tail = stem.substr(last + 1);
+
+    if (contains(known_arch, tail)) {
+        auto before = stem.substr(0, last);
+        auto os_start = before.rfind('_');
+        auto os = os_start == std::string_view::npos ? std::string_view{} : before.substr(os_start + 1);
+        if (contains(known_os, os))
+            return target.has_tag(os) && target.has_tag(tail);
+
+        return target.has_tag(tail);
+    }
+
+    if (contains(known_os, tail))
+        return target.has_tag(tail);
+
+    return true;
+}
+
+// Recursive descent over a //go:build expression, where || binds
+// loosest, then &&, then !
+class ExpressionParser {
+    std::string_view text;
+    size_t pos = 0;
+    const Target &target;
+
+    void skip_space() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r')) {
+            ++pos;
+        }
+    }
+
+    bool accept(std::string_view op) {
+        skip_space();
+        if (text.substr(pos, op.size()) != op)
+            return false;
+
+        pos += op.size();
+        return true;
+    }
+
+    std::optional<bool> operand() {
+        if (accept("!")) {
+            auto value = operand();
+            return value ? std::optional(!*value) : std::nullopt;
+        }
+
+        if (accept("(")) {
+            auto value = disjunction();
+            if (!value || !accept(")"))
+                return std::nullopt;
+
+            return value;
+        }
+
+        skip_space();
+        auto start = pos;
+        while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos]))
+                    || text[pos] == '_' || text[pos] == '.')) {
+            ++pos;
+        }
+
+        if (pos == start)
+            return std::nullopt;
+
+        return target.has_tag(text.substr(start, pos - start));
+    }
+
+    std::optional<bool> conjunction() {
+        auto value = operand();
+        while (value && accept("&&")) {
+            auto right = operand();
+            if (!right)
+                return std::nullopt;
+
+            value = *value && *right;
+        }
+
+        return value;
+    }
+
+    public:
+    ExpressionParser(std::string_view text, const Target &target): text{text}, target{target} {}
+
+    std::optional<bool> disjunction() {
+        auto value = conjunction();
+        while (value && accept("||")) {
+            auto right = conjunction();
+            if (!right)
+                return std::nullopt;
+
+            value = *value || *right;
+        }
+
+        return value;
+    }
+
+    bool at_end() {
+        skip_space();
+        return pos == text.size();
+    }
+};
+
+std::optional<bool> evaluate(std::string_view expression, const Target &target)
+{
+    ExpressionParser parser(expression, target);
+    auto value = parser.disjunction();
+    if (!value || !parser.at_end())
+        return std::nullopt;
+
+    return value;
+}
+
+}
+
+}
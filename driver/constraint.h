@@ -0,0 +1,41 @@
+#ifndef DRIVER_CONSTRAINT_H
+#define DRIVER_CONSTRAINT_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace goop
+{
+
+namespace driver
+{
+
+// The platform files are built for, and the tags that hold for it
+struct Target {
+    std::string os;
+    std::string arch;
+    bool cgo = false;
+    // go1.1 up to go1.<version> hold
+    unsigned version = 21;
+
+    bool has_tag(std::string_view tag) const;
+};
+
+// The platform goop runs on
+Target host_target();
+
+// Whether a file's name allows it on target. A name ending in _GOOS,
+// _GOARCH or _GOOS_GOARCH, before .go and any _test, is a constraint of
+// its own, just like the go tool reads it.
+bool matches_name(std::string_view file_name, const Target &target);
+
+// Whether a //go:build expression holds for target, nothing if it isn't a
+// valid expression
+std::optional<bool> evaluate(std::string_view expression, const Target &target);
+
+}
+
+}
+
+#endif
@@ -1,8 +1,133 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <string>
+#include "build.h"
+#include "thread_pool.h"
 
-int main()
+struct Options {
+    size_t threads = 0;
+    // Each package's imports from the build, under the package
+    bool graph = false;
+    // Only the totals
+    bool summary = false;
+    // Only read the headers of the files, for the import graph
+    bool imports = false;
+};
+
+static void usage()
+{
+    std::cerr << "usage: goop [-j threads] [--graph] [--summary] [--imports] directory\n"
+        << "Finds every package of the module or package in directory, reading the imports\n"
+        << "of each file and parsing it, and writes each package with the length of its\n"
+        << "longest chain of imports within the build\n"
+        << "-j sets the number of threads, one per hardware thread by default\n"
+        << "--graph also writes what each package imports from the build\n"
+        << "--summary only writes the totals\n"
+        << "--imports only reads each file as far as its imports, without parsing it\n"
+        << "Syntax errors and import cycles are reported on stderr, and make the exit status 1"
+        << std::endl;
+}
+
+int main(int argc, char **argv)
 {
-    std::cout << "hello" << std::endl;
+    Options options;
+    std::optional<std::string> directory;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            options.threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--graph") {
+            options.graph = true;
+        } else if (arg == "--summary") {
+            options.summary = true;
+        } else if (arg == "--imports") {
+            options.imports = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else if (arg.empty() || arg[0] == '-' || directory) {
+            usage();
+            return 1;
+        } else {
+            directory = arg;
+        }
+    }
+
+    if (!directory) {
+        usage();
+        return 1;
+    }
+
+    std::ios::sync_with_stdio(false);
+
+    goop::support::ThreadPool pool(options.threads);
+    goop::driver::Build build(pool, goop::driver::host_target(), !options.imports);
+    if (!build.run(*directory)) {
+        std::cerr << "goop: " << *directory << ": not a directory" << std::endl;
+        return 1;
+    }
+
+    int status = 0;
+    size_t files = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    auto packages = build.packages();
+
+    for (const auto *package : packages) {
+        files += package->files.size();
+        tokens += package->tokens;
+        nodes += package->nodes;
+
+        for (const auto &error : package->errors) {
+            std::cerr << error << '\n';
+            status = 1;
+        }
+
+        if (!package->complete) {
+            std::cerr << "goop: " << package->path << ": import cycle\n";
+            status = 1;
+        }
+
+        if (options.summary)
+            continue;
+
+        std::cout << "Package(path: " << package->path
+            << ", files: " << package->files.size();
+        if (!options.imports) {
+            std::cout << ", tokens: " << package->tokens
+                << ", nodes: " << package->nodes;
+        }
+        std::cout << ", level: ";
+        if (package->complete) {
+            std::cout << package->level;
+        } else {
+            std::cout << "cycle";
+        }
+        std::cout << ")\n";
+
+        if (options.graph) {
+            for (const auto &path : package->imports) {
+                // Packages are sorted by path
+                auto found = std::lower_bound(packages.begin(), packages.end(), path, [](const auto *other, const auto &path) {
+                    return other->path < path;
+                });
+                if (found != packages.end() && (*found)->path == path) {
+                    std::cout << "  import: " << path << '\n';
+                }
+            }
+        }
+    }
+
+    std::cout << "Build(packages: " << packages.size()
+        << ", files: " << files;
+    if (!options.imports) {
+        std::cout << ", tokens: " << tokens
+            << ", nodes: " << nodes;
+    }
+    std::cout << ")" << std::endl;
 
-    return 0;
+    return status;
 }
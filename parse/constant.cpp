@@ -0,0 +1,553 @@
+#include "constant.h"
+#include "numeric.h"
+#include <charconv>
+#include <limits>
+#include <utility>
+#include <variant>
+
+namespace goop
+{
+
+namespace constant
+{
+
+using boost::multiprecision::cpp_int;
+using boost::multiprecision::cpp_rational;
+using Op = tokens::Punctuation::Kind;
+
+// Complex values keep both parts as float kind values
+struct Value::Heap {
+    std::variant<cpp_int, cpp_rational, std::pair<Value, Value>> value;
+};
+
+// Largest shift count, enough to reach the smallest float64 from 1
+static constexpr uint64_t SHIFT_LIMIT = 1023 - 1 + 52;
+
+// Largest decimal exponent a float literal can have after moving its
+// point, about what 16 bits of binary exponent reach
+static constexpr int64_t EXPONENT_LIMIT = 10000;
+
+static bool is_integer_kind(Value::Kind kind)
+{
+    return kind == Value::Kind::INT || kind == Value::Kind::RUNE;
+}
+
+Value Value::make_int(Kind kind, cpp_int value)
+{
+    if (value >= std::numeric_limits<int64_t>::min() && value <= std::numeric_limits<int64_t>::max()) {
+        return Value(kind, static_cast<int64_t>(value));
+    }
+
+    return Value(kind, std::make_shared<const Heap>(Heap{std::move(value)}));
+}
+
+Value Value::make_rational(cpp_rational value)
+{
+    // Integral floats share the integer representation and fast paths
+    if (boost::multiprecision::denominator(value) == 1) {
+        return make_int(Kind::FLOAT, boost::multiprecision::numerator(value));
+    }
+
+    return Value(Kind::FLOAT, std::make_shared<const Heap>(Heap{std::move(value)}));
+}
+
+Value Value::integer(cpp_int value)
+{
+    return make_int(Kind::INT, std::move(value));
+}
+
+Value Value::rational(cpp_rational value)
+{
+    return make_rational(std::move(value));
+}
+
+Value Value::complex(const Value &real, const Value &imag)
+{
+    auto as_float = [](const Value &part) {
+        assert(part.kind() != Kind::COMPLEX && "Complex part of a complex value");
+        auto converted = part;
+        converted.value_kind = Kind::FLOAT;
+        return converted;
+    };
+
+    return Value(Kind::COMPLEX, std::make_shared<const Heap>(Heap{std::pair(as_float(real), as_float(imag))}));
+}
+
+bool Value::is_integral() const
+{
+    return !heap || std::holds_alternative<cpp_int>(heap->value);
+}
+
+cpp_int Value::to_cpp_int() const
+{
+    assert(is_integral() && "Not an integer");
+    if (!heap) {
+        return small;
+    }
+
+    return std::get<cpp_int>(heap->value);
+}
+
+cpp_rational Value::to_cpp_rational() const
+{
+    if (!heap) {
+        return small;
+    }
+
+    if (auto *integer = std::get_if<cpp_int>(&heap->value)) {
+        return *integer;
+    }
+
+    if (auto *ratio = std::get_if<cpp_rational>(&heap->value)) {
+        return *ratio;
+    }
+
+    return std::get<std::pair<Value, Value>>(heap->value).first.to_cpp_rational();
+}
+
+Value Value::real() const
+{
+    if (value_kind == Kind::COMPLEX) {
+        return std::get<std::pair<Value, Value>>(heap->value).first;
+    }
+
+    return *this;
+}
+
+Value Value::imag() const
+{
+    if (value_kind == Kind::COMPLEX) {
+        return std::get<std::pair<Value, Value>>(heap->value).second;
+    }
+
+    return Value(value_kind, int64_t(0));
+}
+
+std::optional<Value> Value::to_kind(Kind kind) const
+{
+    auto value = *this;
+    if (value_kind == Kind::COMPLEX && kind != Kind::COMPLEX) {
+        auto imaginary = imag();
+        if (!imaginary.is_small() || imaginary.small != 0)
+            return std::nullopt;
+
+        value = real();
+    }
+
+    if (kind == Kind::COMPLEX) {
+        return value_kind == Kind::COMPLEX ? value : complex(value, Value(0));
+    }
+
+    if (is_integer_kind(kind) && !value.is_integral())
+        return std::nullopt;
+
+    value.value_kind = kind;
+    return value;
+}
+
+std::optional<int64_t> Value::to_int64() const
+{
+    if (value_kind == Kind::COMPLEX || heap)
+        return std::nullopt;
+
+    return small;
+}
+
+double Value::to_double() const
+{
+    if (!heap) {
+        return static_cast<double>(small);
+    }
+
+    if (auto *integer = std::get_if<cpp_int>(&heap->value)) {
+        return tokens::rational_value(*integer, 1);
+    }
+
+    if (auto *ratio = std::get_if<cpp_rational>(&heap->value)) {
+        return tokens::rational_value(
+                boost::multiprecision::numerator(*ratio),
+                boost::multiprecision::denominator(*ratio));
+    }
+
+    return real().to_double();
+}
+
+// Digits of an integer literal in any radix, however many there are
+static cpp_int literal_digits(std::string_view digits, uint8_t radix)
+{
+    cpp_int value = 0;
+    for (auto c : digits) {
+        if (c == '_' || c == '.')
+            continue;
+
+        value *= radix;
+        value += c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+    }
+
+    return value;
+}
+
+// Strips the 0b/0o/0x prefix, an implicit octal 0 is just a digit
+static std::string_view without_prefix(std::string_view lit)
+{
+    if (lit.size() >= 2 && lit[0] == '0') {
+        auto prefix = lit[1] | 0x20;
+        if (prefix == 'b' || prefix == 'o' || prefix == 'x') {
+            lit.remove_prefix(2);
+        }
+    }
+
+    return lit;
+}
+
+Value Value::of(const tokens::IntLiteral &literal)
+{
+    if (literal.cached && *literal.cached <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+        return Value(static_cast<int64_t>(*literal.cached));
+    }
+
+    return make_int(Kind::INT, literal_digits(without_prefix(literal.lit), literal.radix));
+}
+
+Value Value::of(const tokens::RuneLiteral &literal)
+{
+    return Value(Kind::RUNE, int64_t(literal.rune));
+}
+
+std::optional<Value> Value::of(const tokens::FloatLiteral &literal)
+{
+    auto mantissa = without_prefix(literal.mantissa);
+
+    int64_t exponent = 0;
+    for (auto c : literal.exponent) {
+        if (c != '_' && exponent <= EXPONENT_LIMIT * 4) {
+            exponent = exponent * 10 + (c - '0');
+        }
+    }
+
+    if (literal.negative) {
+        exponent = -exponent;
+    }
+
+    // Each digit after the point moves the exponent by one digit's worth
+    auto point = mantissa.find('.');
+    if (point != std::string_view::npos) {
+        for (auto c : mantissa.substr(point + 1)) {
+            exponent -= c == '_' ? 0 : (literal.radix == 16 ? 4 : 1);
+        }
+    }
+
+    auto digits = literal_digits(mantissa, literal.radix);
+    if (digits == 0) {
+        return Value(Kind::FLOAT, int64_t(0));
+    }
+
+    uint32_t base = literal.radix == 16 ? 2 : 10;
+    auto limit = literal.radix == 16 ? EXPONENT_LIMIT * 4 : EXPONENT_LIMIT;
+    if (exponent > limit || exponent < -limit)
+        return std::nullopt;
+
+    // Not auto, which would keep the expression template referring to
+    // the cpp_int(base) temporary after it is gone
+    cpp_int power = boost::multiprecision::pow(cpp_int(base), static_cast<unsigned>(exponent < 0 ? -exponent : exponent));
+    if (exponent >= 0) {
+        return make_int(Kind::FLOAT, digits * power);
+    }
+
+    return make_rational(cpp_rational(digits, power));
+}
+
+std::optional<Value> Value::of(const tokens::ImaginaryLiteral &literal)
+{
+    std::optional<Value> imaginary = std::visit([](const auto &inner) -> std::optional<Value> {
+        return Value::of(inner);
+    }, literal.inner);
+
+    if (!imaginary)
+        return std::nullopt;
+
+    return complex(Value(0), *imaginary);
+}
+
+std::optional<Value> unary(Op op, const Value &x)
+{
+    switch (op) {
+    case Op::PLUS:
+        return x;
+    case Op::MINUS:
+        if (x.kind() == Value::Kind::COMPLEX) {
+            return Value::complex(*unary(op, x.real()), *unary(op, x.imag()));
+        }
+
+        if (!x.heap && x.small != std::numeric_limits<int64_t>::min()) {
+            return Value(x.kind(), -x.small);
+        }
+
+        if (x.is_integral()) {
+            return Value::make_int(x.kind(), -x.to_cpp_int());
+        }
+
+        return Value::make_rational(-x.to_cpp_rational());
+    case Op::CARAT:
+        if (!is_integer_kind(x.kind()))
+            return std::nullopt;
+
+        if (!x.heap) {
+            return Value(x.kind(), ~x.small);
+        }
+
+        return Value::make_int(x.kind(), -x.to_cpp_int() - 1);
+    default:
+        return std::nullopt;
+    }
+}
+
+static std::optional<Value> complex_binary(const Value &x, Op op, const Value &y)
+{
+    auto a = x.real(), b = x.imag();
+    auto c = y.real(), d = y.imag();
+
+    switch (op) {
+    case Op::PLUS:
+    case Op::MINUS:
+        return Value::complex(*binary(a, op, c), *binary(b, op, d));
+    case Op::STAR:
+        // (a + bi)(c + di) = (ac - bd) + (ad + bc)i
+        return Value::complex(
+                *binary(*binary(a, Op::STAR, c), Op::MINUS, *binary(b, Op::STAR, d)),
+                *binary(*binary(a, Op::STAR, d), Op::PLUS, *binary(b, Op::STAR, c)));
+    case Op::SLASH: {
+        // Multiply through by the conjugate of the divisor
+        auto scale = *binary(*binary(c, Op::STAR, c), Op::PLUS, *binary(d, Op::STAR, d));
+        auto real = *binary(*binary(a, Op::STAR, c), Op::PLUS, *binary(b, Op::STAR, d));
+        auto imag = *binary(*binary(b, Op::STAR, c), Op::MINUS, *binary(a, Op::STAR, d));
+
+        auto real_part = binary(real, Op::SLASH, scale);
+        auto imag_part = binary(imag, Op::SLASH, scale);
+        if (!real_part || !imag_part)
+            return std::nullopt;
+
+        return Value::complex(*real_part, *imag_part);
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<Value> binary(const Value &x, Op op, const Value &y)
+{
+    auto kind = std::max(x.kind(), y.kind());
+    bool integer = is_integer_kind(kind);
+
+    switch (op) {
+    case Op::PLUS:
+    case Op::MINUS:
+    case Op::STAR:
+    case Op::SLASH:
+        break;
+    case Op::PERCENT:
+    case Op::AMP:
+    case Op::PIPE:
+    case Op::CARAT:
+    case Op::BITCLEAR:
+        if (!integer)
+            return std::nullopt;
+        break;
+    default:
+        return std::nullopt;
+    }
+
+    if (kind == Value::Kind::COMPLEX) {
+        return complex_binary(x, op, y);
+    }
+
+    if (!x.heap && !y.heap) {
+        auto a = x.small, b = y.small;
+        int64_t result;
+
+        switch (op) {
+        case Op::PLUS:
+            if (!__builtin_add_overflow(a, b, &result))
+                return Value(kind, result);
+            break;
+        case Op::MINUS:
+            if (!__builtin_sub_overflow(a, b, &result))
+                return Value(kind, result);
+            break;
+        case Op::STAR:
+            if (!__builtin_mul_overflow(a, b, &result))
+                return Value(kind, result);
+            break;
+        case Op::SLASH:
+            if (b == 0)
+                return std::nullopt;
+
+            // Only INT64_MIN / -1 doesn't fit, and floats only stay
+            // integers when the division is exact
+            if ((b != -1 || a != std::numeric_limits<int64_t>::min()) && (integer || a % b == 0))
+                return Value(kind, a / b);
+            break;
+        case Op::PERCENT:
+            if (b == 0)
+                return std::nullopt;
+
+            return Value(kind, b == -1 ? 0 : a % b);
+        case Op::AMP:
+            return Value(kind, a & b);
+        case Op::PIPE:
+            return Value(kind, a | b);
+        case Op::CARAT:
+            return Value(kind, a ^ b);
+        case Op::BITCLEAR:
+            return Value(kind, a & ~b);
+        default:
+            break;
+        }
+    }
+
+    if (x.is_integral() && y.is_integral() && (integer || op != Op::SLASH)) {
+        auto a = x.to_cpp_int(), b = y.to_cpp_int();
+
+        switch (op) {
+        case Op::PLUS:
+            return Value::make_int(kind, a + b);
+        case Op::MINUS:
+            return Value::make_int(kind, a - b);
+        case Op::STAR:
+            return Value::make_int(kind, a * b);
+        case Op::SLASH:
+            if (b == 0)
+                return std::nullopt;
+            return Value::make_int(kind, a / b);
+        case Op::PERCENT:
+            if (b == 0)
+                return std::nullopt;
+            return Value::make_int(kind, a % b);
+        case Op::AMP:
+            return Value::make_int(kind, a & b);
+        case Op::PIPE:
+            return Value::make_int(kind, a | b);
+        case Op::CARAT:
+            return Value::make_int(kind, a ^ b);
+        case Op::BITCLEAR:
+            return Value::make_int(kind, a & ~b);
+        default:
+            return std::nullopt;
+        }
+    }
+
+    auto a = x.to_cpp_rational(), b = y.to_cpp_rational();
+    switch (op) {
+    case Op::PLUS:
+        return Value::make_rational(a + b);
+    case Op::MINUS:
+        return Value::make_rational(a - b);
+    case Op::STAR:
+        return Value::make_rational(a * b);
+    case Op::SLASH:
+        if (b == 0)
+            return std::nullopt;
+        return Value::make_rational(a / b);
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<Value> shift(const Value &x, Op op, uint64_t count)
+{
+    if (op != Op::LSHIFT && op != Op::RSHIFT)
+        return std::nullopt;
+
+    // Untyped shifts give integers, from any value that is one
+    auto kind = x.kind() == Value::Kind::RUNE ? Value::Kind::RUNE : Value::Kind::INT;
+    auto value = x.to_kind(kind);
+    if (!value)
+        return std::nullopt;
+
+    if (op == Op::LSHIFT && count > SHIFT_LIMIT)
+        return std::nullopt;
+
+    if (auto small = value->to_int64()) {
+        if (op == Op::RSHIFT) {
+            return Value(kind, count >= 64 ? (*small < 0 ? -1 : 0) : *small >> count);
+        }
+
+        if (count < 63 && (*small << count) >> count == *small) {
+            return Value(kind, *small << count);
+        }
+    }
+
+    auto big = value->to_cpp_int();
+    if (op == Op::LSHIFT) {
+        return Value::make_int(kind, big << count);
+    }
+
+    // Shifting right rounds towards negative infinity
+    if (big < 0) {
+        return Value::make_int(kind, -((-big - 1) >> count) - 1);
+    }
+
+    return Value::make_int(kind, big >> count);
+}
+
+std::optional<bool> compare(const Value &x, Op op, const Value &y)
+{
+    if (x.kind() == Value::Kind::COMPLEX || y.kind() == Value::Kind::COMPLEX) {
+        if (op != Op::EQUAL && op != Op::NOT_EQUAL)
+            return std::nullopt;
+
+        auto real = compare(x.real(), Op::EQUAL, y.real());
+        auto imag = compare(x.imag(), Op::EQUAL, y.imag());
+        return (*real && *imag) == (op == Op::EQUAL);
+    }
+
+    int order;
+    if (!x.heap && !y.heap) {
+        order = (x.small > y.small) - (x.small < y.small);
+    } else if (x.is_integral() && y.is_integral()) {
+        order = x.to_cpp_int().compare(y.to_cpp_int());
+    } else {
+        order = x.to_cpp_rational().compare(y.to_cpp_rational());
+    }
+
+    switch (op) {
+    case Op::EQUAL:
+        return order == 0;
+    case Op::NOT_EQUAL:
+        return order != 0;
+    case Op::LESS_THAN:
+        return order < 0;
+    case Op::LESS_THAN_EQUAL:
+        return order <= 0;
+    case Op::GREATER_THAN:
+        return order > 0;
+    case Op::GREATER_THAN_EQUAL:
+        return order >= 0;
+    default:
+        return std::nullopt;
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, const Value &value)
+{
+    if (value.kind() == Value::Kind::COMPLEX) {
+        return os << "(" << value.real() << " + " << value.imag() << "i)";
+    }
+
+    if (value.is_small()) {
+        return os << value.small;
+    }
+
+    if (is_integer_kind(value.kind())) {
+        return os << value.to_cpp_int();
+    }
+
+    // Floats are shown rounded to the nearest double
+    char text[32];
+    auto [end, _] = std::to_chars(std::begin(text), std::end(text), value.to_double());
+    return os << std::string_view(text, end - text);
+}
+
+}
+
+}
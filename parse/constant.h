@@ -0,0 +1,110 @@
+#ifndef PARSE_CONSTANT_H
+#define PARSE_CONSTANT_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <boost/multiprecision/cpp_int.hpp>
+#include "tokens.h"
+
+namespace goop
+{
+
+namespace constant
+{
+
+// Exact value of an untyped numeric constant.
+// Integers, and floats that happen to be integers, are held inline while
+// they fit in 64 bits, so folding ordinary constants never allocates.
+// Anything bigger lives in an immutable heap node shared between copies.
+class Value {
+    public:
+    // Ordered so that an operation on two kinds gives the larger one
+    enum class Kind : uint8_t {
+        INT,
+        RUNE,
+        FLOAT,
+        COMPLEX,
+    };
+
+    private:
+    struct Heap;
+
+    Kind value_kind;
+    int64_t small;
+    std::shared_ptr<const Heap> heap;
+
+    Value(Kind kind, int64_t small): value_kind{kind}, small{small} {}
+    Value(Kind kind, std::shared_ptr<const Heap> heap): value_kind{kind}, small{0}, heap{std::move(heap)} {}
+
+    static Value make_int(Kind kind, boost::multiprecision::cpp_int value);
+    static Value make_rational(boost::multiprecision::cpp_rational value);
+
+    bool is_integral() const;
+    boost::multiprecision::cpp_int to_cpp_int() const;
+    boost::multiprecision::cpp_rational to_cpp_rational() const;
+
+    friend std::optional<Value> unary(tokens::Punctuation::Kind op, const Value &x);
+    friend std::optional<Value> binary(const Value &x, tokens::Punctuation::Kind op, const Value &y);
+    friend std::optional<Value> shift(const Value &x, tokens::Punctuation::Kind op, uint64_t count);
+    friend std::optional<bool> compare(const Value &x, tokens::Punctuation::Kind op, const Value &y);
+
+    public:
+    Value(int64_t value = 0): value_kind{Kind::INT}, small{value} {}
+
+    static Value integer(boost::multiprecision::cpp_int value);
+    static Value rational(boost::multiprecision::cpp_rational value);
+    static Value complex(const Value &real, const Value &imag);
+
+    static Value of(const tokens::IntLiteral &literal);
+    static Value of(const tokens::RuneLiteral &literal);
+    // Fail for exponents too large to represent exactly
+    static std::optional<Value> of(const tokens::FloatLiteral &literal);
+    static std::optional<Value> of(const tokens::ImaginaryLiteral &literal);
+
+    Kind kind() const {
+        return value_kind;
+    }
+
+    // Whether the value is held inline rather than on the heap
+    bool is_small() const {
+        return !heap;
+    }
+
+    Value real() const;
+    Value imag() const;
+
+    // The same value as another kind, if it can be represented exactly:
+    // a float has to be integral to become an int, a complex has to have
+    // no imaginary part to become anything else
+    std::optional<Value> to_kind(Kind kind) const;
+
+    std::optional<int64_t> to_int64() const;
+    // Correctly rounded, of the real part for complex values
+    double to_double() const;
+
+    friend std::ostream &operator<<(std::ostream &os, const Value &value);
+};
+
+// + - and ^ (bitwise complement, integers only)
+std::optional<Value> unary(tokens::Punctuation::Kind op, const Value &x);
+
+// + - * / for every kind, % & | ^ &^ for integers only.
+// Dividing two integers truncates, anything else divides exactly.
+// Fails on division by zero and operators the kinds don't support.
+std::optional<Value> binary(const Value &x, tokens::Punctuation::Kind op, const Value &y);
+
+// << and >> of a value that is integral, giving an integer.
+// Counts past what a float64 could still tell apart are rejected,
+// like the go tool does.
+std::optional<Value> shift(const Value &x, tokens::Punctuation::Kind op, uint64_t count);
+
+// == != < <= > >=, complex values can only be compared for equality
+std::optional<bool> compare(const Value &x, tokens::Punctuation::Kind op, const Value &y);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include "interner.h"
+#include "tokens.h"
+#include <cassert>
+#include <cstring>
+#include <functional>
+
+namespace goop
+{
+
+namespace tokens
+{
+
+std::string_view Interner::Shard::store(std::string_view name)
+{
+    if (name.size() > block_remaining) {
+        // Oversized names get a block of their own so the
+        // current block can keep being filled
+        auto size = std::max(name.size(), BLOCK_SIZE);
+        blocks.push_back(std::make_unique<char[]>(size));
+
+        if (size > BLOCK_SIZE) {
+            std::memcpy(blocks.back().get(), name.data(), name.size());
+            return std::string_view(blocks.back().get(), name.size());
+        }
+
+        block_cursor = blocks.back().get();
+        block_remaining = size;
+    }
+
+    std::memcpy(block_cursor, name.data(), name.size());
+    std::string_view stored(block_cursor, name.size());
+    block_cursor += name.size();
+    block_remaining -= name.size();
+    return stored;
+}
+
+Interner::Interner(std::span<const std::string_view> reserved):
+    chunks{std::make_unique<std::atomic<std::string_view *>[]>(MAX_CHUNKS)},
+    next_symbol{0}
+{
+    for (auto name : reserved) {
+        [[maybe_unused]] auto expected = next_symbol.load();
+        [[maybe_unused]] auto symbol = intern(name);
+        assert(symbol == expected && "Reserved names must be distinct");
+    }
+}
+
+Interner::~Interner()
+{
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+        delete[] chunks[i].load(std::memory_order_relaxed);
+    }
+}
+
+Interner &Interner::global()
+{
+    static const auto keywords = [] {
+        std::array<std::string_view, Keyword::count> spellings;
+        for (uint32_t kind = 0; kind < Keyword::count; ++kind) {
+            spellings[kind] = Keyword::spelling(static_cast<Keyword::Kind>(kind));
+        }
+
+        return spellings;
+    }();
+
+    static Interner interner(keywords);
+    return interner;
+}
+
+void Interner::publish(Symbol symbol, std::string_view name)
+{
+    auto &chunk = chunks[symbol >> CHUNK_BITS];
+    auto *entries = chunk.load(std::memory_order_acquire);
+    if (!entries) {
+        std::lock_guard lock(chunk_mutex);
+        entries = chunk.load(std::memory_order_acquire);
+        if (!entries) {
+            entries = new std::string_view[CHUNK_SIZE];
+            chunk.store(entries, std::memory_order_release);
+        }
+    }
+
+    entries[symbol & (CHUNK_SIZE - 1)] = name;
+}
+
+Symbol Interner::intern(std::string_view name)
+{
+    auto hash = std::hash<std::string_view>{}(name);
+    auto &shard = shards[hash >> (sizeof(hash) * 8 - SHARD_BITS)];
+
+    // Almost every lookup is a name that has been seen before,
+    // those only need the shared lock
+    {
+        std::shared_lock lock(shard.mutex);
+        auto existing = shard.symbols.find(name);
+        if (existing != shard.symbols.end()) {
+            return existing->second;
+        }
+    }
+
+    std::unique_lock lock(shard.mutex);
+    auto existing = shard.symbols.find(name);
+    if (existing != shard.symbols.end()) {
+        return existing->second;
+    }
+
+    auto stored = shard.store(name);
+    auto symbol = next_symbol.fetch_add(1, std::memory_order_relaxed);
+    publish(symbol, stored);
+    shard.symbols.emplace(stored, symbol);
+    return symbol;
+}
+
+std::string_view Interner::name(Symbol symbol) const
+{
+    assert(symbol < size() && "Unknown symbol");
+    auto *entries = chunks[symbol >> CHUNK_BITS].load(std::memory_order_acquire);
+    return entries[symbol & (CHUNK_SIZE - 1)];
+}
+
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef PARSE_INTERNER_H
+#define PARSE_INTERNER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace goop
+{
+
+namespace tokens
+{
+
+typedef uint32_t Symbol;
+
+// Maps each distinct identifier spelling to a stable 32 bit symbol.
+// Safe to use from any number of threads: names are spread over shards
+// that each take a reader/writer lock, and symbol to name lookups are
+// lock free. Interned names live as long as the interner.
+class Interner {
+    static constexpr size_t SHARD_BITS = 6;
+    static constexpr size_t SHARDS = size_t(1) << SHARD_BITS;
+    static constexpr size_t CHUNK_BITS = 14;
+    static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static constexpr size_t MAX_CHUNKS = size_t(1) << (32 - CHUNK_BITS);
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    struct alignas(64) Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string_view, Symbol> symbols;
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char *block_cursor = nullptr;
+        size_t block_remaining = 0;
+
+        std::string_view store(std::string_view name);
+    };
+
+    std::array<Shard, SHARDS> shards;
+
+    // Symbol -> name, in fixed size chunks that are never moved
+    // so readers don't need a lock
+    std::unique_ptr<std::atomic<std::string_view *>[]> chunks;
+    std::mutex chunk_mutex;
+    std::atomic<Symbol> next_symbol;
+
+    void publish(Symbol symbol, std::string_view name);
+
+    public:
+    // The reserved names are interned first, in order,
+    // so they get the symbols 0 to reserved.size() - 1
+    Interner(std::span<const std::string_view> reserved = {});
+    ~Interner();
+
+    Interner(const Interner &) = delete;
+    Interner &operator=(const Interner &) = delete;
+
+    // Shared by every lexer in the process, seeded with the keywords
+    // so that a symbol below Keyword::count is that keyword's kind
+    static Interner &global();
+
+    Symbol intern(std::string_view name);
+    std::string_view name(Symbol symbol) const;
+
+    size_t size() const {
+        return next_symbol.load(std::memory_order_relaxed);
+    }
+};
+
+}
+
+}
+
+#endif
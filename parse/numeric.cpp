@@ -0,0 +1,489 @@
+#include "numeric.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <boost/multiprecision/cpp_int.hpp>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace goop
+{
+
+namespace tokens
+{
+
+// The kernels below work on eight digits at once, held one per byte of
+// a 64 bit word with the first digit in the lowest byte
+
+static constexpr uint64_t repeat(uint8_t byte)
+{
+    return 0x0101010101010101ULL * byte;
+}
+
+static uint64_t load8(const char *p)
+{
+    uint64_t bytes;
+    std::memcpy(&bytes, p, sizeof(bytes));
+    if constexpr (std::endian::native == std::endian::big) {
+        bytes = __builtin_bswap64(bytes);
+    }
+
+    return bytes;
+}
+
+static bool has_separator(uint64_t bytes)
+{
+    auto x = bytes ^ repeat('_');
+    return ((x - repeat(0x01)) & ~x & repeat(0x80)) != 0;
+}
+
+// Values of eight ASCII digits already known to be valid in radix
+static uint64_t digit_values(uint64_t bytes, uint8_t radix)
+{
+    if (radix == 16) {
+        // Letters have bit 6 set and their value - 9 in the low nibble
+        return (bytes & repeat(0x0F)) + 9 * ((bytes >> 6) & repeat(0x01));
+    }
+
+    return bytes - repeat('0');
+}
+
+// Folds neighbouring digits together, first pairs into 16 bit lanes,
+// then those into 32 bit lanes, then into one number. Eight digits of
+// any radix up to 16 fit in 32 bits, so no lane overflows into the next.
+static uint64_t combine_digits(uint64_t digits, uint64_t radix)
+{
+    auto radix2 = radix * radix;
+    digits = (digits * radix + (digits >> 8)) & 0x00FF00FF00FF00FFULL;
+    digits = (digits * radix2 + (digits >> 16)) & 0x0000FFFF0000FFFFULL;
+    return (digits * (radix2 * radix2) + (digits >> 32)) & 0xFFFFFFFFULL;
+}
+
+static uint64_t valid_digit_value(char c)
+{
+    return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+std::optional<uint64_t> int_literal_value(std::string_view lit, uint8_t radix)
+{
+    // The implicit octal prefix is just a 0 digit
+    if (lit.size() >= 2 && lit[0] == '0') {
+        auto prefix = lit[1] | 0x20;
+        if (prefix == 'b' || prefix == 'o' || prefix == 'x') {
+            lit.remove_prefix(2);
+        }
+    }
+
+    uint64_t radix8 = radix;
+    radix8 *= radix8;
+    radix8 *= radix8;
+    radix8 *= radix8;
+
+    uint64_t value = 0;
+    const char *p = lit.data();
+    const char *end = p + lit.size();
+
+    while (p < end) {
+        if (end - p >= 8) {
+            auto bytes = load8(p);
+            if (!has_separator(bytes)) {
+                uint64_t shifted;
+                if (__builtin_mul_overflow(value, radix8, &shifted)
+                        || __builtin_add_overflow(shifted, combine_digits(digit_values(bytes, radix), radix), &value)) {
+                    return std::nullopt;
+                }
+
+                p += 8;
+                continue;
+            }
+        }
+
+        if (*p != '_') {
+            uint64_t shifted;
+            if (__builtin_mul_overflow(value, radix, &shifted)
+                    || __builtin_add_overflow(shifted, valid_digit_value(*p), &value)) {
+                return std::nullopt;
+            }
+        }
+
+        ++p;
+    }
+
+    return value;
+}
+
+// Digits of a float exponent past this many make no difference to the
+// result and would only risk overflowing
+static constexpr int64_t EXPONENT_LIMIT = 100000000;
+
+static int64_t exponent_value(std::string_view exponent, bool negative)
+{
+    int64_t value = 0;
+    for (auto c : exponent) {
+        if (c != '_' && value < EXPONENT_LIMIT) {
+            value = value * 10 + (c - '0');
+        }
+    }
+
+    return negative ? -value : value;
+}
+
+// Correctly rounded m * 2^e, where sticky says that nonzero bits below m
+// were dropped. Rounds to nearest, ties to even.
+static double round_binary(uint64_t m, bool sticky, int64_t e)
+{
+    if (m == 0)
+        return 0.0;
+
+    auto zeros = std::countl_zero(m);
+    m <<= zeros;
+    e -= zeros;
+
+    // Keep 53 bits, or fewer once the result is subnormal
+    auto unit = std::max<int64_t>(e + 11, -1074);
+    auto shift = unit - e;
+    if (shift > 64)
+        return 0.0;
+
+    uint64_t q, rest, half;
+    if (shift == 64) {
+        q = 0;
+        rest = m;
+        half = uint64_t(1) << 63;
+    } else {
+        q = m >> shift;
+        rest = m & ((uint64_t(1) << shift) - 1);
+        half = uint64_t(1) << (shift - 1);
+    }
+
+    if (rest > half || (rest == half && (sticky || (q & 1)))) {
+        ++q;
+    }
+
+    if (q == uint64_t(1) << 53) {
+        q >>= 1;
+        ++unit;
+    }
+
+    if (unit + 52 > 1023)
+        return std::numeric_limits<double>::infinity();
+
+    return std::ldexp(static_cast<double>(q), static_cast<int>(unit));
+}
+
+static double hex_float_value(std::string_view mantissa, int64_t exponent)
+{
+    mantissa.remove_prefix(2);
+
+    // The first 16 significant digits are kept, the rest only matter
+    // for rounding
+    uint64_t m = 0;
+    bool sticky = false;
+    bool after_point = false;
+    for (auto c : mantissa) {
+        if (c == '_')
+            continue;
+
+        if (c == '.') {
+            after_point = true;
+            continue;
+        }
+
+        auto digit = valid_digit_value(c);
+        if (m >> 60 == 0) {
+            m = m * 16 + digit;
+            exponent -= after_point ? 4 : 0;
+        } else {
+            sticky |= digit != 0;
+            exponent += after_point ? 0 : 4;
+        }
+    }
+
+    return round_binary(m, sticky, exponent);
+}
+
+// Decimal mantissa as an integer w times 10^q, w holding the first 19
+// significant digits
+struct Decimal {
+    uint64_t w = 0;
+    int64_t q = 0;
+    size_t digits = 0;
+    bool truncated = false;
+};
+
+static Decimal parse_decimal(std::string_view mantissa)
+{
+    Decimal decimal;
+    bool after_point = false;
+    for (auto c : mantissa) {
+        if (c == '_')
+            continue;
+
+        if (c == '.') {
+            after_point = true;
+            continue;
+        }
+
+        uint64_t digit = c - '0';
+        if (decimal.digits < 19) {
+            decimal.w = decimal.w * 10 + digit;
+            decimal.q -= after_point;
+
+            // Leading zeros aren't significant
+            decimal.digits += decimal.w != 0;
+        } else {
+            decimal.truncated |= digit != 0;
+            decimal.q += !after_point;
+        }
+    }
+
+    return decimal;
+}
+
+__extension__ typedef unsigned __int128 Uint128;
+
+static constexpr int SMALLEST_POWER_OF_TEN = -342;
+static constexpr int LARGEST_POWER_OF_TEN = 308;
+
+// 128 bit approximations of 5^q for every power of ten a double can
+// need, scaled to start with a set bit. Computed once with big integers
+// the same way as the fast_float library's table: truncated for q >= 0,
+// rounded up for q < 0.
+static const std::array<Uint128, LARGEST_POWER_OF_TEN - SMALLEST_POWER_OF_TEN + 1> &powers_of_five()
+{
+    static const auto table = [] {
+        using boost::multiprecision::cpp_int;
+
+        std::array<Uint128, LARGEST_POWER_OF_TEN - SMALLEST_POWER_OF_TEN + 1> table;
+        const cpp_int limit = cpp_int(1) << 128;
+
+        for (int q = SMALLEST_POWER_OF_TEN; q <= LARGEST_POWER_OF_TEN; ++q) {
+            cpp_int power = boost::multiprecision::pow(cpp_int(5), static_cast<unsigned>(std::abs(q)));
+            if (q < 0) {
+                auto z = boost::multiprecision::msb(power) + 1;
+                auto b = q >= -27 ? z + 127 : 2 * z + 128;
+                power = (cpp_int(1) << b) / power + 1;
+            } else {
+                while (power < limit / 2) {
+                    power <<= 1;
+                }
+            }
+
+            while (power >= limit) {
+                power >>= 1;
+            }
+
+            table[q - SMALLEST_POWER_OF_TEN] = static_cast<Uint128>(power >> 64) << 64
+                | static_cast<uint64_t>(power & std::numeric_limits<uint64_t>::max());
+        }
+
+        return table;
+    }();
+
+    return table;
+}
+
+// Biased exponent and stored mantissa bits of a double
+struct AdjustedMantissa {
+    uint64_t mantissa;
+    int32_t power2;
+
+    bool operator==(const AdjustedMantissa &) const = default;
+
+    double value() const {
+        return std::bit_cast<double>(mantissa | static_cast<uint64_t>(power2) << 52);
+    }
+};
+
+// Eisel-Lemire: w * 10^q rounded to a double from the top bits of w
+// times a 128 bit approximation of 5^q, exact for any w and q
+// (Mushtak and Lemire, "Fast number parsing without fallback")
+static AdjustedMantissa eisel_lemire(uint64_t w, int64_t q)
+{
+    if (w == 0 || q < SMALLEST_POWER_OF_TEN)
+        return {0, 0};
+
+    if (q > LARGEST_POWER_OF_TEN)
+        return {0, 0x7FF};
+
+    auto zeros = std::countl_zero(w);
+    w <<= zeros;
+
+    auto power = powers_of_five()[q - SMALLEST_POWER_OF_TEN];
+    auto product = static_cast<Uint128>(w) * static_cast<uint64_t>(power >> 64);
+    auto high = static_cast<uint64_t>(product >> 64);
+    auto low = static_cast<uint64_t>(product);
+
+    // Only when the bits below the 55 kept ones are all set can the low
+    // half of the power make a difference
+    constexpr uint64_t precision_mask = std::numeric_limits<uint64_t>::max() >> 55;
+    if ((high & precision_mask) == precision_mask) {
+        auto second = static_cast<Uint128>(w) * static_cast<uint64_t>(power);
+        auto second_high = static_cast<uint64_t>(second >> 64);
+        low += second_high;
+        if (second_high > low) {
+            ++high;
+        }
+    }
+
+    int upper_bit = static_cast<int>(high >> 63);
+    int shift = upper_bit + 64 - 52 - 3;
+
+    AdjustedMantissa answer;
+    answer.mantissa = high >> shift;
+    answer.power2 = static_cast<int32_t>((((152170 + 65536) * q) >> 16) + 63 + upper_bit - zeros + 1023);
+
+    if (answer.power2 <= 0) {
+        if (-answer.power2 + 1 >= 64)
+            return {0, 0};
+
+        answer.mantissa >>= -answer.power2 + 1;
+        answer.mantissa += answer.mantissa & 1;
+        answer.mantissa >>= 1;
+        answer.power2 = answer.mantissa < (uint64_t(1) << 52) ? 0 : 1;
+        return answer;
+    }
+
+    // Exactly halfway between two doubles, which can only happen for
+    // these q, has to round to even
+    if (low <= 1 && q >= -4 && q <= 23 && (answer.mantissa & 3) == 1
+            && (answer.mantissa << shift) == high) {
+        answer.mantissa &= ~uint64_t(1);
+    }
+
+    answer.mantissa += answer.mantissa & 1;
+    answer.mantissa >>= 1;
+    if (answer.mantissa >= uint64_t(2) << 52) {
+        answer.mantissa = uint64_t(1) << 52;
+        ++answer.power2;
+    }
+
+    answer.mantissa &= ~(uint64_t(1) << 52);
+    if (answer.power2 >= 0x7FF)
+        return {0, 0x7FF};
+
+    return answer;
+}
+
+// Every digit of the mantissa as a big integer over a power of ten,
+// rounded exactly. Only needed when more than 19 significant digits
+// leave the fast paths unsure.
+static double exact_decimal_value(std::string_view mantissa, int64_t exponent)
+{
+    using boost::multiprecision::cpp_int;
+
+    cpp_int digits = 0;
+    int64_t significant = 0;
+    bool after_point = false;
+    for (auto c : mantissa) {
+        if (c == '_')
+            continue;
+
+        if (c == '.') {
+            after_point = true;
+            continue;
+        }
+
+        digits = digits * 10 + (c - '0');
+        exponent -= after_point;
+        significant += digits != 0;
+    }
+
+    if (digits == 0 || exponent + significant <= -324)
+        return 0.0;
+
+    if (exponent + significant > 310)
+        return std::numeric_limits<double>::infinity();
+
+    cpp_int numerator = digits;
+    cpp_int denominator = 1;
+    if (exponent >= 0) {
+        numerator *= boost::multiprecision::pow(cpp_int(10), static_cast<unsigned>(exponent));
+    } else {
+        denominator = boost::multiprecision::pow(cpp_int(10), static_cast<unsigned>(-exponent));
+    }
+
+    return rational_value(numerator, denominator);
+}
+
+double rational_value(
+        const boost::multiprecision::cpp_int &numerator,
+        const boost::multiprecision::cpp_int &denominator
+)
+{
+    using boost::multiprecision::cpp_int;
+
+    if (numerator < 0)
+        return -rational_value(-numerator, denominator);
+
+    if (numerator == 0)
+        return 0.0;
+
+    // Scale so the quotient has exactly 64 bits, the remainder only
+    // matters as a sticky bit
+    int64_t scale = 63 - (static_cast<int64_t>(boost::multiprecision::msb(numerator))
+            - static_cast<int64_t>(boost::multiprecision::msb(denominator)));
+
+    // Anything this far out of range is 0 or infinite either way
+    if (scale > 1200)
+        return 0.0;
+    if (scale < -1200)
+        return std::numeric_limits<double>::infinity();
+
+    cpp_int quotient, remainder;
+    while (true) {
+        auto scaled_numerator = scale >= 0 ? cpp_int(numerator << scale) : numerator;
+        auto scaled_denominator = scale >= 0 ? denominator : cpp_int(denominator << -scale);
+        boost::multiprecision::divide_qr(scaled_numerator, scaled_denominator, quotient, remainder);
+
+        if (boost::multiprecision::msb(quotient) == 63)
+            break;
+
+        ++scale;
+    }
+
+    return round_binary(static_cast<uint64_t>(quotient), remainder != 0, -scale);
+}
+
+double float_literal_value(
+        std::string_view mantissa,
+        std::string_view exponent,
+        bool negative_exponent,
+        uint8_t radix
+)
+{
+    auto exponent10 = exponent_value(exponent, negative_exponent);
+    if (radix == 16) {
+        return hex_float_value(mantissa, exponent10);
+    }
+
+    auto decimal = parse_decimal(mantissa);
+    auto q = decimal.q + exponent10;
+
+    // Clinger: both w and the power of ten are exact doubles, so one
+    // correctly rounded operation gives the answer
+    static constexpr double exact_powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    if (!decimal.truncated && decimal.w <= uint64_t(1) << 53 && q >= -22 && q <= 22) {
+        auto w = static_cast<double>(decimal.w);
+        return q < 0 ? w / exact_powers[-q] : w * exact_powers[q];
+    }
+
+    auto answer = eisel_lemire(decimal.w, q);
+
+    // The dropped digits put the value between w and w + 1, if both
+    // round the same way so does the value
+    if (decimal.truncated && eisel_lemire(decimal.w + 1, q) != answer) {
+        return exact_decimal_value(mantissa, exponent10);
+    }
+
+    return answer.value();
+}
+
+}
+
+}
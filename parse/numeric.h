@@ -0,0 +1,73 @@
+#ifndef PARSE_NUMERIC_H
+#define PARSE_NUMERIC_H
+
+#include <bit>
+#include <boost/multiprecision/cpp_int.hpp>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+namespace goop
+{
+
+namespace tokens
+{
+
+// Value of an integer literal as it was lexed, radix prefix and digit
+// separators included. The digits have to be valid in radix.
+// Empty if the value doesn't fit in 64 bits.
+std::optional<uint64_t> int_literal_value(std::string_view lit, uint8_t radix);
+
+// Correctly rounded double value of a float literal, in the parts the
+// lexer splits it into: the mantissa with any radix prefix and point,
+// the exponent digits and the exponent's sign. Values too large for a
+// double are infinite, too small ones are 0.
+double float_literal_value(
+        std::string_view mantissa,
+        std::string_view exponent,
+        bool negative_exponent,
+        uint8_t radix
+);
+
+// Correctly rounded double value of numerator / denominator,
+// denominator being positive
+double rational_value(
+        const boost::multiprecision::cpp_int &numerator,
+        const boost::multiprecision::cpp_int &denominator
+);
+
+// Number of leading bytes of text that are decimal digits, checked
+// eight at a time and counted in whole blocks of eight, so the caller
+// finishes the run a byte at a time. Clears in_radix if any of those
+// digits is too big for radix.
+inline size_t decimal_digit_blocks(std::string_view text, uint8_t radix, bool &in_radix)
+{
+    constexpr uint64_t ones = 0x0101010101010101ULL;
+    constexpr uint64_t high = 0x8080808080808080ULL;
+    constexpr uint64_t nibbles = 0xF0F0F0F0F0F0F0F0ULL;
+
+    size_t i = 0;
+    for (; i + 8 <= text.size(); i += 8) {
+        uint64_t bytes;
+        std::memcpy(&bytes, text.data() + i, sizeof(bytes));
+
+        // Every byte is 0x30 to 0x39 when the high nibbles are all 3,
+        // both before and after adding 6
+        if (((bytes & nibbles) | (((bytes + 6 * ones) & nibbles) >> 4)) != 0x33 * ones)
+            break;
+
+        // Digits of radix or more carry into the high bit
+        if (radix < 10 && ((bytes + (0x80 - '0' - radix) * ones) & high)) {
+            in_radix = false;
+        }
+    }
+
+    return i;
+}
+
+}
+
+}
+
+#endif
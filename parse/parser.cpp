@@ -0,0 +1,2030 @@
+#include "parser.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace goop
+{
+
+namespace parser
+{
+
+using tokens::Keyword;
+using tokens::Punctuation;
+using tokens::TokenKind;
+
+static constexpr Layout layouts[] = {
+    {"File", Operand::LIST, Operand::NONE, "", "decls"},
+    {"Bad", Operand::NONE, Operand::NONE, "", ""},
+    {"Package", Operand::NODE, Operand::NONE, "", "name"},
+    {"GenDecl", Operand::LIST, Operand::NONE, "", "specs"},
+    {"ImportSpec", Operand::NODE, Operand::NONE, "", "name"},
+    {"ValueSpec", Operand::EXTRA, Operand::NONE, "rnr", "names type values"},
+    {"TypeSpec", Operand::EXTRA, Operand::NONE, "nnn", "name params type"},
+    {"AliasSpec", Operand::EXTRA, Operand::NONE, "nnn", "name params type"},
+    {"FuncDecl", Operand::EXTRA, Operand::NODE, "nnnn", "receiver name params type body"},
+    {"FieldList", Operand::LIST, Operand::NONE, "", "fields"},
+    {"Field", Operand::EXTRA, Operand::NONE, "rnn", "names type tag"},
+    {"Ident", Operand::NONE, Operand::NONE, "", ""},
+    {"BasicLit", Operand::NONE, Operand::NONE, "", ""},
+    {"CompositeLit", Operand::EXTRA, Operand::NONE, "nr", "type elements"},
+    {"KeyValue", Operand::NODE, Operand::NODE, "", "key value"},
+    {"FuncLit", Operand::NODE, Operand::NODE, "", "type body"},
+    {"Paren", Operand::NODE, Operand::NONE, "", "x"},
+    {"Selector", Operand::NODE, Operand::NODE, "", "x sel"},
+    {"Index", Operand::NODE, Operand::NODE, "", "x index"},
+    {"IndexList", Operand::EXTRA, Operand::NONE, "nr", "x indices"},
+    {"Slice", Operand::EXTRA, Operand::NONE, "nnnn", "x low high max"},
+    {"TypeAssert", Operand::NODE, Operand::NODE, "", "x type"},
+    {"Call", Operand::EXTRA, Operand::VALUE, "nr", "fun args ellipsis"},
+    {"Unary", Operand::NODE, Operand::NONE, "", "x"},
+    {"Binary", Operand::NODE, Operand::NODE, "", "x y"},
+    {"Ellipsis", Operand::NODE, Operand::NONE, "", "elem"},
+    {"ArrayType", Operand::NODE, Operand::NODE, "", "len elem"},
+    {"SliceType", Operand::NODE, Operand::NONE, "", "elem"},
+    {"MapType", Operand::NODE, Operand::NODE, "", "key value"},
+    {"ChanType", Operand::NODE, Operand::VALUE, "", "elem dir"},
+    {"FuncType", Operand::NODE, Operand::NODE, "", "params results"},
+    {"StructType", Operand::LIST, Operand::NONE, "", "fields"},
+    {"InterfaceType", Operand::LIST, Operand::NONE, "", "elements"},
+    {"Block", Operand::LIST, Operand::NONE, "", "statements"},
+    {"LazyBlock", Operand::NONE, Operand::VALUE, "", "end"},
+    {"Labeled", Operand::NODE, Operand::NODE, "", "label statement"},
+    {"Send", Operand::NODE, Operand::NODE, "", "chan value"},
+    {"IncDec", Operand::NODE, Operand::NONE, "", "x"},
+    {"Assign", Operand::EXTRA, Operand::NONE, "rr", "lhs rhs"},
+    {"Go", Operand::NODE, Operand::NONE, "", "call"},
+    {"Defer", Operand::NODE, Operand::NONE, "", "call"},
+    {"Return", Operand::LIST, Operand::NONE, "", "results"},
+    {"Branch", Operand::NODE, Operand::NONE, "", "label"},
+    {"If", Operand::EXTRA, Operand::NONE, "nnnn", "init cond then else"},
+    {"Switch", Operand::EXTRA, Operand::NONE, "nnr", "init tag clauses"},
+    {"TypeSwitch", Operand::EXTRA, Operand::NONE, "nnr", "init assign clauses"},
+    {"CaseClause", Operand::EXTRA, Operand::NONE, "rr", "list body"},
+    {"Select", Operand::LIST, Operand::NONE, "", "clauses"},
+    {"CommClause", Operand::EXTRA, Operand::NONE, "nr", "comm body"},
+    {"For", Operand::EXTRA, Operand::NODE, "nnn", "init cond post body"},
+    {"Range", Operand::NODE, Operand::NODE, "", "clause body"},
+};
+
+static_assert(std::size(layouts) == static_cast<size_t>(NodeKind::count));
+
+const Layout &layout(NodeKind kind)
+{
+    return layouts[static_cast<size_t>(kind)];
+}
+
+// Channel directions of a ChanType
+enum ChanDir : uint32_t {
+    BOTH,
+    SEND,
+    RECEIVE,
+};
+
+Ast::Ast(const tokens::TokenStream &stream):
+    arena{std::make_unique<support::Arena>()},
+    stream{&stream},
+    node_list{*arena},
+    extra_data{*arena}
+{
+    node_list.push_back(Node{NodeKind::FILE, 0, 0, 0});
+}
+
+void Ast::reset()
+{
+    node_list.release();
+    extra_data.release();
+    error_list.clear();
+    arena->reset();
+    node_list.push_back(Node{NodeKind::FILE, 0, 0, 0});
+}
+
+// Recursive descent over the significant tokens of a stream, with
+// binary expressions parsed by precedence climbing. Lists of children
+// are gathered on a stack shared by every level of the recursion and
+// copied into the extra data once complete, so that each list ends up
+// contiguous however deeply its elements nest.
+class Parser {
+    const tokens::TokenStream &stream;
+    std::span<const TokenKind> kinds;
+    std::span<const uint32_t> payloads;
+    Ast &ast;
+    const BracketIndex *lazy_bodies;
+
+    // The current token, skipping comments. The end of the stream once
+    // every token is consumed.
+    size_t pos = 0;
+    // Whether the current token is a semicolon inserted before pos
+    bool semicolon = false;
+    // Below zero in the header of an if, for or switch, where a { ends
+    // the expression rather than starting a composite literal
+    int expr_level = 0;
+    std::vector<uint32_t> scratch;
+
+    // A name, a type or both, in a parameter list
+    struct Entry {
+        size_t token;
+        NodeId name;
+        NodeId type;
+    };
+
+    // Entries of the parameter lists being parsed, innermost last
+    std::vector<Entry> entries;
+
+    size_t skip_comments(size_t index) const {
+        while (index < kinds.size() && kinds[index] == TokenKind::COMMENT) {
+            ++index;
+        }
+
+        return index;
+    }
+
+    void advance() {
+        if (semicolon) {
+            semicolon = false;
+            return;
+        }
+
+        if (pos == kinds.size())
+            return;
+
+        auto next = skip_comments(pos + 1);
+        semicolon = stream.semicolon_between(pos, next);
+        pos = next;
+    }
+
+    // Index of the significant token n after the current one, looking
+    // past inserted semicolons
+    size_t peek_index(size_t n) const {
+        auto index = pos;
+        for (size_t i = 0; i < n && index < kinds.size(); ++i) {
+            index = skip_comments(index + 1);
+        }
+
+        return index;
+    }
+
+    bool at_end() const {
+        return !semicolon && pos == kinds.size();
+    }
+
+    bool is_punctuation_at(size_t index, Punctuation::Kind kind) const {
+        return index < kinds.size() && kinds[index] == TokenKind::PUNCTUATION && payloads[index] == kind;
+    }
+
+    bool is_keyword_at(size_t index, Keyword::Kind kind) const {
+        return index < kinds.size() && kinds[index] == TokenKind::KEYWORD && payloads[index] == kind;
+    }
+
+    bool is(Punctuation::Kind kind) const {
+        return !semicolon && is_punctuation_at(pos, kind);
+    }
+
+    bool is(Keyword::Kind kind) const {
+        return !semicolon && is_keyword_at(pos, kind);
+    }
+
+    bool is(TokenKind kind) const {
+        return !semicolon && pos < kinds.size() && kinds[pos] == kind;
+    }
+
+    bool is_semicolon() const {
+        return semicolon || is_punctuation_at(pos, Punctuation::SEMICOLON);
+    }
+
+    std::optional<Punctuation::Kind> punctuation() const {
+        if (semicolon || pos == kinds.size() || kinds[pos] != TokenKind::PUNCTUATION)
+            return std::nullopt;
+
+        return static_cast<Punctuation::Kind>(payloads[pos]);
+    }
+
+    void error(std::string_view expected) {
+        auto &errors = ast.error_list;
+        if (errors.empty() || errors.back().token != pos) {
+            errors.push_back(ParseError{static_cast<TokenIndex>(pos), expected});
+        }
+    }
+
+    // Consumes the token if it is the one expected
+    TokenIndex expect(Punctuation::Kind kind, std::string_view expected) {
+        auto token = static_cast<TokenIndex>(pos);
+        if (is(kind)) {
+            advance();
+        } else {
+            error(expected);
+        }
+
+        return token;
+    }
+
+    // Statements end with a semicolon, which can be left out before a
+    // closing ) or }
+    void expect_semicolon() {
+        if (is_semicolon()) {
+            advance();
+        } else if (!is(Punctuation::RPAREN) && !is(Punctuation::RBRACE)) {
+            error("';'");
+        }
+    }
+
+    NodeId add(NodeKind kind, size_t token, uint32_t lhs = 0, uint32_t rhs = 0) {
+        auto id = static_cast<NodeId>(ast.node_list.size());
+        ast.node_list.push_back(Node{kind, static_cast<TokenIndex>(token), lhs, rhs});
+        return id;
+    }
+
+    NodeId bad(std::string_view expected) {
+        error(expected);
+        return add(NodeKind::BAD, pos);
+    }
+
+    // Appends a record to the extra data, returning where it starts
+    uint32_t add_extra(std::initializer_list<uint32_t> fields) {
+        auto index = static_cast<uint32_t>(ast.extra_data.size());
+        ast.extra_data.append(std::span<const uint32_t>(fields.begin(), fields.size()));
+        return index;
+    }
+
+    struct ListRange {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // Moves the children gathered since base into the extra data
+    ListRange take_list(size_t base) {
+        auto begin = static_cast<uint32_t>(ast.extra_data.size());
+        ast.extra_data.append(std::span<const uint32_t>(scratch).subspan(base));
+        scratch.resize(base);
+        return {begin, static_cast<uint32_t>(ast.extra_data.size())};
+    }
+
+    // Moves two lists, the first gathered from base up to middle
+    std::pair<ListRange, ListRange> take_lists(size_t base, size_t middle) {
+        auto first_begin = static_cast<uint32_t>(ast.extra_data.size());
+        ast.extra_data.append(std::span<const uint32_t>(scratch).subspan(base, middle - base));
+        auto second_begin = static_cast<uint32_t>(ast.extra_data.size());
+        ast.extra_data.append(std::span<const uint32_t>(scratch).subspan(middle));
+        scratch.resize(base);
+        return {{first_begin, second_begin}, {second_begin, static_cast<uint32_t>(ast.extra_data.size())}};
+    }
+
+    NodeId identifier() {
+        if (!is(TokenKind::IDENTIFIER))
+            return bad("identifier");
+
+        auto id = add(NodeKind::IDENT, pos);
+        advance();
+        return id;
+    }
+
+    // Types
+
+    bool starts_type() const {
+        if (semicolon || pos == kinds.size())
+            return false;
+
+        switch (kinds[pos]) {
+        case TokenKind::IDENTIFIER:
+            return true;
+        case TokenKind::KEYWORD:
+            switch (payloads[pos]) {
+            case Keyword::FUNC:
+            case Keyword::MAP:
+            case Keyword::CHAN:
+            case Keyword::STRUCT:
+            case Keyword::INTERFACE:
+                return true;
+            default:
+                return false;
+            }
+        case TokenKind::PUNCTUATION:
+            switch (payloads[pos]) {
+            case Punctuation::LBRACKET:
+            case Punctuation::STAR:
+            case Punctuation::LPAREN:
+            case Punctuation::RECEIVE:
+                return true;
+            default:
+                return false;
+            }
+        default:
+            return false;
+        }
+    }
+
+    // A type argument list [A, B] after a generic type
+    NodeId type_arguments(NodeId x) {
+        auto lbracket = pos;
+        advance();
+        ++expr_level;
+
+        auto base = scratch.size();
+        while (!is(Punctuation::RBRACKET) && !at_end()) {
+            scratch.push_back(type());
+            if (!is(Punctuation::COMMA))
+                break;
+            advance();
+        }
+
+        --expr_level;
+        expect(Punctuation::RBRACKET, "']'");
+        return index_node(lbracket, x, base);
+    }
+
+    NodeId index_node(size_t lbracket, NodeId x, size_t base) {
+        if (scratch.size() == base + 1) {
+            auto index = scratch.back();
+            scratch.pop_back();
+            return add(NodeKind::INDEX, lbracket, x, index);
+        }
+
+        auto indices = take_list(base);
+        return add(NodeKind::INDEX_LIST, lbracket, add_extra({x, indices.begin, indices.end}));
+    }
+
+    NodeId type_name() {
+        auto x = identifier();
+        if (is(Punctuation::DOT)) {
+            auto dot = pos;
+            advance();
+            x = add(NodeKind::SELECTOR, dot, x, identifier());
+        }
+
+        if (is(Punctuation::LBRACKET)) {
+            x = type_arguments(x);
+        }
+
+        return x;
+    }
+
+    NodeId type() {
+        if (is(TokenKind::IDENTIFIER))
+            return type_name();
+
+        auto token = pos;
+        if (is(Punctuation::STAR)) {
+            advance();
+            return add(NodeKind::UNARY, token, type());
+        }
+
+        if (is(Punctuation::LBRACKET))
+            return array_type();
+
+        if (is(Punctuation::LPAREN)) {
+            advance();
+            ++expr_level;
+            auto inner = type();
+            --expr_level;
+            expect(Punctuation::RPAREN, "')'");
+            return add(NodeKind::PAREN, token, inner);
+        }
+
+        if (is(Punctuation::RECEIVE) || is(Keyword::CHAN))
+            return chan_type();
+
+        if (is(Keyword::MAP))
+            return map_type();
+
+        if (is(Keyword::FUNC)) {
+            advance();
+            return signature(token);
+        }
+
+        if (is(Keyword::STRUCT))
+            return struct_type();
+
+        if (is(Keyword::INTERFACE))
+            return interface_type();
+
+        return bad("type");
+    }
+
+    // [N]T, [...]T or []T
+    NodeId array_type() {
+        auto lbracket = pos;
+        advance();
+
+        if (is(Punctuation::RBRACKET)) {
+            advance();
+            return add(NodeKind::SLICE_TYPE, lbracket, type());
+        }
+
+        NodeId length;
+        ++expr_level;
+        if (is(Punctuation::ELIPSES)) {
+            length = add(NodeKind::ELLIPSIS, pos);
+            advance();
+        } else {
+            length = expression();
+        }
+        --expr_level;
+
+        expect(Punctuation::RBRACKET, "']'");
+        return add(NodeKind::ARRAY_TYPE, lbracket, length, type());
+    }
+
+    NodeId map_type() {
+        auto token = pos;
+        advance();
+        expect(Punctuation::LBRACKET, "'['");
+        ++expr_level;
+        auto key = type();
+        --expr_level;
+        expect(Punctuation::RBRACKET, "']'");
+        return add(NodeKind::MAP_TYPE, token, key, type());
+    }
+
+    NodeId chan_type() {
+        auto token = pos;
+        uint32_t dir = BOTH;
+
+        if (is(Punctuation::RECEIVE)) {
+            advance();
+            if (!is(Keyword::CHAN))
+                return bad("'chan'");
+            dir = RECEIVE;
+        }
+
+        advance();
+        if (dir == BOTH && is(Punctuation::RECEIVE)) {
+            advance();
+            dir = SEND;
+        }
+
+        return add(NodeKind::CHAN_TYPE, token, type(), dir);
+    }
+
+    // Parameters and results after func, or after a method name
+    NodeId signature(size_t token) {
+        NodeId params;
+        if (is(Punctuation::LPAREN)) {
+            params = parameters(Punctuation::RPAREN);
+        } else {
+            params = bad("'('");
+        }
+
+        NodeId results = 0;
+        if (is(Punctuation::LPAREN)) {
+            results = parameters(Punctuation::RPAREN);
+        } else if (starts_type()) {
+            results = type();
+        }
+
+        return add(NodeKind::FUNC_TYPE, token, params, results);
+    }
+
+    NodeId field(size_t token, size_t names_base, NodeId type, NodeId tag = 0) {
+        auto names = take_list(names_base);
+        return add(NodeKind::FIELD, token, add_extra({names.begin, names.end, type, tag}));
+    }
+
+    // After a name followed by [, which either starts the name's array
+    // type or is the type arguments of a generic type with that name.
+    // It is an array when a type follows the ].
+    NodeId array_or_instance(NodeId name, bool &named) {
+        auto lbracket = pos;
+        advance();
+
+        if (is(Punctuation::RBRACKET)) {
+            advance();
+            named = true;
+            return add(NodeKind::SLICE_TYPE, lbracket, type());
+        }
+
+        ++expr_level;
+        auto base = scratch.size();
+        if (is(Punctuation::ELIPSES)) {
+            scratch.push_back(add(NodeKind::ELLIPSIS, pos));
+            advance();
+        } else {
+            while (!is(Punctuation::RBRACKET) && !at_end()) {
+                scratch.push_back(type_or_expression());
+                if (!is(Punctuation::COMMA))
+                    break;
+                advance();
+            }
+        }
+        --expr_level;
+        expect(Punctuation::RBRACKET, "']'");
+
+        if (scratch.size() == base + 1 && starts_type()) {
+            auto length = scratch.back();
+            scratch.pop_back();
+            named = true;
+            return add(NodeKind::ARRAY_TYPE, lbracket, length, type());
+        }
+
+        named = false;
+        return index_node(lbracket, name, base);
+    }
+
+    // A parameter or type parameter list. Which entries are names is
+    // only known once the whole list is read: in a list where any entry
+    // is a name followed by a type, a lone identifier is a name sharing
+    // the type of the entry after it, otherwise it is a type.
+    NodeId parameters(Punctuation::Kind close) {
+        auto open = pos;
+        advance();
+        ++expr_level;
+        bool type_parameters = close == Punctuation::RBRACKET;
+
+        auto entries_base = entries.size();
+        bool named = false;
+        while (!is(close) && !at_end()) {
+            Entry entry{pos, 0, 0};
+
+            if (is(TokenKind::IDENTIFIER)) {
+                auto name = identifier();
+                if (is(Punctuation::DOT)) {
+                    auto dot = pos;
+                    advance();
+                    entry.type = add(NodeKind::SELECTOR, dot, name, identifier());
+                    if (is(Punctuation::LBRACKET)) {
+                        entry.type = type_arguments(entry.type);
+                    }
+                } else if (is(Punctuation::LBRACKET) && !type_parameters) {
+                    bool has_name;
+                    entry.type = array_or_instance(name, has_name);
+                    entry.name = has_name ? name : 0;
+                } else if (is(Punctuation::ELIPSES)) {
+                    entry.name = name;
+                    entry.type = variadic();
+                } else if (starts_type() || (type_parameters && is(Punctuation::TILDE))) {
+                    entry.name = name;
+                    entry.type = type_parameters ? constraint() : type();
+                } else {
+                    // Either a name or a type, decided below
+                    entry.name = name;
+                }
+            } else if (is(Punctuation::ELIPSES)) {
+                entry.type = variadic();
+            } else {
+                entry.type = type_parameters ? constraint() : type();
+            }
+
+            named = named || (entry.name && entry.type);
+            entries.push_back(entry);
+
+            if (!is(Punctuation::COMMA))
+                break;
+            advance();
+        }
+
+        --expr_level;
+
+        // Each field replaces the entries it was made from, the fields
+        // end up at the start of this list's entries
+        auto base = scratch.size();
+        auto fields_end = entries_base;
+        if (named) {
+            // Consecutive names share the type that ends their group
+            size_t group_token = open;
+            for (size_t i = entries_base; i < entries.size(); ++i) {
+                auto entry = entries[i];
+                if (scratch.size() == base) {
+                    group_token = entry.token;
+                }
+
+                if (entry.name) {
+                    scratch.push_back(entry.name);
+                }
+
+                if (!entry.type)
+                    continue;
+
+                if (!entry.name) {
+                    error("parameter name");
+                }
+
+                entries[fields_end++].type = field(group_token, base, entry.type);
+            }
+
+            if (scratch.size() != base) {
+                error("parameter type");
+                entries[fields_end++].type = field(group_token, base, 0);
+            }
+        } else {
+            for (size_t i = entries_base; i < entries.size(); ++i) {
+                auto entry = entries[i];
+                entries[fields_end++].type = field(entry.token, base, entry.type ? entry.type : entry.name);
+            }
+        }
+
+        for (size_t i = entries_base; i < fields_end; ++i) {
+            scratch.push_back(entries[i].type);
+        }
+        entries.resize(entries_base);
+
+        expect(close, close == Punctuation::RPAREN ? "')'" : "']'");
+        auto fields = take_list(base);
+        return add(NodeKind::FIELD_LIST, open, fields.begin, fields.end);
+    }
+
+    NodeId variadic() {
+        auto token = pos;
+        advance();
+        return add(NodeKind::ELLIPSIS, token, type());
+    }
+
+    // A union of terms, each a type or ~type, in type parameter
+    // constraints and interfaces
+    NodeId constraint() {
+        auto term = [&] {
+            if (is(Punctuation::TILDE)) {
+                auto token = pos;
+                advance();
+                return add(NodeKind::UNARY, token, type());
+            }
+
+            return type();
+        };
+
+        auto x = term();
+        while (is(Punctuation::PIPE)) {
+            auto token = pos;
+            advance();
+            x = add(NodeKind::BINARY, token, x, term());
+        }
+
+        return x;
+    }
+
+    NodeId struct_type() {
+        auto token = pos;
+        advance();
+        expect(Punctuation::LBRACE, "'{'");
+
+        auto base = scratch.size();
+        while (!is(Punctuation::RBRACE) && !at_end()) {
+            auto start = pos;
+            scratch.push_back(field_declaration());
+            expect_semicolon();
+            if (pos == start && !semicolon) {
+                advance();
+            }
+        }
+
+        expect(Punctuation::RBRACE, "'}'");
+        auto fields = take_list(base);
+        return add(NodeKind::STRUCT_TYPE, token, fields.begin, fields.end);
+    }
+
+    NodeId field_declaration() {
+        auto token = pos;
+        auto names_base = scratch.size();
+        NodeId field_type;
+
+        if (is(TokenKind::IDENTIFIER)) {
+            auto name = identifier();
+
+            if (is(Punctuation::DOT)) {
+                auto dot = pos;
+                advance();
+                field_type = add(NodeKind::SELECTOR, dot, name, identifier());
+                if (is(Punctuation::LBRACKET)) {
+                    field_type = type_arguments(field_type);
+                }
+            } else if (is(Punctuation::LBRACKET)) {
+                bool named;
+                field_type = array_or_instance(name, named);
+                if (named) {
+                    scratch.push_back(name);
+                }
+            } else if (is_semicolon() || is(TokenKind::STRING_LITERAL) || is(Punctuation::RBRACE)) {
+                // Embedded
+                field_type = name;
+            } else {
+                scratch.push_back(name);
+                while (is(Punctuation::COMMA)) {
+                    advance();
+                    scratch.push_back(identifier());
+                }
+
+                field_type = type();
+            }
+        } else if (is(Punctuation::STAR)) {
+            auto star = pos;
+            advance();
+            field_type = add(NodeKind::UNARY, star, type_name());
+        } else {
+            field_type = bad("field name or embedded type");
+        }
+
+        NodeId tag = 0;
+        if (is(TokenKind::STRING_LITERAL)) {
+            tag = add(NodeKind::BASIC_LIT, pos);
+            advance();
+        }
+
+        return field(token, names_base, field_type, tag);
+    }
+
+    NodeId interface_type() {
+        auto token = pos;
+        advance();
+        expect(Punctuation::LBRACE, "'{'");
+
+        auto base = scratch.size();
+        while (!is(Punctuation::RBRACE) && !at_end()) {
+            auto start = pos;
+            auto element_token = pos;
+            auto names_base = scratch.size();
+
+            if (is(TokenKind::IDENTIFIER) && is_punctuation_at(peek_index(1), Punctuation::LPAREN)) {
+                scratch.push_back(identifier());
+                auto method = signature(pos);
+                scratch.push_back(field(element_token, names_base, method));
+            } else {
+                scratch.push_back(field(element_token, names_base, constraint()));
+            }
+
+            expect_semicolon();
+            if (pos == start && !semicolon) {
+                advance();
+            }
+        }
+
+        expect(Punctuation::RBRACE, "'}'");
+        auto elements = take_list(base);
+        return add(NodeKind::INTERFACE_TYPE, token, elements.begin, elements.end);
+    }
+
+    // Expressions
+
+    static int precedence(Punctuation::Kind kind) {
+        switch (kind) {
+        case Punctuation::BOOL_OR:
+            return 1;
+        case Punctuation::BOOL_AND:
+            return 2;
+        case Punctuation::EQUAL:
+        case Punctuation::NOT_EQUAL:
+        case Punctuation::LESS_THAN:
+        case Punctuation::LESS_THAN_EQUAL:
+        case Punctuation::GREATER_THAN:
+        case Punctuation::GREATER_THAN_EQUAL:
+            return 3;
+        case Punctuation::PLUS:
+        case Punctuation::MINUS:
+        case Punctuation::PIPE:
+        case Punctuation::CARAT:
+            return 4;
+        case Punctuation::STAR:
+        case Punctuation::SLASH:
+        case Punctuation::PERCENT:
+        case Punctuation::LSHIFT:
+        case Punctuation::RSHIFT:
+        case Punctuation::AMP:
+        case Punctuation::BITCLEAR:
+            return 5;
+        default:
+            return 0;
+        }
+    }
+
+    NodeId expression() {
+        return binary_expression(1);
+    }
+
+    // Types are parsed as expressions wherever either can appear,
+    // a type is just an operand the checker will reject as a value
+    NodeId type_or_expression() {
+        return expression();
+    }
+
+    // Binds operators of at least min_precedence, left to right
+    NodeId binary_expression(int min_precedence) {
+        auto x = unary_expression();
+
+        while (auto kind = punctuation()) {
+            auto level = precedence(*kind);
+            if (level < min_precedence)
+                break;
+
+            auto token = pos;
+            advance();
+            x = add(NodeKind::BINARY, token, x, binary_expression(level + 1));
+        }
+
+        return x;
+    }
+
+    NodeId unary_expression() {
+        if (auto kind = punctuation()) {
+            switch (*kind) {
+            case Punctuation::PLUS:
+            case Punctuation::MINUS:
+            case Punctuation::BANG:
+            case Punctuation::CARAT:
+            case Punctuation::STAR:
+            case Punctuation::AMP:
+            case Punctuation::TILDE: {
+                auto token = pos;
+                advance();
+                return add(NodeKind::UNARY, token, unary_expression());
+            }
+            case Punctuation::RECEIVE: {
+                // <-chan T is a type, anything else receives
+                if (is_keyword_at(peek_index(1), Keyword::CHAN))
+                    return primary_expression(chan_type());
+
+                auto token = pos;
+                advance();
+                return add(NodeKind::UNARY, token, unary_expression());
+            }
+            default:
+                break;
+            }
+        }
+
+        return primary_expression(operand());
+    }
+
+    NodeId operand() {
+        if (semicolon || pos == kinds.size())
+            return bad("expression");
+
+        auto token = pos;
+        switch (kinds[pos]) {
+        case TokenKind::IDENTIFIER:
+            return identifier();
+        case TokenKind::INT_LITERAL:
+        case TokenKind::FLOAT_LITERAL:
+        case TokenKind::IMAGINARY_LITERAL:
+        case TokenKind::RUNE_LITERAL:
+        case TokenKind::STRING_LITERAL:
+            advance();
+            return add(NodeKind::BASIC_LIT, token);
+        case TokenKind::KEYWORD:
+            if (is(Keyword::FUNC)) {
+                advance();
+                auto func_type = signature(token);
+                if (is(Punctuation::LBRACE))
+                    return add(NodeKind::FUNC_LIT, token, func_type, block());
+
+                return func_type;
+            }
+
+            if (starts_type())
+                return type();
+
+            return bad("expression");
+        case TokenKind::PUNCTUATION:
+            if (is(Punctuation::LPAREN)) {
+                advance();
+                ++expr_level;
+                auto inner = type_or_expression();
+                --expr_level;
+                expect(Punctuation::RPAREN, "')'");
+                return add(NodeKind::PAREN, token, inner);
+            }
+
+            if (is(Punctuation::LBRACKET))
+                return array_type();
+
+            return bad("expression");
+        default:
+            return bad("expression");
+        }
+    }
+
+    // Whether x { starts a composite literal of type x
+    bool is_literal_type(NodeId x) const {
+        switch (ast.node(x).kind) {
+        case NodeKind::IDENT:
+        case NodeKind::SELECTOR:
+        case NodeKind::INDEX:
+        case NodeKind::INDEX_LIST:
+            return expr_level >= 0;
+        case NodeKind::ARRAY_TYPE:
+        case NodeKind::SLICE_TYPE:
+        case NodeKind::MAP_TYPE:
+        case NodeKind::STRUCT_TYPE:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Selectors, indexes, slices, calls, assertions and composite
+    // literals applied to x
+    NodeId primary_expression(NodeId x) {
+        while (auto kind = punctuation()) {
+            auto token = pos;
+
+            if (*kind == Punctuation::DOT) {
+                advance();
+                if (is(TokenKind::IDENTIFIER)) {
+                    x = add(NodeKind::SELECTOR, token, x, identifier());
+                } else if (is(Punctuation::LPAREN)) {
+                    advance();
+                    NodeId asserted = 0;
+                    if (is(Keyword::TYPE)) {
+                        advance();
+                    } else {
+                        asserted = type();
+                    }
+                    expect(Punctuation::RPAREN, "')'");
+                    x = add(NodeKind::TYPE_ASSERT, token, x, asserted);
+                } else {
+                    return bad("selector or type assertion");
+                }
+            } else if (*kind == Punctuation::LBRACKET) {
+                x = index_or_slice(x);
+            } else if (*kind == Punctuation::LPAREN) {
+                x = call(x);
+            } else if (*kind == Punctuation::LBRACE && is_literal_type(x)) {
+                x = literal_value(x);
+            } else {
+                break;
+            }
+        }
+
+        return x;
+    }
+
+    NodeId index_or_slice(NodeId x) {
+        auto lbracket = pos;
+        advance();
+        ++expr_level;
+
+        // Up to three indexes separated by colons
+        NodeId indexes[3] = {0, 0, 0};
+        size_t colons = 0;
+
+        if (!is(Punctuation::COLON)) {
+            indexes[0] = type_or_expression();
+        }
+
+        if (is(Punctuation::COMMA)) {
+            // Type arguments
+            auto base = scratch.size();
+            scratch.push_back(indexes[0]);
+            while (is(Punctuation::COMMA)) {
+                advance();
+                if (is(Punctuation::RBRACKET))
+                    break;
+                scratch.push_back(type_or_expression());
+            }
+
+            --expr_level;
+            expect(Punctuation::RBRACKET, "']'");
+            return index_node(lbracket, x, base);
+        }
+
+        while (is(Punctuation::COLON) && colons < 2) {
+            advance();
+            ++colons;
+            if (!is(Punctuation::COLON) && !is(Punctuation::RBRACKET)) {
+                indexes[colons] = expression();
+            }
+        }
+
+        --expr_level;
+        expect(Punctuation::RBRACKET, "']'");
+
+        if (colons == 0)
+            return add(NodeKind::INDEX, lbracket, x, indexes[0]);
+
+        return add(NodeKind::SLICE, lbracket, add_extra({x, indexes[0], indexes[1], indexes[2]}));
+    }
+
+    NodeId call(NodeId fun) {
+        auto lparen = pos;
+        advance();
+        ++expr_level;
+
+        auto base = scratch.size();
+        uint32_t ellipsis = 0;
+        while (!is(Punctuation::RPAREN) && !at_end()) {
+            scratch.push_back(type_or_expression());
+            if (is(Punctuation::ELIPSES)) {
+                advance();
+                ellipsis = 1;
+            }
+
+            if (!is(Punctuation::COMMA))
+                break;
+            advance();
+        }
+
+        --expr_level;
+        expect(Punctuation::RPAREN, "')'");
+        auto args = take_list(base);
+        return add(NodeKind::CALL, lparen, add_extra({fun, args.begin, args.end}), ellipsis);
+    }
+
+    // { elements } of a composite literal, whose type is 0 when elided
+    NodeId literal_value(NodeId type) {
+        auto lbrace = pos;
+        advance();
+        auto outer = expr_level;
+        expr_level = 0;
+
+        auto element = [&] {
+            if (is(Punctuation::LBRACE))
+                return literal_value(0);
+
+            return expression();
+        };
+
+        auto base = scratch.size();
+        while (!is(Punctuation::RBRACE) && !at_end()) {
+            auto x = element();
+            if (is(Punctuation::COLON)) {
+                auto colon = pos;
+                advance();
+                x = add(NodeKind::KEY_VALUE, colon, x, element());
+            }
+
+            scratch.push_back(x);
+            if (!is(Punctuation::COMMA))
+                break;
+            advance();
+        }
+
+        expr_level = outer;
+        expect(Punctuation::RBRACE, "'}'");
+        auto elements = take_list(base);
+        return add(NodeKind::COMPOSITE_LIT, lbrace, add_extra({type, elements.begin, elements.end}));
+    }
+
+    // Gathers a comma separated list of expressions on the scratch stack
+    void expression_list() {
+        scratch.push_back(expression());
+        while (is(Punctuation::COMMA)) {
+            advance();
+            scratch.push_back(expression());
+        }
+    }
+
+    // Statements
+
+    static bool is_assignment(Punctuation::Kind kind) {
+        switch (kind) {
+        case Punctuation::ASSIGNMENT:
+        case Punctuation::SHORT_DECLARATION:
+        case Punctuation::PLUS_EQUAL:
+        case Punctuation::MINUS_EQUAL:
+        case Punctuation::STAR_EQUAL:
+        case Punctuation::SLASH_EQUAL:
+        case Punctuation::MOD_EQUAL:
+        case Punctuation::AND_EQUAL:
+        case Punctuation::OR_EQUAL:
+        case Punctuation::XOR_EQUAL:
+        case Punctuation::LSHIFT_EQUAL:
+        case Punctuation::RSHIFT_EQUAL:
+        case Punctuation::BITCLEAR_EQUAL:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    NodeId range_clause() {
+        auto token = pos;
+        advance();
+        return add(NodeKind::UNARY, token, expression());
+    }
+
+    // range x, or an assignment from it
+    bool is_range_clause(NodeId id) const {
+        const auto &n = ast.node(id);
+        if (n.kind == NodeKind::UNARY)
+            return is_keyword_at(n.token, Keyword::RANGE);
+
+        if (n.kind != NodeKind::ASSIGN)
+            return false;
+
+        auto rhs = ast.list(ast.extra(n.lhs + 2), ast.extra(n.lhs + 3));
+        return rhs.size() == 1 && ast.node(rhs[0]).kind == NodeKind::UNARY
+            && is_keyword_at(ast.node(rhs[0]).token, Keyword::RANGE);
+    }
+
+    // Expression, send, increment, assignment or short variable
+    // declaration, and labels where a statement can be labeled. The
+    // assignment can be a range clause in a for header.
+    NodeId simple_statement(bool label_ok = false, bool range_ok = false) {
+        if (range_ok && is(Keyword::RANGE))
+            return range_clause();
+
+        auto base = scratch.size();
+        expression_list();
+
+        auto kind = punctuation();
+        auto token = pos;
+
+        if (kind && is_assignment(*kind)) {
+            advance();
+            auto middle = scratch.size();
+            if (range_ok && is(Keyword::RANGE)) {
+                scratch.push_back(range_clause());
+            } else {
+                expression_list();
+            }
+
+            auto [lhs, rhs] = take_lists(base, middle);
+            return add(NodeKind::ASSIGN, token, add_extra({lhs.begin, lhs.end, rhs.begin, rhs.end}));
+        }
+
+        auto x = scratch[base];
+        bool single = scratch.size() == base + 1;
+        scratch.resize(base);
+
+        if (!single)
+            return bad("':=' or '='");
+
+        if (kind == Punctuation::COLON && label_ok && ast.node(x).kind == NodeKind::IDENT) {
+            advance();
+            // A label can come right before a closing brace
+            NodeId statement = 0;
+            if (!is(Punctuation::RBRACE) && !at_end()) {
+                statement = this->statement();
+            }
+
+            return add(NodeKind::LABELED, ast.node(x).token, x, statement);
+        }
+
+        if (kind == Punctuation::RECEIVE) {
+            advance();
+            return add(NodeKind::SEND, token, x, expression());
+        }
+
+        if (kind == Punctuation::INCREMENT || kind == Punctuation::DECREMENT) {
+            advance();
+            return add(NodeKind::INC_DEC, token, x);
+        }
+
+        return x;
+    }
+
+    // Gathers the statements up to the closing } or next case of a
+    // block on the scratch stack
+    void statements() {
+        while (!is(Punctuation::RBRACE) && !is(Keyword::CASE) && !is(Keyword::DEFAULT) && !at_end()) {
+            auto start = pos;
+            if (auto s = statement()) {
+                scratch.push_back(s);
+            }
+
+            if (!is(Punctuation::RBRACE) && !is(Keyword::CASE) && !is(Keyword::DEFAULT)) {
+                expect_semicolon();
+            }
+
+            // Skip whatever no statement starts with
+            if (pos == start && !semicolon) {
+                advance();
+            }
+        }
+    }
+
+    ListRange statement_list() {
+        auto base = scratch.size();
+        statements();
+        return take_list(base);
+    }
+
+    // Jumps from the { of a function body to its }, leaving the body for
+    // parse_lazy_body(). An unclosed body is parsed now, to report it.
+    NodeId lazy_block() {
+        auto rbrace = lazy_bodies->match(static_cast<TokenIndex>(pos));
+        if (rbrace == BracketIndex::NONE)
+            return block();
+
+        auto lbrace = pos;
+        pos = rbrace;
+        semicolon = false;
+        advance();
+        return add(NodeKind::LAZY_BLOCK, lbrace, 0, rbrace);
+    }
+
+    NodeId block() {
+        if (!is(Punctuation::LBRACE))
+            return bad("'{'");
+
+        auto lbrace = pos;
+        advance();
+        auto outer = expr_level;
+        expr_level = 0;
+        auto statements = statement_list();
+        expr_level = outer;
+        expect(Punctuation::RBRACE, "'}'");
+        return add(NodeKind::BLOCK, lbrace, statements.begin, statements.end);
+    }
+
+    // Nothing for an empty statement
+    NodeId statement() {
+        if (is_semicolon())
+            return 0;
+
+        if (is(Punctuation::LBRACE))
+            return block();
+
+        auto token = pos;
+        if (is(TokenKind::KEYWORD)) {
+            switch (payloads[pos]) {
+            case Keyword::VAR:
+            case Keyword::CONST:
+            case Keyword::TYPE:
+                return declaration();
+            case Keyword::GO:
+                advance();
+                return add(NodeKind::GO, token, expression());
+            case Keyword::DEFER:
+                advance();
+                return add(NodeKind::DEFER, token, expression());
+            case Keyword::RETURN: {
+                advance();
+                auto base = scratch.size();
+                if (!is_semicolon() && !is(Punctuation::RBRACE)) {
+                    expression_list();
+                }
+
+                auto results = take_list(base);
+                return add(NodeKind::RETURN, token, results.begin, results.end);
+            }
+            case Keyword::BREAK:
+            case Keyword::CONTINUE:
+            case Keyword::GOTO: {
+                advance();
+                NodeId label = 0;
+                if (is(TokenKind::IDENTIFIER)) {
+                    label = identifier();
+                }
+
+                return add(NodeKind::BRANCH, token, label);
+            }
+            case Keyword::FALLTHROUGH:
+                advance();
+                return add(NodeKind::BRANCH, token);
+            case Keyword::IF:
+                return if_statement();
+            case Keyword::FOR:
+                return for_statement();
+            case Keyword::SWITCH:
+                return switch_statement();
+            case Keyword::SELECT:
+                return select_statement();
+            default:
+                break;
+            }
+        }
+
+        return simple_statement(true);
+    }
+
+    NodeId if_statement() {
+        auto token = pos;
+        advance();
+
+        auto outer = expr_level;
+        expr_level = -1;
+
+        NodeId init = 0;
+        NodeId cond = 0;
+        if (is(Punctuation::LBRACE)) {
+            error("condition");
+        } else {
+            if (!is_semicolon()) {
+                cond = simple_statement();
+            }
+
+            if (is_semicolon()) {
+                advance();
+                init = cond;
+                cond = is(Punctuation::LBRACE) ? bad("condition") : expression();
+            }
+        }
+
+        expr_level = outer;
+        auto then = block();
+
+        NodeId otherwise = 0;
+        if (is(Keyword::ELSE)) {
+            advance();
+            if (is(Keyword::IF)) {
+                otherwise = if_statement();
+            } else if (is(Punctuation::LBRACE)) {
+                otherwise = block();
+            } else {
+                otherwise = bad("'if' or '{'");
+            }
+        }
+
+        return add(NodeKind::IF, token, add_extra({init, cond, then, otherwise}));
+    }
+
+    NodeId for_statement() {
+        auto token = pos;
+        advance();
+
+        auto outer = expr_level;
+        expr_level = -1;
+
+        NodeId init = 0;
+        NodeId cond = 0;
+        NodeId post = 0;
+        bool is_range = false;
+
+        if (!is(Punctuation::LBRACE)) {
+            if (!is_semicolon()) {
+                cond = simple_statement(false, true);
+                is_range = is_range_clause(cond);
+            }
+
+            if (!is_range && is_semicolon()) {
+                advance();
+                init = cond;
+                cond = 0;
+                if (!is_semicolon()) {
+                    cond = expression();
+                }
+
+                if (is_semicolon()) {
+                    advance();
+                } else {
+                    error("';'");
+                }
+
+                if (!is(Punctuation::LBRACE)) {
+                    post = simple_statement();
+                }
+            }
+        }
+
+        expr_level = outer;
+        auto body = block();
+
+        if (is_range)
+            return add(NodeKind::RANGE, token, cond, body);
+
+        return add(NodeKind::FOR, token, add_extra({init, cond, post}), body);
+    }
+
+    // x.(type), or v := x.(type)
+    bool is_type_switch_guard(NodeId id) const {
+        const auto &n = ast.node(id);
+        if (n.kind == NodeKind::TYPE_ASSERT)
+            return n.rhs == 0;
+
+        if (n.kind != NodeKind::ASSIGN || !is_punctuation_at(n.token, Punctuation::SHORT_DECLARATION))
+            return false;
+
+        auto rhs = ast.list(ast.extra(n.lhs + 2), ast.extra(n.lhs + 3));
+        return rhs.size() == 1 && ast.node(rhs[0]).kind == NodeKind::TYPE_ASSERT && ast.node(rhs[0]).rhs == 0;
+    }
+
+    NodeId switch_statement() {
+        auto token = pos;
+        advance();
+
+        auto outer = expr_level;
+        expr_level = -1;
+
+        NodeId init = 0;
+        NodeId tag = 0;
+        if (!is(Punctuation::LBRACE)) {
+            if (!is_semicolon()) {
+                tag = simple_statement();
+            }
+
+            if (is_semicolon()) {
+                advance();
+                init = tag;
+                tag = 0;
+                if (!is(Punctuation::LBRACE)) {
+                    tag = simple_statement();
+                }
+            }
+        }
+
+        expr_level = outer;
+        expect(Punctuation::LBRACE, "'{'");
+
+        auto base = scratch.size();
+        while (is(Keyword::CASE) || is(Keyword::DEFAULT)) {
+            scratch.push_back(case_clause());
+        }
+
+        expect(Punctuation::RBRACE, "'}'");
+        auto clauses = take_list(base);
+        auto kind = tag && is_type_switch_guard(tag) ? NodeKind::TYPE_SWITCH : NodeKind::SWITCH;
+        return add(kind, token, add_extra({init, tag, clauses.begin, clauses.end}));
+    }
+
+    NodeId case_clause() {
+        auto token = pos;
+        bool is_default = is(Keyword::DEFAULT);
+        advance();
+
+        auto base = scratch.size();
+        if (!is_default) {
+            expression_list();
+        }
+
+        auto middle = scratch.size();
+        expect(Punctuation::COLON, "':'");
+        statements();
+
+        auto [list, body] = take_lists(base, middle);
+        return add(NodeKind::CASE_CLAUSE, token, add_extra({list.begin, list.end, body.begin, body.end}));
+    }
+
+    NodeId select_statement() {
+        auto token = pos;
+        advance();
+        expect(Punctuation::LBRACE, "'{'");
+
+        auto base = scratch.size();
+        while (is(Keyword::CASE) || is(Keyword::DEFAULT)) {
+            auto clause = pos;
+            bool is_default = is(Keyword::DEFAULT);
+            advance();
+
+            NodeId comm = 0;
+            if (!is_default) {
+                comm = simple_statement();
+            }
+
+            expect(Punctuation::COLON, "':'");
+            auto body = statement_list();
+            scratch.push_back(add(NodeKind::COMM_CLAUSE, clause, add_extra({comm, body.begin, body.end})));
+        }
+
+        expect(Punctuation::RBRACE, "'}'");
+        auto clauses = take_list(base);
+        return add(NodeKind::SELECT, token, clauses.begin, clauses.end);
+    }
+
+    // Declarations
+
+    NodeId import_spec() {
+        NodeId name = 0;
+        if (is(TokenKind::IDENTIFIER) || is(Punctuation::DOT)) {
+            name = add(NodeKind::IDENT, pos);
+            advance();
+        }
+
+        if (!is(TokenKind::STRING_LITERAL))
+            return bad("import path");
+
+        auto path = pos;
+        advance();
+        return add(NodeKind::IMPORT_SPEC, path, name);
+    }
+
+    NodeId value_spec() {
+        auto token = pos;
+        auto base = scratch.size();
+        scratch.push_back(identifier());
+        while (is(Punctuation::COMMA)) {
+            advance();
+            scratch.push_back(identifier());
+        }
+
+        NodeId value_type = 0;
+        if (!is(Punctuation::ASSIGNMENT) && !is_semicolon() && !is(Punctuation::RPAREN)) {
+            value_type = type();
+        }
+
+        auto middle = scratch.size();
+        if (is(Punctuation::ASSIGNMENT)) {
+            advance();
+            expression_list();
+        }
+
+        auto values = take_list(middle);
+        auto names = take_list(base);
+        return add(NodeKind::VALUE_SPEC, token, add_extra({names.begin, names.end, value_type, values.begin, values.end}));
+    }
+
+    // Whether a comma comes before the ] closing the [ at pos
+    bool bracket_has_comma() const {
+        size_t depth = 0;
+        for (auto index = peek_index(1); index < kinds.size(); index = skip_comments(index + 1)) {
+            if (kinds[index] != TokenKind::PUNCTUATION)
+                continue;
+
+            switch (payloads[index]) {
+            case Punctuation::LPAREN:
+            case Punctuation::LBRACKET:
+            case Punctuation::LBRACE:
+                ++depth;
+                break;
+            case Punctuation::RPAREN:
+            case Punctuation::RBRACKET:
+            case Punctuation::RBRACE:
+                if (depth == 0)
+                    return false;
+                --depth;
+                break;
+            case Punctuation::COMMA:
+                if (depth == 0)
+                    return true;
+                break;
+            default:
+                break;
+            }
+        }
+
+        return false;
+    }
+
+    // Whether the [ after a type's name starts type parameters rather
+    // than an array length. As in Go, [P *C] and [P (C)] are arrays, but
+    // [P *C,], [P (C),] and [P *struct{}] are type parameters.
+    bool starts_type_parameters() const {
+        auto first = peek_index(1);
+        if (first == kinds.size() || kinds[first] != TokenKind::IDENTIFIER)
+            return false;
+
+        auto second = peek_index(2);
+        if (second == kinds.size())
+            return false;
+
+        switch (kinds[second]) {
+        case TokenKind::IDENTIFIER:
+            return true;
+        case TokenKind::KEYWORD:
+            switch (payloads[second]) {
+            case Keyword::INTERFACE:
+            case Keyword::FUNC:
+            case Keyword::MAP:
+            case Keyword::CHAN:
+            case Keyword::STRUCT:
+                return true;
+            default:
+                return false;
+            }
+        case TokenKind::PUNCTUATION:
+            switch (payloads[second]) {
+            case Punctuation::COMMA:
+            case Punctuation::TILDE:
+            case Punctuation::LBRACKET:
+                return true;
+            case Punctuation::STAR: {
+                // A pointer to a type literal can't be a multiplication
+                auto third = peek_index(3);
+                return is_keyword_at(third, Keyword::STRUCT) || is_keyword_at(third, Keyword::INTERFACE)
+                    || is_keyword_at(third, Keyword::FUNC) || is_keyword_at(third, Keyword::MAP)
+                    || is_keyword_at(third, Keyword::CHAN) || is_punctuation_at(third, Punctuation::LBRACKET)
+                    || bracket_has_comma();
+            }
+            case Punctuation::LPAREN:
+                return bracket_has_comma();
+            default:
+                return false;
+            }
+        default:
+            return false;
+        }
+    }
+
+    NodeId type_spec() {
+        auto token = pos;
+        auto name = identifier();
+
+        NodeId params = 0;
+        if (is(Punctuation::LBRACKET) && starts_type_parameters()) {
+            params = parameters(Punctuation::RBRACKET);
+        }
+
+        auto kind = NodeKind::TYPE_SPEC;
+        if (is(Punctuation::ASSIGNMENT)) {
+            advance();
+            kind = NodeKind::ALIAS_SPEC;
+        }
+
+        return add(kind, token, add_extra({name, params, type()}));
+    }
+
+    // import, const, var or type, with one spec or a group of them
+    NodeId declaration() {
+        auto token = pos;
+        auto keyword = payloads[pos];
+        advance();
+
+        auto spec = [&] {
+            switch (keyword) {
+            case Keyword::IMPORT:
+                return import_spec();
+            case Keyword::TYPE:
+                return type_spec();
+            default:
+                return value_spec();
+            }
+        };
+
+        auto base = scratch.size();
+        if (is(Punctuation::LPAREN)) {
+            advance();
+            while (!is(Punctuation::RPAREN) && !at_end()) {
+                auto start = pos;
+                if (!is_semicolon()) {
+                    scratch.push_back(spec());
+                }
+
+                expect_semicolon();
+                if (pos == start && !semicolon) {
+                    advance();
+                }
+            }
+
+            expect(Punctuation::RPAREN, "')'");
+        } else {
+            scratch.push_back(spec());
+        }
+
+        auto specs = take_list(base);
+        return add(NodeKind::GEN_DECL, token, specs.begin, specs.end);
+    }
+
+    NodeId function_declaration() {
+        auto token = pos;
+        advance();
+
+        NodeId receiver = 0;
+        if (is(Punctuation::LPAREN)) {
+            receiver = parameters(Punctuation::RPAREN);
+        }
+
+        auto name = identifier();
+
+        NodeId params = 0;
+        if (is(Punctuation::LBRACKET)) {
+            params = parameters(Punctuation::RBRACKET);
+        }
+
+        auto func_type = signature(token);
+
+        NodeId body = 0;
+        if (is(Punctuation::LBRACE)) {
+            body = lazy_bodies ? lazy_block() : block();
+        }
+
+        return add(NodeKind::FUNC_DECL, token, add_extra({receiver, name, params, func_type}), body);
+    }
+
+    bool starts_declaration() const {
+        return is(Keyword::FUNC) || is(Keyword::TYPE) || is(Keyword::VAR)
+            || is(Keyword::CONST) || is(Keyword::IMPORT);
+    }
+
+    // Skips to the next statement that starts a top level declaration
+    void synchronize() {
+        while (!at_end()) {
+            bool after_semicolon = is_semicolon();
+            advance();
+            if (after_semicolon && starts_declaration())
+                return;
+        }
+    }
+
+    public:
+    Parser(const tokens::TokenStream &stream, Ast &ast, const BracketIndex *lazy_bodies = nullptr, size_t start = 0):
+        stream{stream},
+        kinds{stream.kinds()},
+        payloads{stream.payloads()},
+        ast{ast},
+        lazy_bodies{lazy_bodies},
+        pos{skip_comments(start)} {}
+
+    // The block starting at the current token, on its own
+    NodeId body() {
+        return block();
+    }
+
+    void file() {
+        // Go source comes out at about 0.8 nodes and 0.95 words of extra
+        // data per token
+        ast.node_list.reserve(stream.size() + 16);
+        ast.extra_data.reserve(stream.size() + 16);
+
+        auto first = pos;
+        auto base = scratch.size();
+
+        if (is(Keyword::PACKAGE)) {
+            auto token = pos;
+            advance();
+            scratch.push_back(add(NodeKind::PACKAGE, token, identifier()));
+            expect_semicolon();
+        } else {
+            scratch.push_back(bad("'package'"));
+        }
+
+        while (!at_end()) {
+            auto start = pos;
+            auto errors = ast.error_list.size();
+
+            if (is_semicolon()) {
+                advance();
+                continue;
+            }
+
+            if (is(Keyword::FUNC)) {
+                scratch.push_back(function_declaration());
+            } else if (is(Keyword::IMPORT) || is(Keyword::CONST) || is(Keyword::VAR) || is(Keyword::TYPE)) {
+                scratch.push_back(declaration());
+            } else {
+                scratch.push_back(bad("declaration"));
+            }
+
+            if (!at_end()) {
+                expect_semicolon();
+            }
+
+            bool stuck = pos == start && !semicolon;
+            if ((stuck || ast.error_list.size() != errors) && !starts_declaration()) {
+                synchronize();
+            }
+        }
+
+        auto decls = take_list(base);
+        ast.node_list[0] = Node{NodeKind::FILE, static_cast<TokenIndex>(first), decls.begin, decls.end};
+    }
+};
+
+Ast parse(const tokens::TokenStream &stream, const BracketIndex *lazy_bodies)
+{
+    Ast ast(stream);
+    Parser(stream, ast, lazy_bodies).file();
+    return ast;
+}
+
+NodeId parse_block(Ast &ast, TokenIndex lbrace)
+{
+    return Parser(ast.tokens(), ast, nullptr, lbrace).body();
+}
+
+void parse_lazy_body(Ast &ast, NodeId lazy)
+{
+    // The block is the last node added, moving it into the LazyBlock's
+    // place leaves no trace of it
+    auto block = parse_block(ast, ast.node(lazy).token);
+    ast.node_list[lazy] = ast.node_list[block];
+    ast.node_list.resize(block);
+}
+
+// Parses the LazyBlocks of a tree in batches on a pool and moves the
+// results into the tree. Each batch is parsed into an Ast of its own over
+// the same tokens, so workers share nothing, and only needs its nodes and
+// extra data moved: the layout of each node tells which of its operands
+// and extra words are node ids and which are extra data indices.
+class BodyParser {
+    struct Batch {
+        // The LazyBlocks of the batch, in source order
+        std::vector<NodeId> lazy;
+        std::optional<Ast> part;
+        // Where the nodes of each body start in part, its Block last
+        std::vector<NodeId> firsts;
+    };
+
+    Ast &tree;
+    support::ThreadPool &pool;
+    std::vector<Batch> batches;
+
+    void parse_batch(Batch &batch, size_t tokens) {
+        batch.part.emplace(tree.tokens());
+        auto &part = *batch.part;
+        part.node_list.reserve(tokens + 16);
+        part.extra_data.reserve(tokens + 16);
+
+        for (auto lazy : batch.lazy) {
+            batch.firsts.push_back(static_cast<NodeId>(part.size()));
+            parse_block(part, tree.node(lazy).token);
+        }
+
+        batch.firsts.push_back(static_cast<NodeId>(part.size()));
+    }
+
+    // Moves one body, whose nodes have been given ids from node_offset
+    // on and whose extra data is already copied to extra_offset, with its
+    // Block taking the place of the LazyBlock
+    void move_body(const Ast &part, NodeId first, NodeId end, NodeId lazy, uint32_t extra_offset) {
+        auto node_offset = static_cast<uint32_t>(tree.size()) - first;
+        auto move_node = [&](uint32_t id) {
+            return id ? id + node_offset : 0;
+        };
+
+        auto move_list = [&](uint32_t begin, uint32_t end) {
+            for (auto i = begin; i < end; ++i) {
+                tree.extra_data[i + extra_offset] = move_node(part.extra(i));
+            }
+        };
+
+        for (auto id = first; id < end; ++id) {
+            auto n = part.node(id);
+            const auto &shape = layout(n.kind);
+
+            if (shape.lhs == Operand::EXTRA) {
+                auto field = n.lhs;
+                for (auto letter : shape.extra) {
+                    if (letter == 'n') {
+                        tree.extra_data[field + extra_offset] = move_node(part.extra(field));
+                        field += 1;
+                    } else {
+                        move_list(part.extra(field), part.extra(field + 1));
+                        tree.extra_data[field + extra_offset] = part.extra(field) + extra_offset;
+                        tree.extra_data[field + 1 + extra_offset] = part.extra(field + 1) + extra_offset;
+                        field += 2;
+                    }
+                }
+                n.lhs += extra_offset;
+            } else if (shape.lhs == Operand::LIST) {
+                move_list(n.lhs, n.rhs);
+                n.lhs += extra_offset;
+                n.rhs += extra_offset;
+            } else if (shape.lhs == Operand::NODE) {
+                n.lhs = move_node(n.lhs);
+            }
+
+            if (shape.rhs == Operand::NODE) {
+                n.rhs = move_node(n.rhs);
+            }
+
+            if (id + 1 == end) {
+                tree.node_list[lazy] = n;
+            } else {
+                tree.node_list.push_back(n);
+            }
+        }
+    }
+
+    void merge(Batch &batch) {
+        auto &part = *batch.part;
+        auto extra_offset = static_cast<uint32_t>(tree.extra_data.size());
+        tree.extra_data.append(part.extras());
+
+        for (size_t i = 0; i < batch.lazy.size(); ++i) {
+            move_body(part, batch.firsts[i], batch.firsts[i + 1], batch.lazy[i], extra_offset);
+        }
+
+        tree.error_list.insert(tree.error_list.end(), part.error_list.begin(), part.error_list.end());
+        batch.part.reset();
+    }
+
+    public:
+    BodyParser(Ast &tree, support::ThreadPool &pool): tree{tree}, pool{pool} {}
+
+    void run(size_t batch_tokens) {
+        // Only function declarations are lazy, and they are in source order
+        std::vector<size_t> tokens;
+        for (NodeId id = 0; id < tree.size(); ++id) {
+            const auto &n = tree.node(id);
+            if (n.kind != NodeKind::LAZY_BLOCK)
+                continue;
+
+            if (tokens.empty() || tokens.back() >= batch_tokens) {
+                batches.emplace_back();
+                tokens.push_back(0);
+            }
+
+            batches.back().lazy.push_back(id);
+            tokens.back() += n.rhs + 1 - n.token;
+        }
+
+        if (batches.size() == 1) {
+            parse_batch(batches[0], tokens[0]);
+        } else {
+            support::TaskGroup group(pool);
+            for (size_t i = 0; i < batches.size(); ++i) {
+                group.run([this, &tokens, i] {
+                    parse_batch(batches[i], tokens[i]);
+                });
+            }
+        }
+
+        for (auto &batch : batches) {
+            merge(batch);
+        }
+
+        std::stable_sort(tree.error_list.begin(), tree.error_list.end(), [](const auto &a, const auto &b) {
+            return a.token < b.token;
+        });
+    }
+};
+
+Ast parse_parallel(const tokens::TokenStream &stream, support::ThreadPool &pool, size_t batch_tokens)
+{
+    // Too few tokens to fill two batches, splitting would only cost
+    if (stream.size() < 2 * batch_tokens)
+        return parse(stream);
+
+    BracketIndex brackets(stream);
+    auto ast = parse(stream, &brackets);
+    BodyParser(ast, pool).run(batch_tokens);
+    return ast;
+}
+
+std::vector<Ast> parse_parallel(
+        std::span<const tokens::TokenStream *const> streams,
+        support::ThreadPool &pool,
+        size_t batch_tokens
+)
+{
+    std::vector<std::optional<Ast>> parsed(streams.size());
+    {
+        support::TaskGroup group(pool);
+        for (size_t i = 0; i < streams.size(); ++i) {
+            group.run([&, i] {
+                parsed[i].emplace(parse_parallel(*streams[i], pool, batch_tokens));
+            });
+        }
+    }
+
+    std::vector<Ast> trees;
+    trees.reserve(streams.size());
+    for (auto &tree : parsed) {
+        trees.push_back(std::move(*tree));
+    }
+
+    return trees;
+}
+
+static void dump_node(std::ostream &os, const Ast &ast, NodeId id, std::string_view field, size_t depth)
+{
+    const auto &n = ast.node(id);
+    const auto &shape = layout(n.kind);
+
+    os << std::string(depth * 2, ' ');
+    if (!field.empty()) {
+        os << field << ": ";
+    }
+
+    os << shape.name << "(token: ";
+    if (n.token < ast.tokens().size()) {
+        // Raw strings can span lines, each node stays on one
+        for (auto c : ast.text(n.token)) {
+            if (c == '\n') {
+                os << "\\n";
+            } else if (c == '\r') {
+                os << "\\r";
+            } else {
+                os << c;
+            }
+        }
+    } else {
+        os << "EOF";
+    }
+
+    // A value is always the last field, and is written on the node's line
+    if (shape.rhs == Operand::VALUE) {
+        os << ", " << shape.fields.substr(shape.fields.rfind(' ') + 1) << ": " << n.rhs;
+    }
+
+    os << ")\n";
+
+    // The field names, in the order the children are visited
+    auto names = shape.fields;
+    auto next_name = [&] {
+        auto space = names.find(' ');
+        auto name = names.substr(0, space);
+        names = space == std::string_view::npos ? std::string_view{} : names.substr(space + 1);
+        return name;
+    };
+
+    auto write_child = [&](uint32_t child, std::string_view name) {
+        if (child) {
+            dump_node(os, ast, child, name, depth + 1);
+        }
+    };
+
+    auto write_list = [&](uint32_t begin, uint32_t end, std::string_view name) {
+        for (auto child : ast.list(begin, end)) {
+            dump_node(os, ast, child, name, depth + 1);
+        }
+    };
+
+    if (shape.lhs == Operand::EXTRA) {
+        auto field_index = n.lhs;
+        for (auto letter : shape.extra) {
+            auto name = next_name();
+            if (letter == 'n') {
+                write_child(ast.extra(field_index), name);
+                field_index += 1;
+            } else {
+                write_list(ast.extra(field_index), ast.extra(field_index + 1), name);
+                field_index += 2;
+            }
+        }
+    } else if (shape.lhs == Operand::LIST) {
+        write_list(n.lhs, n.rhs, next_name());
+    } else if (shape.lhs == Operand::NODE) {
+        write_child(n.lhs, next_name());
+    }
+
+    if (shape.rhs == Operand::NODE) {
+        write_child(n.rhs, next_name());
+    }
+}
+
+void dump(std::ostream &os, const Ast &ast, NodeId id)
+{
+    dump_node(os, ast, id, "", 0);
+}
+
+}
+
+}
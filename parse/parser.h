@@ -0,0 +1,292 @@
+#ifndef PARSE_PARSER_H
+#define PARSE_PARSER_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "arena.h"
+#include "skim.h"
+#include "tokens.h"
+
+namespace goop
+{
+
+namespace support
+{
+
+class ThreadPool;
+
+}
+
+namespace parser
+{
+
+// Index of a node within its Ast. Node 0 is the file, which is never
+// anyone's child, so a child of 0 means the child is absent.
+typedef uint32_t NodeId;
+
+enum class NodeKind : uint8_t {
+    // Statements of the file, the package clause first
+    FILE,
+    // Where the parser gave up, at its token
+    BAD,
+
+    PACKAGE,
+    // import, const, var or type, one spec or a parenthesized group
+    GEN_DECL,
+    IMPORT_SPEC,
+    VALUE_SPEC,
+    TYPE_SPEC,
+    ALIAS_SPEC,
+    FUNC_DECL,
+
+    // Parameters, results, type parameters and receivers
+    FIELD_LIST,
+    // Struct field, parameter or interface element
+    FIELD,
+
+    IDENT,
+    BASIC_LIT,
+    COMPOSITE_LIT,
+    KEY_VALUE,
+    FUNC_LIT,
+    PAREN,
+    SELECTOR,
+    INDEX,
+    // Instantiation with more than one type argument
+    INDEX_LIST,
+    SLICE,
+    TYPE_ASSERT,
+    CALL,
+    UNARY,
+    BINARY,
+
+    ELLIPSIS,
+    ARRAY_TYPE,
+    SLICE_TYPE,
+    MAP_TYPE,
+    CHAN_TYPE,
+    FUNC_TYPE,
+    STRUCT_TYPE,
+    INTERFACE_TYPE,
+
+    BLOCK,
+    // A function body left unparsed, see parse_lazy_body()
+    LAZY_BLOCK,
+    LABELED,
+    SEND,
+    INC_DEC,
+    ASSIGN,
+    GO,
+    DEFER,
+    RETURN,
+    // break, continue, goto and fallthrough
+    BRANCH,
+    IF,
+    SWITCH,
+    TYPE_SWITCH,
+    CASE_CLAUSE,
+    SELECT,
+    COMM_CLAUSE,
+    FOR,
+    RANGE,
+
+    count,
+};
+
+// Each node is its kind, the token it is named after (an operator, the
+// keyword starting a statement, a name) and two 32 bit operands whose
+// meaning depends on the kind, as given by its Layout. Anything that
+// doesn't fit in two operands goes in the extra data.
+struct Node {
+    NodeKind kind;
+    TokenIndex token;
+    uint32_t lhs;
+    uint32_t rhs;
+};
+
+enum class Operand : uint8_t {
+    NONE,
+    // A plain number
+    VALUE,
+    // A child, 0 if absent
+    NODE,
+    // Uses both operands: the children are extra[lhs] to extra[rhs]
+    LIST,
+    // Index of a record in the extra data, see Layout::extra
+    EXTRA,
+};
+
+struct Layout {
+    std::string_view name;
+    Operand lhs;
+    Operand rhs;
+    // The record an EXTRA operand points at, one letter per field:
+    // 'n' is a child, 'r' a list of children taking two words, its
+    // begin and end in the extra data
+    std::string_view extra;
+    // Space separated name of each child, lists and VALUE operands
+    // included: the fields of the record first, then lhs, then rhs
+    std::string_view fields;
+};
+
+const Layout &layout(NodeKind kind);
+
+struct ParseError {
+    // Where the error was found, the end of the stream at the end of input
+    TokenIndex token;
+    std::string_view expected;
+};
+
+// The syntax tree of one file, as flat arrays of nodes and extra data
+// held in an arena. Nodes refer to each other and to their extra data by
+// index, so the tree is a few large allocations however big the file is,
+// and reset() drops all of it at once.
+class Ast {
+    std::unique_ptr<support::Arena> arena;
+    const tokens::TokenStream *stream;
+    support::ArenaVector<Node> node_list;
+    support::ArenaVector<uint32_t> extra_data;
+    std::vector<ParseError> error_list;
+
+    friend class Parser;
+    friend class BodyParser;
+    friend void parse_lazy_body(Ast &ast, NodeId lazy);
+
+    public:
+    explicit Ast(const tokens::TokenStream &stream);
+
+    const tokens::TokenStream &tokens() const {
+        return *stream;
+    }
+
+    const Node &node(NodeId id) const {
+        return node_list[id];
+    }
+
+    size_t size() const {
+        return node_list.size();
+    }
+
+    uint32_t extra(size_t index) const {
+        return extra_data[index];
+    }
+
+    std::span<const uint32_t> extras() const {
+        return extra_data.view();
+    }
+
+    // Children from extra[begin] to extra[end]
+    std::span<const NodeId> list(uint32_t begin, uint32_t end) const {
+        return extra_data.view().subspan(begin, end - begin);
+    }
+
+    std::span<const ParseError> errors() const {
+        return error_list;
+    }
+
+    std::string_view text(TokenIndex token) const {
+        return stream->text(token);
+    }
+
+    // Calls visit with every child of a node that is there, in the order
+    // of its layout's fields, which is source order
+    template<typename Visit>
+    void for_each_child(NodeId id, Visit &&visit) const;
+
+    // Frees the whole tree, leaving the empty file
+    void reset();
+
+    // Bytes of the arena taken by nodes and extra data. What the arena
+    // holds in all is memory().capacity().
+    size_t storage_bytes() const {
+        return arena->allocated();
+    }
+
+    const support::Arena &memory() const {
+        return *arena;
+    }
+};
+
+template<typename Visit>
+void Ast::for_each_child(NodeId id, Visit &&visit) const
+{
+    const auto &n = node(id);
+    const auto &shape = layout(n.kind);
+
+    auto visit_node = [&](uint32_t child) {
+        if (child) {
+            visit(static_cast<NodeId>(child));
+        }
+    };
+
+    auto visit_list = [&](uint32_t begin, uint32_t end) {
+        for (auto child : list(begin, end)) {
+            visit(child);
+        }
+    };
+
+    if (shape.lhs == Operand::EXTRA) {
+        auto field = n.lhs;
+        for (auto letter : shape.extra) {
+            if (letter == 'n') {
+                visit_node(extra(field));
+                field += 1;
+            } else {
+                visit_list(extra(field), extra(field + 1));
+                field += 2;
+            }
+        }
+    } else if (shape.lhs == Operand::LIST) {
+        visit_list(n.lhs, n.rhs);
+        return;
+    } else if (shape.lhs == Operand::NODE) {
+        visit_node(n.lhs);
+    }
+
+    if (shape.rhs == Operand::NODE) {
+        visit_node(n.rhs);
+    }
+}
+
+// Parses a whole file. Comments in the stream are skipped and
+// semicolons are inserted at line ends as the language says, so a stream
+// lexed with any CommentMode works. The stream has to outlive the Ast.
+// Given the stream's bracket index, the body of every function
+// declaration is jumped over and left as a LazyBlock.
+Ast parse(const tokens::TokenStream &stream, const BracketIndex *lazy_bodies = nullptr);
+
+// Parses the block starting at the { at lbrace, such as the body of a
+// declaration found by skim(), adding its nodes and errors to ast
+NodeId parse_block(Ast &ast, TokenIndex lbrace);
+
+// Parses the body a LazyBlock stands for, turning the node into its Block
+void parse_lazy_body(Ast &ast, NodeId lazy);
+
+// Parses a file with its function bodies spread over the pool. The top
+// level is parsed first with lazy bodies, then the bodies in batches of
+// about batch_tokens tokens, each batch into an Ast and arena of its own,
+// and the batches are moved into the file's tree in source order. The
+// tree dumps the same as parse() gives, except that a syntax error in a
+// body can't throw the parser off outside it.
+Ast parse_parallel(const tokens::TokenStream &stream, support::ThreadPool &pool, size_t batch_tokens = 16 * 1024);
+
+// Parses the files of a package with parse_parallel, all at once
+std::vector<Ast> parse_parallel(
+        std::span<const tokens::TokenStream *const> streams,
+        support::ThreadPool &pool,
+        size_t batch_tokens = 16 * 1024
+);
+
+// Writes the tree under a node with each child on its own line,
+// indented under its parent and prefixed with its field name
+void dump(std::ostream &os, const Ast &ast, NodeId id = 0);
+
+}
+
+}
+
+#endif
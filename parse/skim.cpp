@@ -0,0 +1,384 @@
+#include "skim.h"
+#include <algorithm>
+#include <array>
+
+namespace goop
+{
+
+namespace parser
+{
+
+using tokens::Keyword;
+using tokens::Punctuation;
+using tokens::TokenKind;
+
+// The kind of bracket an opener or closer is, -1 for anything else
+static int bracket_of(uint32_t punctuation)
+{
+    switch (punctuation) {
+    case Punctuation::LPAREN:
+    case Punctuation::RPAREN:
+        return 0;
+    case Punctuation::LBRACKET:
+    case Punctuation::RBRACKET:
+        return 1;
+    case Punctuation::LBRACE:
+    case Punctuation::RBRACE:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+static bool is_opener(uint32_t punctuation)
+{
+    return punctuation == Punctuation::LPAREN || punctuation == Punctuation::LBRACKET
+        || punctuation == Punctuation::LBRACE;
+}
+
+BracketIndex::BracketIndex(const tokens::TokenStream &stream):
+    partners(stream.size(), NONE)
+{
+    auto kinds = stream.kinds();
+    auto payloads = stream.payloads();
+
+    // Openers waiting for their closer, and how many of each kind there
+    // are, so that a closer nothing waits for is known unmatched without
+    // searching the stack
+    std::vector<TokenIndex> open;
+    std::array<size_t, 3> waiting{};
+
+    for (TokenIndex i = 0; i < kinds.size(); ++i) {
+        if (kinds[i] != TokenKind::PUNCTUATION)
+            continue;
+
+        auto bracket = bracket_of(payloads[i]);
+        if (bracket < 0)
+            continue;
+
+        if (is_opener(payloads[i])) {
+            open.push_back(i);
+            waiting[bracket] += 1;
+            continue;
+        }
+
+        if (!waiting[bracket])
+            continue;
+
+        // A closer for an outer bracket closes the unclosed ones inside
+        // it too, they stay unmatched
+        while (bracket_of(payloads[open.back()]) != bracket) {
+            waiting[bracket_of(payloads[open.back()])] -= 1;
+            open.pop_back();
+        }
+
+        partners[open.back()] = i;
+        partners[i] = open.back();
+        waiting[bracket] -= 1;
+        open.pop_back();
+    }
+}
+
+std::string_view name(Declaration::Kind kind)
+{
+    switch (kind) {
+    case Declaration::IMPORT:
+        return "import";
+    case Declaration::CONST:
+        return "const";
+    case Declaration::VAR:
+        return "var";
+    case Declaration::TYPE:
+        return "type";
+    case Declaration::FUNC:
+        return "func";
+    case Declaration::METHOD:
+        return "method";
+    }
+
+    return "";
+}
+
+// Walks the top level of a file. Everything bracketed is jumped over
+// with the bracket index, and statement ends are found with the same
+// semicolon insertion the parser does, so no token inside a body is
+// ever looked at.
+class Skimmer {
+    const tokens::TokenStream &stream;
+    std::span<const TokenKind> kinds;
+    std::span<const uint32_t> payloads;
+    Outline &outline;
+    TokenIndex size;
+
+    TokenIndex skip_comments(TokenIndex index) const {
+        while (index < size && kinds[index] == TokenKind::COMMENT) {
+            ++index;
+        }
+
+        return index;
+    }
+
+    TokenIndex next(TokenIndex index) const {
+        return skip_comments(index + 1);
+    }
+
+    bool is_punctuation(TokenIndex index, Punctuation::Kind kind) const {
+        return index < size && kinds[index] == TokenKind::PUNCTUATION && payloads[index] == kind;
+    }
+
+    bool is_keyword(TokenIndex index, Keyword::Kind kind) const {
+        return index < size && kinds[index] == TokenKind::KEYWORD && payloads[index] == kind;
+    }
+
+    bool is_identifier(TokenIndex index) const {
+        return index < size && kinds[index] == TokenKind::IDENTIFIER;
+    }
+
+    bool opens(TokenIndex index) const {
+        return kinds[index] == TokenKind::PUNCTUATION && is_opener(payloads[index]);
+    }
+
+    // The last token of the bracketed part starting at index, the token
+    // itself if it isn't an opener. An unclosed bracket runs to limit.
+    TokenIndex last_of(TokenIndex index, TokenIndex limit) const {
+        if (!opens(index))
+            return index;
+
+        auto match = outline.brackets.match(index);
+        return match == BracketIndex::NONE ? limit - 1 : match;
+    }
+
+    // The significant token after the bracketed part starting at index
+    TokenIndex step(TokenIndex index, TokenIndex limit) const {
+        return std::min(next(last_of(index, limit)), limit);
+    }
+
+    // One past the last token of the statement starting at index, which
+    // ends before an explicit semicolon, at a line break that inserts
+    // one, or at limit
+    TokenIndex statement_end(TokenIndex index, TokenIndex limit) const {
+        auto end = index;
+
+        while (index < limit && !is_punctuation(index, Punctuation::SEMICOLON)) {
+            auto last = last_of(index, limit);
+            end = last + 1;
+
+            auto following = skip_comments(last + 1);
+            if (stream.semicolon_between(last, following))
+                break;
+
+            index = following;
+        }
+
+        return end;
+    }
+
+    void add(Declaration::Kind kind, TokenIndex name, TokenIndex begin, TokenIndex end,
+            TokenIndex body_begin, TokenIndex body_end) {
+        outline.declarations.push_back(Declaration{
+            kind, name, BracketIndex::NONE, begin, end, body_begin, body_end
+        });
+    }
+
+    // One spec, its first significant token at first
+    void spec(Declaration::Kind kind, TokenIndex begin, TokenIndex first, TokenIndex end) {
+        if (kind == Declaration::IMPORT) {
+            auto path = first;
+            while (path < end && kinds[path] != TokenKind::STRING_LITERAL) {
+                path = next(path);
+            }
+
+            add(kind, path < end ? path : BracketIndex::NONE, begin, end, end, end);
+            return;
+        }
+
+        if (kind == Declaration::TYPE) {
+            auto name = is_identifier(first) ? first : BracketIndex::NONE;
+            auto body = name == BracketIndex::NONE ? first : std::min(next(first), end);
+            add(kind, name, begin, end, body, end);
+            return;
+        }
+
+        // The values of a const or var follow the first = outside brackets
+        auto names = outline.declarations.size();
+        auto index = first;
+        while (index < end && is_identifier(index)) {
+            add(kind, index, begin, end, end, end);
+            index = next(index);
+            if (!is_punctuation(index, Punctuation::COMMA))
+                break;
+
+            index = next(index);
+        }
+
+        while (index < end && !is_punctuation(index, Punctuation::ASSIGNMENT)) {
+            index = step(index, end);
+        }
+
+        if (index < end) {
+            auto values = std::min(next(index), end);
+            for (auto i = names; i < outline.declarations.size(); ++i) {
+                outline.declarations[i].body_begin = values;
+            }
+        }
+    }
+
+    // import, const, var or type at keyword, returning where the next
+    // declaration can start
+    TokenIndex declaration(Declaration::Kind kind, TokenIndex keyword) {
+        auto first = next(keyword);
+
+        if (!is_punctuation(first, Punctuation::LPAREN)) {
+            auto end = statement_end(first, size);
+            spec(kind, keyword, first, end);
+            return skip_comments(end);
+        }
+
+        auto close = outline.brackets.match(first);
+        auto limit = close == BracketIndex::NONE ? size : close;
+        auto index = next(first);
+
+        while (index < limit) {
+            if (is_punctuation(index, Punctuation::SEMICOLON)) {
+                index = next(index);
+                continue;
+            }
+
+            auto end = statement_end(index, limit);
+            spec(kind, index, index, end);
+            index = skip_comments(end);
+        }
+
+        return limit == size ? size : next(close);
+    }
+
+    // Base type name of a receiver, the last name before the type's
+    // arguments or the closing paren
+    TokenIndex receiver_type(TokenIndex open, TokenIndex close) const {
+        auto type = BracketIndex::NONE;
+        for (auto index = next(open); index < close; index = step(index, close)) {
+            if (is_punctuation(index, Punctuation::LBRACKET))
+                break;
+
+            if (is_identifier(index)) {
+                type = index;
+            }
+        }
+
+        return type;
+    }
+
+    TokenIndex function(TokenIndex keyword) {
+        auto kind = Declaration::FUNC;
+        auto receiver = BracketIndex::NONE;
+        auto index = next(keyword);
+
+        if (is_punctuation(index, Punctuation::LPAREN)) {
+            kind = Declaration::METHOD;
+            auto close = last_of(index, size);
+            receiver = receiver_type(index, close);
+            index = next(close);
+        }
+
+        auto name = BracketIndex::NONE;
+        if (is_identifier(index)) {
+            name = index;
+            index = next(index);
+        }
+
+        // Type parameters, parameters and results, up to the body. Only
+        // struct and interface types have braces in a signature.
+        auto end = index;
+        auto body_begin = BracketIndex::NONE;
+        bool type_literal = false;
+
+        while (index < size && !is_punctuation(index, Punctuation::SEMICOLON)) {
+            bool body = !type_literal && is_punctuation(index, Punctuation::LBRACE);
+            type_literal = is_keyword(index, Keyword::STRUCT) || is_keyword(index, Keyword::INTERFACE);
+
+            auto last = last_of(index, size);
+            end = last + 1;
+            if (body) {
+                body_begin = index;
+                break;
+            }
+
+            auto following = skip_comments(last + 1);
+            if (stream.semicolon_between(last, following))
+                break;
+
+            index = following;
+        }
+
+        if (body_begin == BracketIndex::NONE) {
+            body_begin = end;
+        }
+
+        outline.declarations.push_back(Declaration{
+            kind, name, receiver, keyword, end, body_begin, end
+        });
+
+        return skip_comments(end);
+    }
+
+    public:
+    Skimmer(const tokens::TokenStream &stream, Outline &outline):
+        stream{stream},
+        kinds{stream.kinds()},
+        payloads{stream.payloads()},
+        outline{outline},
+        size{static_cast<TokenIndex>(stream.size())} {}
+
+    void file() {
+        auto index = skip_comments(0);
+
+        if (is_keyword(index, Keyword::PACKAGE)) {
+            auto name = next(index);
+            if (is_identifier(name)) {
+                outline.package = name;
+            }
+
+            index = skip_comments(statement_end(index, size));
+        }
+
+        while (index < size) {
+            if (kinds[index] == TokenKind::KEYWORD) {
+                switch (payloads[index]) {
+                case Keyword::FUNC:
+                    index = function(index);
+                    continue;
+                case Keyword::IMPORT:
+                    index = declaration(Declaration::IMPORT, index);
+                    continue;
+                case Keyword::CONST:
+                    index = declaration(Declaration::CONST, index);
+                    continue;
+                case Keyword::VAR:
+                    index = declaration(Declaration::VAR, index);
+                    continue;
+                case Keyword::TYPE:
+                    index = declaration(Declaration::TYPE, index);
+                    continue;
+                }
+            }
+
+            // Semicolons between declarations, and anything that isn't one
+            if (is_punctuation(index, Punctuation::SEMICOLON)) {
+                index = next(index);
+            } else {
+                index = skip_comments(statement_end(index, size));
+            }
+        }
+    }
+};
+
+Outline skim(const tokens::TokenStream &stream)
+{
+    Outline outline{BracketIndex::NONE, {}, BracketIndex(stream)};
+    Skimmer(stream, outline).file();
+    return outline;
+}
+
+}
+
+}
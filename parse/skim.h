@@ -0,0 +1,89 @@
+#ifndef PARSE_SKIM_H
+#define PARSE_SKIM_H
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "tokens.h"
+
+namespace goop
+{
+
+namespace parser
+{
+
+typedef uint32_t TokenIndex;
+
+// The partner of every bracket of a stream, built in one pass so that
+// skipping from an opening (, [ or { to its closer, or back, is a single
+// lookup
+class BracketIndex {
+    std::vector<TokenIndex> partners;
+
+    public:
+    // Unmatched brackets, and tokens that aren't brackets
+    static constexpr TokenIndex NONE = UINT32_MAX;
+
+    BracketIndex() = default;
+    explicit BracketIndex(const tokens::TokenStream &stream);
+
+    TokenIndex match(TokenIndex index) const {
+        return partners[index];
+    }
+
+    size_t storage_bytes() const {
+        return partners.capacity() * sizeof(TokenIndex);
+    }
+};
+
+// A top level declaration found by skim(). Each name of a const or var
+// spec is a declaration of its own, sharing the spec's tokens.
+struct Declaration {
+    enum Kind : uint8_t {
+        IMPORT,
+        CONST,
+        VAR,
+        TYPE,
+        FUNC,
+        METHOD,
+    };
+
+    Kind kind;
+    // The declared name, or the path of an import. NONE if missing.
+    TokenIndex name;
+    // Base type name of a method's receiver, NONE otherwise
+    TokenIndex receiver;
+    // Tokens [begin, end) of the declaration, from its keyword, or from
+    // its first token when it is a spec in a parenthesized group
+    TokenIndex begin;
+    TokenIndex end;
+    // Tokens [body_begin, body_end) of a function's body, braces
+    // included, the values of a const or var, or everything after a
+    // type's name. Empty when there is none.
+    TokenIndex body_begin;
+    TokenIndex body_end;
+};
+
+std::string_view name(Declaration::Kind kind);
+
+// The shape of a file without its bodies
+struct Outline {
+    // Name of the package clause, NONE without one
+    TokenIndex package;
+    std::vector<Declaration> declarations;
+    BracketIndex brackets;
+};
+
+// Finds the top level declarations of a file in one linear pass over the
+// bracket index, jumping over everything bracketed, function bodies
+// included. Nothing is checked beyond what finding the names takes, a
+// stream with syntax errors still gets an outline of whatever could be
+// recognized.
+Outline skim(const tokens::TokenStream &stream);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,225 @@
+#include "source.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace goop
+{
+
+namespace source
+{
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other):
+    mapping{std::exchange(other.mapping, nullptr)},
+    mapping_size{std::exchange(other.mapping_size, 0)},
+    owned{std::move(other.owned)}
+{
+}
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer &&other)
+{
+    if (this != &other) {
+        if (mapping)
+            munmap(const_cast<char *>(mapping), mapping_size);
+
+        mapping = std::exchange(other.mapping, nullptr);
+        mapping_size = std::exchange(other.mapping_size, 0);
+        owned = std::move(other.owned);
+    }
+
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer()
+{
+    if (mapping)
+        munmap(const_cast<char *>(mapping), mapping_size);
+}
+
+std::optional<SourceBuffer> SourceBuffer::map_file(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return std::nullopt;
+
+    auto buffer = from_fd(fd);
+    close(fd);
+    return buffer;
+}
+
+std::optional<SourceBuffer> SourceBuffer::from_fd(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return std::nullopt;
+
+    // Regular, non-empty files are mapped, mmap can't do zero length
+    // and pipes/terminals have to be read
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        auto size = static_cast<size_t>(st.st_size);
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, size, MADV_SEQUENTIAL);
+            return SourceBuffer(static_cast<const char *>(addr), size);
+        }
+    }
+
+    std::string contents;
+    char chunk[64 * 1024];
+    while (true) {
+        auto n = read(fd, chunk, sizeof(chunk));
+        if (n == 0)
+            break;
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return std::nullopt;
+        }
+
+        contents.append(chunk, static_cast<size_t>(n));
+    }
+
+    return SourceBuffer(std::move(contents));
+}
+
+std::optional<SourceBuffer> SourceBuffer::from_file(FILE *file)
+{
+    return from_fd(fileno(file));
+}
+
+// Offsets of the first byte of every line
+static std::vector<uint32_t> find_line_starts(std::string_view text)
+{
+    std::vector<uint32_t> starts{0};
+    const char *data = text.data();
+    size_t size = text.size();
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // Compare 16 bytes at a time and only look at the ones that matched
+    const auto newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= size; i += 16) {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+        while (mask) {
+            starts.push_back(static_cast<uint32_t>(i + __builtin_ctz(mask) + 1));
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    while (i < size) {
+        auto found = static_cast<const char *>(std::memchr(data + i, '\n', size - i));
+        if (!found)
+            break;
+
+        i = static_cast<size_t>(found - data) + 1;
+        starts.push_back(static_cast<uint32_t>(i));
+    }
+
+    return starts;
+}
+
+SourceManager::File &SourceManager::get(FileId file) const
+{
+    std::shared_lock lock(mutex);
+    assert(file < files.size() && "Unknown file");
+    return *files[file];
+}
+
+std::optional<FileId> SourceManager::add(std::string path, SourceBuffer buffer)
+{
+    std::unique_lock lock(mutex);
+
+    // One past the end of each file is a location too, so the files'
+    // ranges are one byte longer than the files
+    auto base = next_base;
+    if (base + buffer.size() + 1 > UINT32_MAX)
+        return std::nullopt;
+
+    next_base += buffer.size() + 1;
+    files.push_back(std::make_unique<File>(
+                std::move(path), std::move(buffer), static_cast<uint32_t>(base)));
+    return static_cast<FileId>(files.size() - 1);
+}
+
+std::optional<FileId> SourceManager::load(const std::string &path)
+{
+    auto buffer = SourceBuffer::map_file(path);
+    if (!buffer)
+        return std::nullopt;
+
+    return add(path, std::move(*buffer));
+}
+
+size_t SourceManager::size() const
+{
+    std::shared_lock lock(mutex);
+    return files.size();
+}
+
+std::string_view SourceManager::path(FileId file) const
+{
+    return get(file).path;
+}
+
+std::string_view SourceManager::text(FileId file) const
+{
+    return get(file).buffer.view();
+}
+
+SourceLocation SourceManager::location(FileId file, uint32_t offset) const
+{
+    auto &entry = get(file);
+    assert(offset <= entry.buffer.size() && "Offset past the end of the file");
+    return SourceLocation(entry.base + offset);
+}
+
+FileId SourceManager::file(SourceLocation location) const
+{
+    assert(location.valid() && "Invalid location");
+
+    // Files are added in order of their bases
+    std::shared_lock lock(mutex);
+    auto it = std::upper_bound(files.begin(), files.end(), location.raw,
+            [](uint32_t raw, const auto &file) { return raw < file->base; });
+    assert(it != files.begin() && "Location before the first file");
+    return static_cast<FileId>(it - files.begin() - 1);
+}
+
+uint32_t SourceManager::offset(SourceLocation location) const
+{
+    return location.raw - get(file(location)).base;
+}
+
+LineColumn SourceManager::line_column(SourceLocation location) const
+{
+    auto &entry = get(file(location));
+    std::call_once(entry.lines_built, [&] {
+        entry.line_starts = find_line_starts(entry.buffer.view());
+    });
+
+    auto offset = location.raw - entry.base;
+    auto line = std::upper_bound(entry.line_starts.begin(), entry.line_starts.end(), offset) - 1;
+    return LineColumn{
+        entry.path,
+        static_cast<uint32_t>(line - entry.line_starts.begin() + 1),
+        offset - *line + 1,
+    };
+}
+
+}
+
+}
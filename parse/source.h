@@ -0,0 +1,149 @@
+#ifndef PARSE_SOURCE_H
+#define PARSE_SOURCE_H
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace goop
+{
+
+namespace source
+{
+
+// Owns the bytes of a single UTF-8 source file.
+// Files are memory mapped where possible, everything else (pipes,
+// in-memory test input) is held in a std::string.
+class SourceBuffer {
+    const char *mapping;
+    size_t mapping_size;
+    std::string owned;
+
+    SourceBuffer(const char *mapping, size_t mapping_size):
+        mapping{mapping}, mapping_size{mapping_size} {}
+
+    public:
+    SourceBuffer(std::string contents):
+        mapping{nullptr}, mapping_size{0}, owned{std::move(contents)} {}
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    SourceBuffer(SourceBuffer &&other);
+    SourceBuffer &operator=(SourceBuffer &&other);
+    ~SourceBuffer();
+
+    static std::optional<SourceBuffer> map_file(const std::string &path);
+    static std::optional<SourceBuffer> from_fd(int fd);
+    static std::optional<SourceBuffer> from_file(FILE *file);
+
+    std::string_view view() const {
+        if (mapping) {
+            return std::string_view(mapping, mapping_size);
+        }
+
+        return owned;
+    }
+
+    size_t size() const {
+        return view().size();
+    }
+};
+
+typedef uint32_t FileId;
+
+// Position of a byte in any file loaded into a SourceManager.
+// Every file gets its own range of a single 32 bit space, so a location
+// is the start of its file's range plus the byte offset into the file,
+// and tokens only need the offset they already carry to be located.
+class SourceLocation {
+    uint32_t raw;
+
+    explicit SourceLocation(uint32_t raw): raw{raw} {}
+    friend class SourceManager;
+
+    public:
+    // The invalid location, not in any file
+    SourceLocation(): raw{0} {}
+
+    bool valid() const {
+        return raw != 0;
+    }
+
+    uint32_t value() const {
+        return raw;
+    }
+
+    SourceLocation operator+(uint32_t offset) const {
+        return SourceLocation(raw + offset);
+    }
+
+    auto operator<=>(const SourceLocation &) const = default;
+};
+
+// Line and column of a location, both starting at 1.
+// Columns count bytes, like the go tool's positions.
+struct LineColumn {
+    std::string_view path;
+    uint32_t line;
+    uint32_t column;
+};
+
+// Owns the buffers of every loaded file and maps between locations and
+// file/offset or line/column positions. Line tables are only built the
+// first time a position in that file is asked for.
+// Safe to load files and look up locations from any number of threads.
+class SourceManager {
+    struct File {
+        std::string path;
+        SourceBuffer buffer;
+        uint32_t base;
+
+        std::once_flag lines_built;
+        std::vector<uint32_t> line_starts;
+
+        File(std::string path, SourceBuffer buffer, uint32_t base):
+            path{std::move(path)}, buffer{std::move(buffer)}, base{base} {}
+    };
+
+    mutable std::shared_mutex mutex;
+    std::vector<std::unique_ptr<File>> files;
+    uint64_t next_base;
+
+    File &get(FileId file) const;
+
+    public:
+    SourceManager(): next_base{1} {}
+
+    SourceManager(const SourceManager &) = delete;
+    SourceManager &operator=(const SourceManager &) = delete;
+
+    // Fails once the files loaded so far fill the location space
+    std::optional<FileId> add(std::string path, SourceBuffer buffer);
+    std::optional<FileId> load(const std::string &path);
+
+    size_t size() const;
+    std::string_view path(FileId file) const;
+    std::string_view text(FileId file) const;
+
+    // Offsets up to and including the size of the file are valid,
+    // the last one being the end of the file
+    SourceLocation location(FileId file, uint32_t offset) const;
+
+    FileId file(SourceLocation location) const;
+    uint32_t offset(SourceLocation location) const;
+    LineColumn line_column(SourceLocation location) const;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "stats.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace goop
+{
+
+namespace stats
+{
+
+thread_local constinit Counters *thread_counters = nullptr;
+
+// Counters of threads that have finished are kept, their counts
+// still belong in the totals
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<Counters>> registry;
+
+Counters &register_thread()
+{
+    std::lock_guard lock(registry_mutex);
+    registry.push_back(std::make_unique<Counters>());
+    thread_counters = registry.back().get();
+    return *thread_counters;
+}
+
+Counters snapshot()
+{
+    std::lock_guard lock(registry_mutex);
+
+    Counters total;
+    for (const auto &counters : registry) {
+        total.add(*counters);
+    }
+
+    return total;
+}
+
+void Counters::add(const Counters &other)
+{
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        tokens[i] += other.tokens[i];
+    }
+
+    bytes += other.bytes;
+    allocations += other.allocations;
+    allocated_bytes += other.allocated_bytes;
+
+    for (size_t i = 0; i < consumers.size(); ++i) {
+        consumers[i].calls += other.consumers[i].calls;
+        consumers[i].matches += other.consumers[i].matches;
+        consumers[i].backtracks += other.consumers[i].backtracks;
+        consumers[i].backtracked_bytes += other.consumers[i].backtracked_bytes;
+    }
+
+    for (size_t i = 0; i < phase_ns.size(); ++i) {
+        phase_ns[i] += other.phase_ns[i];
+    }
+}
+
+std::string_view name(Consumer consumer)
+{
+    static constexpr std::string_view names[] = {
+        "punctuation",
+        "identifier",
+        "number",
+        "rune",
+        "string",
+        "raw_string",
+        "comment",
+    };
+
+    static_assert(std::size(names) == static_cast<size_t>(Consumer::count));
+    return names[static_cast<size_t>(consumer)];
+}
+
+std::string_view name(Phase phase)
+{
+    static constexpr std::string_view names[] = {
+        "read",
+        "lex",
+        "stitch",
+        "relex",
+        "cache",
+        "format",
+    };
+
+    static_assert(std::size(names) == static_cast<size_t>(Phase::count));
+    return names[static_cast<size_t>(phase)];
+}
+
+}
+
+}
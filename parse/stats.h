@@ -0,0 +1,160 @@
+#ifndef PARSE_STATS_H
+#define PARSE_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace goop
+{
+
+namespace stats
+{
+
+// Counting is compiled in with GOOP_STATS, without it every
+// function here is empty and the calls compile away
+#ifdef GOOP_STATS
+inline constexpr bool enabled = true;
+#else
+inline constexpr bool enabled = false;
+#endif
+
+// The consume_* functions the lexer dispatches to
+enum class Consumer : uint8_t {
+    PUNCTUATION,
+    IDENTIFIER,
+    NUMBER,
+    RUNE,
+    STRING,
+    RAW_STRING,
+    COMMENT,
+    count,
+};
+
+enum class Phase : uint8_t {
+    READ,
+    LEX,
+    // Joining the chunks of a parallel lex, re-lexing those guessed wrong
+    STITCH,
+    RELEX,
+    CACHE,
+    FORMAT,
+    count,
+};
+
+std::string_view name(Consumer consumer);
+std::string_view name(Phase phase);
+
+struct ConsumerCounts {
+    uint64_t calls = 0;
+    uint64_t matches = 0;
+    // Times the cursor was moved back after looking ahead, and how far
+    uint64_t backtracks = 0;
+    uint64_t backtracked_bytes = 0;
+};
+
+struct Counters {
+    // Indexed by TokenKind
+    std::array<uint64_t, 10> tokens{};
+    // Every byte the lexer moved over, whitespace included
+    uint64_t bytes = 0;
+    // Buffers the lexer allocated for token values
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    std::array<ConsumerCounts, static_cast<size_t>(Consumer::count)> consumers{};
+    // Summed over threads, so parallel phases can add up to more than
+    // the time they took
+    std::array<uint64_t, static_cast<size_t>(Phase::count)> phase_ns{};
+
+    void add(const Counters &other);
+};
+
+// Each thread counts into its own Counters, so counting never contends
+extern thread_local constinit Counters *thread_counters;
+Counters &register_thread();
+
+inline Counters &local()
+{
+    if (auto *counters = thread_counters) {
+        return *counters;
+    }
+
+    return register_thread();
+}
+
+// Sum over every thread that counted anything. Only exact once the
+// threads are done, nothing synchronizes with them while they count.
+Counters snapshot();
+
+inline void count_token(size_t kind, uint64_t bytes)
+{
+    if constexpr (enabled) {
+        auto &counters = local();
+        counters.tokens[kind] += 1;
+        counters.bytes += bytes;
+    }
+}
+
+inline void count_bytes(uint64_t bytes)
+{
+    if constexpr (enabled) {
+        local().bytes += bytes;
+    }
+}
+
+inline void count_call(Consumer consumer, bool matched)
+{
+    if constexpr (enabled) {
+        auto &counts = local().consumers[static_cast<size_t>(consumer)];
+        counts.calls += 1;
+        counts.matches += matched;
+    }
+}
+
+inline void count_backtrack(Consumer consumer, uint64_t bytes)
+{
+    if constexpr (enabled) {
+        auto &counts = local().consumers[static_cast<size_t>(consumer)];
+        counts.backtracks += 1;
+        counts.backtracked_bytes += bytes;
+    }
+}
+
+inline void count_allocation(uint64_t bytes)
+{
+    if constexpr (enabled) {
+        auto &counters = local();
+        counters.allocations += 1;
+        counters.allocated_bytes += bytes;
+    }
+}
+
+// Adds the time until it goes out of scope to a phase
+class ScopedPhase {
+#ifdef GOOP_STATS
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+    public:
+    ScopedPhase(Phase phase): phase{phase}, start{std::chrono::steady_clock::now()} {}
+
+    ~ScopedPhase() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        local().phase_ns[static_cast<size_t>(phase)] +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+#else
+    public:
+    ScopedPhase(Phase) {}
+#endif
+
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,580 @@
+#include "token_cache.h"
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <unordered_map>
+#include <unistd.h>
+
+namespace goop
+{
+
+namespace tokens
+{
+
+namespace fs = std::filesystem;
+
+__extension__ typedef unsigned __int128 Uint128;
+
+static constexpr char MAGIC[8] = {'G', 'O', 'O', 'P', 'T', 'O', 'K', '\0'};
+
+// Bumped whenever the encoding changes
+static constexpr uint32_t FORMAT_VERSION = 2;
+
+// Fields are in native byte order, entries aren't meant to be moved
+// between machines
+struct Header {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t lexer_version;
+    uint64_t hash_low;
+    uint64_t hash_high;
+    uint64_t source_size;
+    uint64_t token_count;
+    uint64_t name_count;
+    uint64_t names_size;
+    uint64_t data_size;
+    // Hash of everything after the header
+    uint64_t checksum;
+};
+
+static_assert(sizeof(Header) == 80);
+
+// Where a block of tokens starts in the data, and the end of the token
+// before it, which the block's first offset is relative to
+struct IndexEntry {
+    uint32_t data_offset;
+    uint32_t previous_end;
+};
+
+static uint64_t load64(const char *p)
+{
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Folded 64x64 -> 128 bit product, the mixing step of the wyhash family
+static uint64_t mix(uint64_t a, uint64_t b)
+{
+    auto product = static_cast<Uint128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+ContentHash hash_content(std::string_view source)
+{
+    static constexpr uint64_t K0 = 0xa0761d6478bd642f;
+    static constexpr uint64_t K1 = 0xe7037ed1a0b428db;
+    static constexpr uint64_t K2 = 0x8ebc6af09c88c6e3;
+    static constexpr uint64_t K3 = 0x589965cc75374cc3;
+
+    const char *data = source.data();
+    size_t size = source.size();
+    uint64_t first = K0 ^ size;
+    uint64_t second = K1 + size;
+
+    // Two lanes of 8 bytes each, so the multiplies can overlap
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        auto a = load64(data + i);
+        auto b = load64(data + i + 8);
+        first = mix(a ^ K2, first ^ b);
+        second = mix(b ^ K3, second ^ a);
+    }
+
+    char tail[16] = {};
+    std::memcpy(tail, data + i, size - i);
+    first = mix(load64(tail) ^ K2, first ^ K1);
+    second = mix(load64(tail + 8) ^ K3, second ^ K0);
+
+    auto low = mix(first ^ K0, second ^ K3);
+    auto high = mix(second ^ K1, low ^ K2);
+    return ContentHash{low, high};
+}
+
+std::string ContentHash::hex() const
+{
+    static constexpr char digits[] = "0123456789abcdef";
+
+    std::string text(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        text[15 - i] = digits[(high >> (i * 4)) & 0xF];
+        text[31 - i] = digits[(low >> (i * 4)) & 0xF];
+    }
+
+    return text;
+}
+
+static void put_varint(std::string &out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back(static_cast<char>(value));
+}
+
+static void put_fixed64(std::string &out, uint64_t value)
+{
+    char bytes[8];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    out.append(bytes, sizeof(bytes));
+}
+
+static void encode_int(std::string &out, const IntLiteral &lit)
+{
+    out.push_back(static_cast<char>(lit.radix | (lit.cached ? 0x80 : 0)));
+    if (lit.cached) {
+        put_varint(out, *lit.cached);
+    }
+}
+
+static void encode_float(std::string &out, const FloatLiteral &lit, const char *token)
+{
+    assert(lit.mantissa.data() == token && "Token not from the given source");
+
+    put_varint(out, lit.mantissa.size());
+    put_varint(out, lit.exponent.empty() ? 0 : lit.exponent.data() - token);
+    put_varint(out, lit.exponent.size());
+    put_varint(out, static_cast<uint32_t>(lit.exponent_char.value_or(0)));
+    out.push_back(static_cast<char>(lit.radix | (lit.negative ? 0x80 : 0)));
+
+    uint64_t bits;
+    auto value = lit.value();
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_fixed64(out, bits);
+}
+
+std::string encode_tokens(const TokenStream &tokens, std::string_view source, const ContentHash &hash)
+{
+    assert(tokens.comment_mode() == CommentMode::ALL && "Comments dropped from the tokens");
+
+    auto offsets = tokens.offsets();
+    auto lengths = tokens.lengths();
+
+    std::vector<IndexEntry> index;
+    index.reserve((tokens.size() + CachedTokens::BLOCK_SIZE - 1) / CachedTokens::BLOCK_SIZE);
+
+    // Identifiers refer to the first place their name appears
+    std::string names;
+    std::unordered_map<Symbol, uint32_t> name_indices;
+
+    // Most tokens take three or four bytes
+    std::string data;
+    data.reserve(tokens.size() * 4);
+
+    uint32_t previous_end = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (i % CachedTokens::BLOCK_SIZE == 0) {
+            index.push_back({static_cast<uint32_t>(data.size()), previous_end});
+        }
+
+        auto offset = offsets[i];
+        data.push_back(static_cast<char>(tokens.kinds()[i]));
+        put_varint(data, offset - previous_end);
+        put_varint(data, lengths[i]);
+        previous_end = offset + lengths[i];
+
+        // Anything that can be worked out from the text is left out
+        std::visit([&](const auto &tok) {
+            using T = std::decay_t<decltype(tok)>;
+
+            if constexpr (std::is_same_v<T, Keyword> || std::is_same_v<T, Punctuation>) {
+                data.push_back(static_cast<char>(tok.kind));
+            } else if constexpr (std::is_same_v<T, Identifier>) {
+                auto [it, added] = name_indices.try_emplace(tok.symbol, name_indices.size());
+                if (added) {
+                    put_varint(names, offset);
+                    put_varint(names, lengths[i]);
+                }
+
+                put_varint(data, it->second);
+            } else if constexpr (std::is_same_v<T, IntLiteral>) {
+                encode_int(data, tok);
+            } else if constexpr (std::is_same_v<T, FloatLiteral>) {
+                encode_float(data, tok, source.data() + offset);
+            } else if constexpr (std::is_same_v<T, ImaginaryLiteral>) {
+                data.push_back(static_cast<char>(tok.inner.index()));
+                std::visit([&](const auto &inner) {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(inner)>, IntLiteral>) {
+                        encode_int(data, inner);
+                    } else {
+                        encode_float(data, inner, source.data() + offset);
+                    }
+                }, tok.inner);
+            } else if constexpr (std::is_same_v<T, RuneLiteral>) {
+                data.push_back(static_cast<char>(tok.kind));
+                put_varint(data, static_cast<uint32_t>(tok.rune));
+            } else if constexpr (std::is_same_v<T, StringLiteral>) {
+                put_varint(data, tok.decoded ? tok.decoded->size() + 1 : 0);
+                if (tok.decoded) {
+                    data.append(*tok.decoded);
+                }
+            } else if constexpr (std::is_same_v<T, Error>) {
+                data.push_back(static_cast<char>(tok.reason));
+            }
+        }, tokens[i]);
+    }
+
+    std::string body;
+    body.reserve(index.size() * sizeof(IndexEntry) + names.size() + data.size());
+    body.append(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(IndexEntry));
+    body.append(names);
+    body.append(data);
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.format_version = FORMAT_VERSION;
+    header.lexer_version = LEXER_VERSION;
+    header.hash_low = hash.low;
+    header.hash_high = hash.high;
+    header.source_size = source.size();
+    header.token_count = tokens.size();
+    header.name_count = name_indices.size();
+    header.names_size = names.size();
+    header.data_size = data.size();
+    header.checksum = hash_content(body).low;
+
+    std::string encoded;
+    encoded.reserve(sizeof(header) + body.size());
+    encoded.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    encoded.append(body);
+    return encoded;
+}
+
+// Bounds checked reads. The checksum already rules out damaged entries,
+// this only keeps one that was written wrong from being read past.
+struct Reader {
+    const char *pos;
+    const char *end;
+    bool ok = true;
+
+    uint8_t byte() {
+        if (pos == end) {
+            ok = false;
+            return 0;
+        }
+
+        return static_cast<uint8_t>(*pos++);
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            auto b = byte();
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return value;
+        }
+
+        ok = false;
+        return 0;
+    }
+
+    std::string_view bytes(uint64_t count) {
+        if (count > static_cast<uint64_t>(end - pos)) {
+            ok = false;
+            return {};
+        }
+
+        std::string_view view(pos, count);
+        pos += count;
+        return view;
+    }
+};
+
+std::optional<CachedTokens> CachedTokens::open(
+        std::string_view encoded,
+        std::string_view source,
+        const ContentHash &hash
+)
+{
+    if (encoded.size() < sizeof(Header))
+        return std::nullopt;
+
+    Header header;
+    std::memcpy(&header, encoded.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+            || header.format_version != FORMAT_VERSION
+            || header.lexer_version != LEXER_VERSION
+            || header.hash_low != hash.low
+            || header.hash_high != hash.high
+            || header.source_size != source.size())
+        return std::nullopt;
+
+    auto blocks = (header.token_count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    auto index_size = blocks * sizeof(IndexEntry);
+    if (encoded.size() != sizeof(Header) + index_size + header.names_size + header.data_size)
+        return std::nullopt;
+
+    // Tokens are decoded as they are iterated, a damaged entry has to be
+    // turned away here or it would end them early
+    if (hash_content(encoded.substr(sizeof(Header))).low != header.checksum)
+        return std::nullopt;
+
+    CachedTokens tokens(source);
+    tokens.index = encoded.substr(sizeof(Header), index_size);
+    tokens.data = encoded.substr(sizeof(Header) + index_size + header.names_size);
+    tokens.token_count = header.token_count;
+
+    // Each name is interned once here rather than for every use
+    auto names = encoded.substr(sizeof(Header) + index_size, header.names_size);
+    Reader reader{names.data(), names.data() + names.size()};
+    tokens.symbols.reserve(header.name_count);
+    for (uint64_t i = 0; i < header.name_count; ++i) {
+        auto offset = reader.varint();
+        auto length = reader.varint();
+        if (!reader.ok || offset + length > source.size())
+            return std::nullopt;
+
+        tokens.symbols.push_back(Interner::global().intern(source.substr(offset, length)));
+    }
+
+    return tokens;
+}
+
+CachedTokens::iterator CachedTokens::at(size_t index) const
+{
+    auto block = index / BLOCK_SIZE;
+    if (index >= token_count) {
+        return iterator(this, data.data() + data.size(), 0);
+    }
+
+    IndexEntry entry;
+    std::memcpy(&entry, this->index.data() + block * sizeof(IndexEntry), sizeof(entry));
+
+    iterator it(this, data.data() + entry.data_offset, entry.previous_end);
+    for (auto skip = index % BLOCK_SIZE; skip > 0; --skip) {
+        ++it;
+    }
+
+    return it;
+}
+
+static IntLiteral decode_int(Reader &reader, std::string_view text)
+{
+    auto flags = reader.byte();
+    IntLiteral lit(text, flags & 0x7F);
+    if (flags & 0x80) {
+        lit.cached = reader.varint();
+    }
+
+    return lit;
+}
+
+static FloatLiteral decode_float(Reader &reader, std::string_view token)
+{
+    auto mantissa_length = reader.varint();
+    auto exponent_start = reader.varint();
+    auto exponent_length = reader.varint();
+    auto exponent_char = static_cast<int32_t>(reader.varint());
+    auto flags = reader.byte();
+    auto bits = reader.bytes(sizeof(uint64_t));
+
+    if (!reader.ok || mantissa_length > token.size() || exponent_start + exponent_length > token.size()) {
+        reader.ok = false;
+        return FloatLiteral({}, {}, 10);
+    }
+
+    FloatLiteral lit(
+            token.substr(0, mantissa_length),
+            token.substr(exponent_start, exponent_length),
+            flags & 0x7F
+            );
+
+    if (exponent_char) {
+        lit.exponent_char = exponent_char;
+    }
+
+    double value;
+    std::memcpy(&value, bits.data(), sizeof(value));
+    lit.negative = flags & 0x80;
+    lit.cached = value;
+    return lit;
+}
+
+void CachedTokens::iterator::decode()
+{
+    Reader reader{pos, tokens->data.data() + tokens->data.size()};
+    if (reader.pos == reader.end) {
+        current.reset();
+        return;
+    }
+
+    auto kind = static_cast<TokenKind>(reader.byte());
+    auto offset = previous_end + reader.varint();
+    auto length = reader.varint();
+    if (offset + length > tokens->source.size()) {
+        current.reset();
+        return;
+    }
+
+    auto text = tokens->source.substr(offset, length);
+
+    // Decoded into the previous token's storage, saving a move
+    if (!current) {
+        current.emplace(LexedToken{Keyword(Keyword::Kind::BREAK), 0, 0});
+    }
+
+    auto &token = current->token;
+
+    switch (kind) {
+    case TokenKind::KEYWORD:
+        token = Keyword(static_cast<Keyword::Kind>(reader.byte()));
+        break;
+    case TokenKind::IDENTIFIER: {
+        auto name = reader.varint();
+        if (name >= tokens->symbols.size()) {
+            reader.ok = false;
+            break;
+        }
+
+        token = Identifier(text, tokens->symbols[name]);
+        break;
+    }
+    case TokenKind::INT_LITERAL:
+        token = decode_int(reader, text);
+        break;
+    case TokenKind::FLOAT_LITERAL:
+        token = decode_float(reader, text);
+        break;
+    case TokenKind::IMAGINARY_LITERAL:
+        // The inner literal is all of the token but the i
+        if (reader.byte() == 0) {
+            token = ImaginaryLiteral(decode_int(reader, text.substr(0, text.size() - 1)));
+        } else {
+            token = ImaginaryLiteral(decode_float(reader, text));
+        }
+        break;
+    case TokenKind::PUNCTUATION:
+        token = Punctuation(static_cast<Punctuation::Kind>(reader.byte()));
+        break;
+    case TokenKind::RUNE_LITERAL: {
+        auto rune_kind = static_cast<RuneLiteral::Kind>(reader.byte());
+        token = RuneLiteral(static_cast<UChar32>(reader.varint()), rune_kind);
+        break;
+    }
+    case TokenKind::STRING_LITERAL: {
+        StringLiteral lit(text.substr(1, text.size() - 2), text[0] == '`');
+        if (auto size = reader.varint()) {
+            lit.decoded = std::string(reader.bytes(size - 1));
+        }
+
+        token = std::move(lit);
+        break;
+    }
+    case TokenKind::COMMENT: {
+        bool multiline = text[1] == '*';
+        auto comment = text.substr(2);
+        if (multiline && comment.size() >= 2 && comment.ends_with("*/")) {
+            comment.remove_suffix(2);
+        }
+
+        token = Comment(comment, multiline);
+        break;
+    }
+    case TokenKind::ERROR: {
+        auto reason = reader.byte();
+        reader.ok &= reason <= Error::UNTERMINATED_COMMENT;
+        token = Error(text, static_cast<Error::Reason>(reason));
+        break;
+    }
+    default:
+        reader.ok = false;
+        break;
+    }
+
+    if (!reader.ok) {
+        current.reset();
+        return;
+    }
+
+    pos = reader.pos;
+    previous_end = static_cast<uint32_t>(offset + length);
+    current->offset = static_cast<uint32_t>(offset);
+    current->length = static_cast<uint32_t>(length);
+}
+
+TokenStream CachedTokens::to_stream() const
+{
+    TokenStream stream(source);
+    stream.reserve(token_count);
+
+    // Every comment is kept, so directives needn't be stored
+    for (const auto &lexed : *this) {
+        stream.push(lexed.token, lexed.offset, lexed.length);
+
+        if (std::holds_alternative<Comment>(lexed.token)) {
+            if (auto directive = Directive::find(source, lexed.offset, lexed.length)) {
+                stream.add_directive(*directive);
+            }
+        }
+    }
+
+    return stream;
+}
+
+fs::path TokenCache::entry_path(const ContentHash &hash) const
+{
+    // Fanned out over 256 subdirectories to keep each one small
+    auto name = hash.hex();
+    return directory / name.substr(0, 2) / (name.substr(2) + "-v" + std::to_string(LEXER_VERSION) + ".tok");
+}
+
+std::optional<CachedTokens> TokenCache::load(std::string_view source, const ContentHash &hash) const
+{
+    auto buffer = source::SourceBuffer::map_file(entry_path(hash).string());
+    if (!buffer)
+        return std::nullopt;
+
+    auto backing = std::make_shared<const source::SourceBuffer>(std::move(*buffer));
+    auto tokens = CachedTokens::open(backing->view(), source, hash);
+    if (!tokens)
+        return std::nullopt;
+
+    tokens->backing = std::move(backing);
+    return tokens;
+}
+
+bool TokenCache::store(const TokenStream &tokens, std::string_view source, const ContentHash &hash) const
+{
+    static std::atomic<uint64_t> counter;
+
+    // Entries are used whatever comments were asked for
+    if (tokens.comment_mode() != CommentMode::ALL)
+        return false;
+
+    auto path = entry_path(hash);
+    std::error_code error;
+    fs::create_directories(path.parent_path(), error);
+    if (error)
+        return false;
+
+    // Readers only ever see a missing or a complete entry
+    auto temporary = path;
+    temporary += ".tmp" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+
+    auto encoded = encode_tokens(tokens, source, hash);
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+        if (!out) {
+            fs::remove(temporary, error);
+            return false;
+        }
+    }
+
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+}
@@ -0,0 +1,150 @@
+#ifndef PARSE_TOKEN_CACHE_H
+#define PARSE_TOKEN_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "source.h"
+#include "tokens.h"
+
+namespace goop
+{
+
+namespace tokens
+{
+
+// 128 bit hash of a source buffer, which names its cache entry
+struct ContentHash {
+    uint64_t low;
+    uint64_t high;
+
+    bool operator==(const ContentHash &) const = default;
+    std::string hex() const;
+};
+
+ContentHash hash_content(std::string_view source);
+
+// Tokens of a source buffer in the cache's binary encoding: a fixed
+// header with a checksum of the rest, a sparse index with an entry every BLOCK_SIZE tokens, where
+// each distinct identifier first appears, then the tokens themselves with
+// varint offsets relative to the end of the token before and varint
+// payloads. Text is never stored, tokens refer back into the source like
+// a TokenStream does. Only streams with every comment are encoded, their
+// directives can be found again from the comments.
+std::string encode_tokens(const TokenStream &tokens, std::string_view source, const ContentHash &hash);
+
+// Read only view of encoded tokens, decoded as they are iterated, so a
+// mapped cache entry is used in place. Symbols don't outlive the process
+// that made them, so the distinct identifiers are interned again when
+// the view is opened.
+class CachedTokens {
+    std::string_view source;
+    std::string_view index;
+    std::string_view data;
+    size_t token_count;
+    std::vector<Symbol> symbols;
+    // Keeps a mapped entry alive, if the view is of one
+    std::shared_ptr<const source::SourceBuffer> backing;
+
+    CachedTokens(std::string_view source): source{source}, token_count{0} {}
+
+    public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    class iterator {
+        const CachedTokens *tokens;
+        const char *pos;
+        uint32_t previous_end;
+        std::optional<LexedToken> current;
+
+        void decode();
+
+        public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = LexedToken;
+        using difference_type = std::ptrdiff_t;
+
+        iterator(const CachedTokens *tokens, const char *pos, uint32_t previous_end):
+            tokens{tokens}, pos{pos}, previous_end{previous_end} {
+            decode();
+        }
+
+        const LexedToken &operator*() const {
+            return *current;
+        }
+
+        const LexedToken *operator->() const {
+            return &*current;
+        }
+
+        iterator &operator++() {
+            decode();
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool operator==(std::default_sentinel_t) const {
+            return !current.has_value();
+        }
+    };
+
+    // Checks the header of encoded against source, which has to be the
+    // source the tokens were lexed from and outlive the view, and the
+    // checksum of the rest. A damaged entry is never opened.
+    static std::optional<CachedTokens> open(
+            std::string_view encoded,
+            std::string_view source,
+            const ContentHash &hash
+    );
+
+    size_t size() const {
+        return token_count;
+    }
+
+    iterator begin() const {
+        return at(0);
+    }
+
+    // Starts decoding from the block holding token index
+    iterator at(size_t index) const;
+
+    std::default_sentinel_t end() const {
+        return {};
+    }
+
+    TokenStream to_stream() const;
+
+    friend class TokenCache;
+};
+
+// Directory of encoded token streams, keyed by content hash and lexer
+// version, so identical files share an entry and entries from other
+// lexer versions are never read. Entries are written to a temporary file
+// and renamed into place, any number of threads and processes can share
+// a directory.
+class TokenCache {
+    std::filesystem::path directory;
+
+    std::filesystem::path entry_path(const ContentHash &hash) const;
+
+    public:
+    TokenCache(std::filesystem::path directory): directory{std::move(directory)} {}
+
+    // Maps the entry for source, if there is one
+    std::optional<CachedTokens> load(std::string_view source, const ContentHash &hash) const;
+    bool store(const TokenStream &tokens, std::string_view source, const ContentHash &hash) const;
+};
+
+}
+
+}
+
+#endif
@@ -1,16 +1,28 @@
 #include "tokens.h"
+#include "numeric.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
 #include <boost/multiprecision/cpp_int.hpp>
+#include <cerrno>
+#include <charconv>
 #include <cstdint>
+#include <cstring>
+#include <fcntl.h>
 #include <ios>
+#include <limits>
 #include <optional>
 #include <set>
 #include <string>
+#include <type_traits>
 #include <unicode/uchar.h>
 #include <unicode/urename.h>
 #include <unicode/ustream.h>
 #include <unicode/unistr.h>
 #include <unicode/unum.h>
 #include <unicode/schriter.h>
+#include <unistd.h>
 #include <variant>
 
 namespace goop
@@ -19,345 +31,475 @@ namespace goop
 namespace tokens
 {
 
-std::optional<int32_t> do_match(UFILE *file, UChar ch)
+template<typename T, typename... Args>
+std::optional<int32_t> matches(Cursor &cursor, T t, Args... args)
 {
-    u_fungetc(ch, file);
+    auto ch = cursor.peek_byte();
+    if (((ch == static_cast<int32_t>(t)) || ... || (ch == static_cast<int32_t>(args)))) {
+        cursor.advance_bytes(1);
+        return ch;
+    }
+
     return std::nullopt;
 }
 
-template<typename T, typename ...Args>
-std::optional<int32_t> do_match(UFILE *file, UChar ch, T t, Args... args)
+// Indexed by Keyword::Kind
+static constexpr std::string_view keyword_spellings[] = {
+    "break",
+    "case",
+    "chan",
+    "const",
+    "continue",
+    "default",
+    "defer",
+    "else",
+    "fallthrough",
+    "for",
+    "func",
+    "go",
+    "goto",
+    "if",
+    "import",
+    "interface",
+    "map",
+    "package",
+    "range",
+    "return",
+    "select",
+    "struct",
+    "switch",
+    "type",
+    "var",
+};
+
+static_assert(std::size(keyword_spellings) == Keyword::count);
+
+// Perfect hash over the keywords, the one the Go compiler's own scanner uses:
+// the first two characters and the length tell all of them apart
+constexpr size_t keyword_hash(std::string_view ident)
 {
-    if (ch == t) {
-        return ch;
+    auto c0 = static_cast<unsigned char>(ident[0]);
+    auto c1 = static_cast<unsigned char>(ident[1]);
+    return (((c0 << 4) ^ c1) + ident.size()) & 63;
+}
+
+static constexpr auto keyword_lengths = [] {
+    auto shortest = keyword_spellings[0].size();
+    auto longest = shortest;
+    for (auto keyword : keyword_spellings) {
+        shortest = std::min(shortest, keyword.size());
+        longest = std::max(longest, keyword.size());
     }
 
-    return do_match(file, ch, args...);
-}
+    return std::pair(shortest, longest);
+}();
 
-template<typename T, typename... Args>
-std::optional<int32_t> matches(UFILE *file, T t, Args... args)
-{
-    auto ch = u_fgetc(file);
-    return do_match(file, ch, t, args...);
-}
-
-static const std::map<icu::UnicodeString, Keyword::Kind> keyword_map = {
-    {"break",       Keyword::Kind::BREAK},
-    {"case",        Keyword::Kind::CASE},
-    {"chan",        Keyword::Kind::CHAN},
-    {"const",       Keyword::Kind::CONST},
-    {"continue",    Keyword::Kind::CONTINUE},
-    {"default",     Keyword::Kind::DEFAULT},
-    {"defer",       Keyword::Kind::DEFER},
-    {"else",        Keyword::Kind::ELSE},
-    {"fallthrough", Keyword::Kind::FALLTHROUGH},
-    {"for",         Keyword::Kind::FOR},
-    {"func",        Keyword::Kind::FUNC},
-    {"go",          Keyword::Kind::GO},
-    {"goto",        Keyword::Kind::GOTO},
-    {"if",          Keyword::Kind::IF},
-    {"import",      Keyword::Kind::IMPORT},
-    {"interface",   Keyword::Kind::INTERFACE},
-    {"map",         Keyword::Kind::MAP},
-    {"package",     Keyword::Kind::PACKAGE},
-    {"range",       Keyword::Kind::RANGE},
-    {"return",      Keyword::Kind::RETURN},
-    {"select",      Keyword::Kind::SELECT},
-    {"struct",      Keyword::Kind::STRUCT},
-    {"switch",      Keyword::Kind::SWITCH},
-    {"type",        Keyword::Kind::TYPE},
-    {"var",         Keyword::Kind::VAR},
+// Keyword kind for each hash, -1 for unused slots
+static constexpr auto keyword_table = [] {
+    std::array<int8_t, 64> table{};
+    table.fill(-1);
+
+    for (uint32_t kind = 0; kind < Keyword::count; ++kind) {
+        auto &slot = table[keyword_hash(keyword_spellings[kind])];
+        if (slot != -1)
+            throw "keyword_hash is no longer perfect";
+
+        slot = static_cast<int8_t>(kind);
+    }
+
+    return table;
+}();
+
+// Indexed by Punctuation::Kind
+static constexpr std::string_view punctuation_spellings[] = {
+    "+", "-", "*", "/", "%", "&", "|", "^",
+    "<<", ">>", "&^", "+=", "-=", "*=", "/=",
+    "%=", "&=", "|=", "^=", "<<=", ">>=",
+    "&^=", "&&", "||", "<-", "++", "--",
+    "==", "<", ">", "=", "!", "~", "!=",
+    "<=", ">=", ":=", "...", "(", ")", "[",
+    "]", "{", "}", ",", ";", ".", ":",
 };
 
-struct PunctuationParseNode {
-    std::optional<Punctuation::Kind> stop;
-    std::map<UChar, PunctuationParseNode> node;
-
-    PunctuationParseNode(std::optional<Punctuation::Kind> stop):
-        stop{stop}, node{{}} {}
-    PunctuationParseNode(std::map<UChar, PunctuationParseNode> node):
-        stop{std::nullopt}, node{node} {}
-    PunctuationParseNode(std::optional<Punctuation::Kind> stop,
-            std::map<UChar, PunctuationParseNode> node):
-        stop{stop}, node{node} {}
+static_assert(std::size(punctuation_spellings) == Punctuation::COLON + 1);
+
+// Flat DFA recognizing the longest punctuation at the cursor, built from
+// the spellings at compile time. Each byte maps to a column (0 if it can't
+// be part of punctuation), state 0 is the start state and also stands for
+// "no transition", since nothing ever transitions back into it.
+struct PunctuationDfa {
+    static constexpr size_t MAX_STATES = 64;
+    static constexpr size_t MAX_COLUMNS = 32;
+
+    std::array<uint8_t, 256> column{};
+    std::array<std::array<uint8_t, MAX_COLUMNS>, MAX_STATES> next{};
+    std::array<int8_t, MAX_STATES> accept{};
 };
 
-static const std::map<UChar, PunctuationParseNode> punctuation_map = {
-    {U'+', PunctuationParseNode(Punctuation::Kind::PLUS, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::PLUS_EQUAL)},
-            {U'+', PunctuationParseNode(Punctuation::Kind::INCREMENT)},
-            })},
-    {U'-', PunctuationParseNode(Punctuation::Kind::MINUS, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::MINUS_EQUAL)},
-            {U'-', PunctuationParseNode(Punctuation::Kind::DECREMENT)},
-            })},
-    {U'*', PunctuationParseNode(Punctuation::Kind::STAR, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::STAR_EQUAL)},
-            })},
-    {U'/', PunctuationParseNode(Punctuation::Kind::SLASH, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::SLASH_EQUAL)},
-            })},
-    {U'%', PunctuationParseNode(Punctuation::Kind::PERCENT, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::MOD_EQUAL)},
-            })},
-    {U'&', PunctuationParseNode(Punctuation::Kind::AMP, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::AND_EQUAL)},
-            {U'&', PunctuationParseNode(Punctuation::Kind::BOOL_AND)},
-            {U'^', PunctuationParseNode(Punctuation::Kind::BITCLEAR, {
-                    {U'=', PunctuationParseNode(Punctuation::Kind::BITCLEAR_EQUAL)},
-                    })},
-            })},
-    {U'|', PunctuationParseNode(Punctuation::Kind::PIPE, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::OR_EQUAL)},
-            {U'|', PunctuationParseNode(Punctuation::Kind::BOOL_OR)},
-            })},
-    {U'^', PunctuationParseNode(Punctuation::Kind::CARAT, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::XOR_EQUAL)},
-            })},
-    {U'<', PunctuationParseNode(Punctuation::Kind::LESS_THAN, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::LESS_THAN_EQUAL)},
-            {U'-', PunctuationParseNode(Punctuation::Kind::RECEIVE)},
-            {U'<', PunctuationParseNode(Punctuation::Kind::LSHIFT, {
-                    {U'=', PunctuationParseNode(Punctuation::Kind::LSHIFT_EQUAL)},
-                    })},
-            })},
-    {U'>', PunctuationParseNode(Punctuation::Kind::GREATER_THAN, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::GREATER_THAN_EQUAL)},
-            {U'>', PunctuationParseNode(Punctuation::Kind::RSHIFT, {
-                    {U'=', PunctuationParseNode(Punctuation::Kind::RSHIFT_EQUAL)},
-                    })},
-            })},
-    {U'=', PunctuationParseNode(Punctuation::Kind::ASSIGNMENT, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::EQUAL)},
-            })},
-    {U'!', PunctuationParseNode(Punctuation::Kind::BANG, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::NOT_EQUAL)},
-            })},
-    {U':', PunctuationParseNode(Punctuation::Kind::COLON, {
-            {U'=', PunctuationParseNode(Punctuation::Kind::SHORT_DECLARATION)},
-            })},
-    {U'~', PunctuationParseNode(Punctuation::Kind::TILDE)},
-    {U'(', PunctuationParseNode(Punctuation::Kind::LPAREN)},
-    {U')', PunctuationParseNode(Punctuation::Kind::RPAREN)},
-    {U'[', PunctuationParseNode(Punctuation::Kind::LBRACKET)},
-    {U']', PunctuationParseNode(Punctuation::Kind::RBRACKET)},
-    {U'{', PunctuationParseNode(Punctuation::Kind::LBRACE)},
-    {U'}', PunctuationParseNode(Punctuation::Kind::RBRACE)},
-    {U';', PunctuationParseNode(Punctuation::Kind::SEMICOLON)},
-    {U',', PunctuationParseNode(Punctuation::Kind::COMMA)},
-    {U'.', PunctuationParseNode(Punctuation::Kind::DOT, {
-            {U'.', PunctuationParseNode({
-                    {U'.', PunctuationParseNode(Punctuation::Kind::ELIPSES)},
-                    })},
-            })},
+static constexpr auto punctuation_dfa = [] {
+    PunctuationDfa dfa;
+    dfa.accept.fill(-1);
+
+    size_t columns = 1;
+    size_t states = 1;
+
+    for (size_t kind = 0; kind < std::size(punctuation_spellings); ++kind) {
+        uint8_t state = 0;
+
+        for (auto ch : punctuation_spellings[kind]) {
+            auto &column = dfa.column[static_cast<unsigned char>(ch)];
+            if (!column) {
+                if (columns == PunctuationDfa::MAX_COLUMNS)
+                    throw "too many punctuation characters";
+
+                column = static_cast<uint8_t>(columns++);
+            }
+
+            auto &next = dfa.next[state][column];
+            if (!next) {
+                if (states == PunctuationDfa::MAX_STATES)
+                    throw "too many punctuation states";
+
+                next = static_cast<uint8_t>(states++);
+            }
+
+            state = next;
+        }
+
+        dfa.accept[state] = static_cast<int8_t>(kind);
+    }
+
+    return dfa;
+}();
+
+// What a token starting with a given byte can be, so that
+// consume_tokens only has to look at it once
+enum class CharClass : uint8_t {
+    OTHER,
+    SPACE,
+    LETTER,
+    DIGIT,
+    DOT,
+    SLASH,
+    PUNCTUATION,
+    QUOTE,
+    BACKTICK,
+    APOSTROPHE,
+    NON_ASCII,
 };
 
-inline bool is_letter(uint16_t c) {
-    return u_isalpha(c) || (c == U'_');
+static constexpr auto char_classes = [] {
+    std::array<CharClass, 256> classes{};
+
+    for (auto spelling : punctuation_spellings) {
+        classes[static_cast<unsigned char>(spelling[0])] = CharClass::PUNCTUATION;
+    }
+
+    for (int c = 'a'; c <= 'z'; ++c) {
+        classes[c] = CharClass::LETTER;
+    }
+
+    for (int c = 'A'; c <= 'Z'; ++c) {
+        classes[c] = CharClass::LETTER;
+    }
+
+    for (int c = '0'; c <= '9'; ++c) {
+        classes[c] = CharClass::DIGIT;
+    }
+
+    for (int c = 0x80; c < 0x100; ++c) {
+        classes[c] = CharClass::NON_ASCII;
+    }
+
+    classes['_'] = CharClass::LETTER;
+    classes['.'] = CharClass::DOT;
+    classes['/'] = CharClass::SLASH;
+    classes['"'] = CharClass::QUOTE;
+    classes['`'] = CharClass::BACKTICK;
+    classes['\''] = CharClass::APOSTROPHE;
+
+    for (int c : {0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x1C, 0x1D, 0x1E, 0x1F, 0x20}) {
+        classes[c] = CharClass::SPACE;
+    }
+
+    return classes;
+}();
+
+inline bool is_letter(UChar32 c) {
+    if (c < 0x80) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_');
+    }
+
+    return u_isalpha(c);
 }
 
-std::optional<TokenVariant> consume_punctuation(UFILE *file)
+inline bool is_unicode_digit(UChar32 c) {
+    if (c < 0x80) {
+        return c >= '0' && c <= '9';
+    }
+
+    return u_isdigit(c);
+}
+
+inline bool is_space(UChar32 c) {
+    if (c < 0x80) {
+        return c == ' ' || (c >= 0x09 && c <= 0x0D) || (c >= 0x1C && c <= 0x1F);
+    }
+
+    return u_isspace(c);
+}
+
+// Value of an ASCII digit in radix, or -1 if it isn't one
+inline int32_t digit_value(int32_t c, uint8_t radix) {
+    int32_t digit;
+    if (c >= '0' && c <= '9') {
+        digit = c - '0';
+    } else if (c >= 'a' && c <= 'z') {
+        digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'Z') {
+        digit = c - 'A' + 10;
+    } else {
+        return -1;
+    }
+
+    return digit < radix ? digit : -1;
+}
+
+std::optional<TokenVariant> consume_punctuation(Cursor &cursor)
 {
-    const auto *mapping = &punctuation_map;
-    std::optional<Punctuation::Kind> candidate;
-    UChar ch;
+    uint8_t state = 0;
+    int8_t candidate = -1;
+    size_t candidate_length = 0;
+    size_t length = 0;
+
+    // Longest match wins, walking past a prefix that isn't itself
+    // punctuation (the ".." in "...") falls back to the last match
+    for (;;) {
+        auto ch = cursor.peek_byte(length);
+        if (ch == Cursor::END)
+            break;
 
-    while ((ch = u_fgetc(file)) != U_EOF) {
-            const auto &node = mapping->find(ch);
-            if (node != mapping->end()) {
-                candidate = node->second.stop;
-                mapping = &node->second.node;
-            } else {
-                break;
-            }
+        state = punctuation_dfa.next[state][punctuation_dfa.column[ch]];
+        if (!state)
+            break;
+
+        length += 1;
+        if (punctuation_dfa.accept[state] >= 0) {
+            candidate = punctuation_dfa.accept[state];
+            candidate_length = length;
+        }
     }
 
-    if (ch != U_EOF)
-        u_fungetc(ch, file);
+    if (candidate >= 0) {
+        if (length > candidate_length) {
+            stats::count_backtrack(stats::Consumer::PUNCTUATION, length - candidate_length);
+        }
 
-    if (candidate) {
-        return Punctuation(*candidate);
+        cursor.advance_bytes(candidate_length);
+        return Punctuation(static_cast<Punctuation::Kind>(candidate));
     }
 
     return std::nullopt;
 }
 
-std::optional<TokenVariant> consume_identifier(UFILE *file)
+std::optional<TokenVariant> consume_identifier(Cursor &cursor)
 {
-    icu::UnicodeString ident;
-    
-    auto c = u_fgetc(file);
-    if (c == U_EOF || !is_letter(c)) {
-        if (c != U_EOF)
-            u_fungetc(c, file);
+    auto start = cursor.offset();
+
+    auto c = cursor.peek();
+    if (!is_letter(c)) {
         return std::nullopt;
     }
 
     do {
-        ident.append(c);
+        cursor.next();
+        c = cursor.peek();
+    } while (is_letter(c) || is_unicode_digit(c));
 
-        c = u_fgetc(file);
-    } while (c != U_EOF && (is_letter(c) || u_isdigit(c)));
+    auto ident = cursor.since(start);
 
-    if (c != U_EOF)
-        u_fungetc(c, file);
-
-    auto kind_if_keyword = keyword_map.find(ident);
-    if (kind_if_keyword != keyword_map.end()) {
-        return Keyword(kind_if_keyword->second);
+    if (auto kind = Keyword::classify(ident)) {
+        return Keyword(*kind);
     }
 
-    return Identifier(ident);
+    return Identifier(ident, Interner::global().intern(ident));
 }
 
-// Consumes digits from the file into the digits string
+// Consumes digits from the cursor, and any _ among them, wherever they
+// are. Where an _ may go is checked on the whole literal afterwards, see
+// well_formed_number().
 // Returns the number of digits consumed and a bool indicating whether all digits were valid in radix
-// The actual radix read into the string is max(radix, 10)
-std::pair<uint32_t, bool> consume_digits(
-        UFILE *file,
-        icu::UnicodeString &digits,
-        uint8_t radix,
-        bool allow_starting_underscore,
-        bool last_was_underscore=false
-)
+// The actual radix read is max(radix, 10)
+std::pair<uint32_t, bool> consume_digits(Cursor &cursor, uint8_t radix)
 {
-    UChar next = u_fgetc(file);
-    if (next == U_EOF) {
-        u_fungetc(next, file);
-        return {0, true};
-    }
-
     auto effective_radix = std::max(radix, static_cast<uint8_t>(10));
     bool all_digits_in_radix = true;
+    uint32_t digits_consumed = 0;
 
-    int32_t digit = u_digit(next, effective_radix);
-    bool underscore_ok = allow_starting_underscore && next == U'_';
-    if (digit == -1 && !underscore_ok) {
-        u_fungetc(next, file);
-        return {0, all_digits_in_radix};
-    }
-
-    all_digits_in_radix &= (underscore_ok || u_digit(next, radix) != -1);
-    last_was_underscore = next == U'_';
-    if (!last_was_underscore) {
-        digits.append(next);
-    }
+    int32_t next;
+    while ((next = cursor.peek_byte()) != Cursor::END) {
+        if (next == U'_') {
+            cursor.advance_bytes(1);
+            continue;
+        }
 
-    uint32_t digits_consumed = 1;
-    while ((next = u_fgetc(file)) != U_EOF) {
-        digit = u_digit(next, effective_radix);
-        if (next != U'_' && digit == -1)
+        if (digit_value(next, effective_radix) == -1)
             break;
 
-        if (next == U'_' && last_was_underscore)
-            break;
-        if (last_was_underscore) {
-            digits_consumed += 1;
-            digits.append(static_cast<UChar>(U'_'));
+        // Long runs of plain digits go eight at a time
+        auto blocks = decimal_digit_blocks(cursor.rest(), radix, all_digits_in_radix);
+        if (blocks) {
+            cursor.advance_bytes(blocks);
+            digits_consumed += blocks;
+            continue;
         }
 
-        last_was_underscore = next == U'_';
-        all_digits_in_radix &= (next == U'_' || u_digit(next, radix) != -1);
+        cursor.advance_bytes(1);
+        all_digits_in_radix &= digit_value(next, radix) != -1;
+        digits_consumed += 1;
+    }
+
+    return {digits_consumed, all_digits_in_radix};
+}
+
+// Whether a literal the number lexer took in keeps the rules it doesn't
+// check as it goes: a prefix needs digits after it, a hex mantissa with a
+// point needs a p exponent, and each _ has to come right after a digit or
+// the prefix and right before a digit
+static bool well_formed_number(std::string_view text)
+{
+    char prefix = text.size() >= 2 && text[0] == '0' ? static_cast<char>(text[1] | 0x20) : 0;
+    bool prefixed = prefix == 'x' || prefix == 'b' || prefix == 'o';
+
+    if (prefixed) {
+        bool digits = false;
+        bool point = false;
+        bool exponent = false;
+        for (auto c : text.substr(2)) {
+            if (prefix == 'x' && (c == 'p' || c == 'P')) {
+                exponent = true;
+                break;
+            }
 
-        if (next != U'_') {
-            digits_consumed += 1;
-            digits.append(next);
+            point |= c == '.';
+            digits |= c != '.' && c != '_' && c != 'i';
         }
+
+        if (!digits || (point && !exponent))
+            return false;
     }
 
-    if (next != U_EOF)
-        u_fungetc(next, file);
-    
-    if (last_was_underscore)
-        u_fungetc(U'_', file);
+    if (text.find('_') == std::string_view::npos)
+        return true;
+
+    // What came before: '0' for a digit (or the prefix), '_', or '.' for
+    // anything else
+    char previous = prefixed ? '0' : '.';
+    for (size_t i = prefixed ? 2 : 0; i < text.size(); ++i) {
+        auto c = text[i];
+        if (c == '_') {
+            if (previous != '0')
+                return false;
+
+            previous = '_';
+        } else if (digit_value(c, prefix == 'x' ? 16 : 10) >= 0) {
+            previous = '0';
+        } else {
+            if (previous == '_')
+                return false;
+
+            previous = '.';
+        }
+    }
 
-    return {digits_consumed, all_digits_in_radix};
+    return previous != '_';
 }
 
 std::optional<FloatLiteral> consume_float_literal_with_exponent(
-        UFILE *file,
-        icu::UnicodeString &digits,
+        Cursor &cursor,
+        std::string_view mantissa,
         uint8_t radix,
-        std::optional<UChar> has_exponent
+        std::optional<int32_t> has_exponent
 )
 {
-    FloatLiteral literal(
-            digits,
-            icu::UnicodeString("", "utf-8"),
-            radix
-            );
+    FloatLiteral literal(mantissa, std::string_view(), radix);
 
     if (has_exponent.has_value()) {
         literal.exponent_char = has_exponent;
-        auto optional_sign = matches(file, U'+', U'-');
+        auto optional_sign = matches(cursor, U'+', U'-');
         literal.negative = optional_sign.has_value() && (*optional_sign == U'-');
 
         // Exponent radix is always 10
-        auto [exponent_digits, all_in_radix] = consume_digits(file, literal.exponent, 10, false);
+        auto exponent_start = cursor.offset();
+        auto [exponent_digits, all_in_radix] = consume_digits(cursor, 10);
         // FIXME: Do something about it?
         if (exponent_digits == 0 || !all_in_radix)
             return std::nullopt;
+
+        literal.exponent = cursor.since(exponent_start);
     }
 
+    literal.cached = float_literal_value(literal.mantissa, literal.exponent, literal.negative, literal.radix);
     return literal;
 }
 
 std::optional<FloatLiteral> consume_float_literal_after_decimal(
-        UFILE *file,
-        icu::UnicodeString &digits,
+        Cursor &cursor,
+        size_t start,
         uint8_t radix,
         bool allow_empty
 )
 {
-    consume_digits(file, digits, radix, false);
+    consume_digits(cursor, radix);
     if (false) {
         if (allow_empty) {
-            return FloatLiteral(digits, icu::UnicodeString("", "utf-8"), radix);
+            return FloatLiteral(cursor.since(start), std::string_view(), radix);
         }
 
-        u_fungetc(U'.', file);
+        cursor.seek(cursor.offset() - 1);
         return std::nullopt;
     }
 
-    std::optional<UChar> has_exponent;
+    auto mantissa = cursor.since(start);
+
+    std::optional<int32_t> has_exponent;
     assert(radix == 10 || radix == 16);
     if (radix == 10) {
-        has_exponent = matches(file, U'e', U'E');
+        has_exponent = matches(cursor, U'e', U'E');
     } else {
-        has_exponent = matches(file, U'p', U'P');
+        has_exponent = matches(cursor, U'p', U'P');
     }
 
-    return consume_float_literal_with_exponent(file, digits, radix, has_exponent);
+    return consume_float_literal_with_exponent(cursor, mantissa, radix, has_exponent);
 }
 
-std::optional<TokenVariant> consume_numeric_literal(UFILE *file)
+static std::optional<TokenVariant> do_consume_numeric_literal(Cursor &cursor)
 {
-    icu::UnicodeString digits("", "utf-8"), exponent("", "utf-8");
+    auto start = cursor.offset();
     uint8_t radix = 10;
     bool radix_implicit = false;
 
-    auto first = u_fgetc(file);
-    if (first == U_EOF) {
-        u_fungetc(first, file);
+    auto first = cursor.peek_byte();
+    if (first == Cursor::END) {
         return std::nullopt;
     }
 
-    digits.append(first);
+    cursor.advance_bytes(1);
     if (first == U'.') {
         // Must be a decimal float literal
-        return consume_float_literal_after_decimal(file, digits, radix, false);
+        return consume_float_literal_after_decimal(cursor, start, radix, false);
     }
 
-    auto first_digit = u_digit(first, 10);
+    auto first_digit = digit_value(first, 10);
     if (first_digit < 0)
         return std::nullopt;
 
     // Detect radix
-    auto second = u_fgetc(file);
+    auto second = cursor.peek_byte();
     bool second_digit_valid = true;
-    if (first_digit == 0 && second != U'.') {
-        if (auto digit = u_digit(second, 10); digit >= 0) {
+    // 0.5 and 0e5 are decimal floats, whatever their mantissa's first digit
+    if (first_digit == 0 && second != U'.' && second != U'e' && second != U'E') {
+        if (auto digit = digit_value(second, 10); digit >= 0) {
             radix = 8;
             radix_implicit = true;
 
@@ -375,20 +517,21 @@ std::optional<TokenVariant> consume_numeric_literal(UFILE *file)
         } else if (second == U'x' || second == U'X') {
             radix = 16;
         } else {
-            if (second != U_EOF)
-                u_fungetc(second, file);
-            return IntLiteral(digits, radix);
+            IntLiteral literal(cursor.since(start), radix, 0);
+            if (matches(cursor, U'i')) {
+                return ImaginaryLiteral(literal);
+            }
+
+            return literal;
         }
 
-        digits.append(second);
-    } else if (second != U_EOF) {
-        u_fungetc(second, file);
+        cursor.advance_bytes(1);
     }
 
-    auto [_, all_in_radix] = consume_digits(file, digits, radix, true);
+    auto [_, all_in_radix] = consume_digits(cursor, radix);
     all_in_radix &= second_digit_valid;
 
-    auto is_float = matches(file, U'.');
+    auto is_float = matches(cursor, U'.');
     if (is_float) {
         if (radix_implicit) {
             radix = 10;
@@ -398,21 +541,22 @@ std::optional<TokenVariant> consume_numeric_literal(UFILE *file)
             return std::nullopt;
         }
 
-        digits.append(*is_float);
-        auto literal = consume_float_literal_after_decimal(file, digits, radix, true);
+        auto literal = consume_float_literal_after_decimal(cursor, start, radix, true);
 
-        if (literal && matches(file, U'i')) {
+        if (literal && matches(cursor, U'i')) {
             return ImaginaryLiteral(*literal);
         }
 
         return literal;
     }
 
-    std::optional<UChar> has_exponent;
+    auto digits = cursor.since(start);
+
+    std::optional<int32_t> has_exponent;
     if (radix == 10 || radix_implicit) {
-        has_exponent = matches(file, U'e', U'E');
+        has_exponent = matches(cursor, U'e', U'E');
     } else if (radix == 16) {
-        has_exponent = matches(file, U'p', U'P');
+        has_exponent = matches(cursor, U'p', U'P');
     }
 
     if (has_exponent) {
@@ -424,15 +568,24 @@ std::optional<TokenVariant> consume_numeric_literal(UFILE *file)
             return std::nullopt;
         }
 
-        auto literal = consume_float_literal_with_exponent(file, digits, radix, has_exponent);
+        auto literal = consume_float_literal_with_exponent(cursor, digits, radix, has_exponent);
 
-        if (literal && matches(file, U'i')) {
+        if (literal && matches(cursor, U'i')) {
             return ImaginaryLiteral(*literal);
         }
 
         return literal;
     }
 
+    auto is_imaginary = matches(cursor, U'i');
+
+    // Backwards compat clause, imaginary literals with a leading 0 are
+    // decimal, so 8 and 9 are fine there
+    if (is_imaginary && radix_implicit) {
+        radix = 10;
+        all_in_radix = true;
+    }
+
     if (!all_in_radix) {
         return std::nullopt;
     }
@@ -442,19 +595,48 @@ std::optional<TokenVariant> consume_numeric_literal(UFILE *file)
             radix
             );
 
-    if (matches(file, U'i')) {
-        // Backwards compat clause
-        if (radix == 8 && radix_implicit) {
-            literal.radix = 10;
-        }
-
+    if (is_imaginary) {
         return ImaginaryLiteral(literal);
     }
 
+    literal.cached = int_literal_value(literal.lit, literal.radix);
     return literal;
 }
 
-std::optional<RuneLiteral> consume_rune_literal_character(UFILE *file, bool is_string_literal)
+std::optional<TokenVariant> consume_numeric_literal(Cursor &cursor)
+{
+    auto start = cursor.offset();
+    auto literal = do_consume_numeric_literal(cursor);
+    if (literal && well_formed_number(cursor.since(start))) {
+        return literal;
+    }
+
+    // The rest of what looks like the same literal goes in the error,
+    // rather than being lexed as identifiers and numbers of its own
+    while (cursor.peek_byte() == U'_' || digit_value(cursor.peek_byte(), 36) >= 0) {
+        cursor.advance_bytes(1);
+    }
+
+    return Error(cursor.since(start), Error::INVALID_NUMBER);
+}
+
+// Reads exactly count digits in radix into value
+static bool consume_escape_digits(Cursor &cursor, uint32_t &value, uint8_t radix, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        auto digit = digit_value(cursor.peek_byte(), radix);
+        if (digit < 0)
+            return false;
+
+        cursor.advance_bytes(1);
+        value *= radix;
+        value += digit;
+    }
+
+    return true;
+}
+
+std::optional<RuneLiteral> consume_rune_literal_character(Cursor &cursor, bool is_string_literal)
 {
     static const std::map<UChar, UChar> escaped_values_char = {
         {U'a', U'\a'},
@@ -482,290 +664,1336 @@ std::optional<RuneLiteral> consume_rune_literal_character(UFILE *file, bool is_s
 
     const auto &escaped_values = is_string_literal ? escaped_values_string : escaped_values_char;
 
-    if (!matches(file, U'\\')) {
-        UChar rune = u_fgetc(file);
+    if (!matches(cursor, U'\\')) {
+        // Neither rune nor string literals can span lines
+        UChar32 rune = cursor.next();
+        if (rune == Cursor::END || rune == '\n')
+            return std::nullopt;
+
         return RuneLiteral(rune, RuneLiteral::Kind::NORMAL);
     }
 
-    if (auto u = matches(file, U'u', U'U')) {
+    if (auto u = matches(cursor, U'u', U'U')) {
         auto kind = *u == U'U' ? RuneLiteral::Kind::BIG_U : RuneLiteral::Kind::LITTLE_U;
 
-        UChar rune = 0;
-        for (int i = 0; i < 4; ++i) {
-            auto ch = u_fgetc(file);
-            auto digit = u_digit(ch, 16);
-            if (digit < 0)
-                return std::nullopt;
+        uint32_t rune = 0;
+        if (!consume_escape_digits(cursor, rune, 16, kind == RuneLiteral::Kind::BIG_U ? 8 : 4))
+            return std::nullopt;
 
-            rune *= 16;
-            rune += digit;
-        }
+        // Surrogate halves aren't code points of their own
+        if (rune > 0x10FFFF || U_IS_SURROGATE(rune))
+            return std::nullopt;
 
-        return RuneLiteral(rune, kind);
+        return RuneLiteral(static_cast<UChar32>(rune), kind);
     }
 
-    if (matches(file, U'x')) {
-        UChar rune = 0;
-        for (int i = 0; i < 2; ++i) {
-            auto ch = u_fgetc(file);
-            auto digit = u_digit(ch, 16);
-            if (digit < 0)
-                return std::nullopt;
-
-            rune *= 16;
-            rune += digit;
-        }
+    if (matches(cursor, U'x')) {
+        uint32_t byte = 0;
+        if (!consume_escape_digits(cursor, byte, 16, 2))
+            return std::nullopt;
 
-        return RuneLiteral(rune, RuneLiteral::Kind::HEX_BYTE);
+        return RuneLiteral(static_cast<UChar32>(byte), RuneLiteral::Kind::HEX_BYTE);
     }
 
-    UChar next = u_fgetc(file);
-    if (next == U_EOF) {
+    auto next = cursor.peek_byte();
+    if (next == Cursor::END) {
         return std::nullopt;
     }
 
     auto match = escaped_values.find(next);
     if (match != escaped_values.end()) {
+        cursor.advance_bytes(1);
         return RuneLiteral(match->second, RuneLiteral::Kind::ESCAPED_CHAR);
-    } else {
-        u_fungetc(next, file);
     }
 
-    UChar rune = 0;
-    for (int i = 0; i < 3; ++i) {
-        auto ch = u_fgetc(file);
-        auto digit = u_digit(ch, 8);
-        if (digit < 0)
-            return std::nullopt;
-
-        rune *= 8;
-        rune += digit;
-    }
+    uint32_t byte = 0;
+    if (!consume_escape_digits(cursor, byte, 8, 3) || byte > 0xFF)
+        return std::nullopt;
 
-    return RuneLiteral(rune, RuneLiteral::Kind::OCTAL_BYTE);
+    return RuneLiteral(static_cast<UChar32>(byte), RuneLiteral::Kind::OCTAL_BYTE);
 }
 
-std::optional<RuneLiteral> consume_rune_literal(UFILE *file)
+// Moves the cursor from just inside a quoted literal past its closing
+// quote, or up to the end of the line if it has none. Escapes are only
+// told apart from the quote, they have been found invalid already.
+static bool skip_quoted(Cursor &cursor, char quote)
 {
-    if (!matches(file, U'\'')) {
-        return std::nullopt;
-    }
+    auto rest = cursor.rest();
+    for (size_t i = 0; i < rest.size(); ++i) {
+        auto c = rest[i];
+        if (c == quote) {
+            cursor.advance_bytes(i + 1);
+            return true;
+        }
 
-    auto rune = consume_rune_literal_character(file, false);
+        if (c == '\n') {
+            cursor.advance_bytes(i);
+            return false;
+        }
 
-    if (!rune || !matches(file, U'\'')) {
-        return std::nullopt;
+        if (c == '\\' && i + 1 < rest.size() && rest[i + 1] != '\n') {
+            ++i;
+        }
     }
 
-    return rune;
+    cursor.advance_bytes(rest.size());
+    return false;
 }
 
-std::optional<TokenVariant> consume_string_literal(UFILE *file)
+std::optional<TokenVariant> consume_rune_literal(Cursor &cursor)
 {
-    if (!matches(file, U'"')) {
+    auto start = cursor.offset();
+    if (!matches(cursor, U'\'')) {
         return std::nullopt;
     }
 
-    auto string_literal = StringLiteral();
+    auto rune = consume_rune_literal_character(cursor, false);
 
-    while (true) {
-        if (matches(file, U'"')) {
-            return string_literal;
-        }
+    if (!rune || !matches(cursor, U'\'')) {
+        stats::count_backtrack(stats::Consumer::RUNE, cursor.offset() - start);
+        cursor.seek(start + 1);
 
-        if (auto rune = consume_rune_literal_character(file, true)) {
-            string_literal.runes.push_back(*rune);
-        } else {
-            break;
-        }
+        auto closed = skip_quoted(cursor, '\'');
+        return Error(cursor.since(start), closed ? Error::INVALID_RUNE : Error::UNTERMINATED_RUNE);
     }
 
-    if (!matches(file, U'"')) {
-        return std::nullopt;
+    return *rune;
+}
+
+// First quote, backslash or newline, the only bytes of an interpreted
+// string literal that aren't simply part of its value
+static size_t find_string_special(std::string_view text)
+{
+    for (size_t i = 0; i < text.size(); ++i) {
+        auto c = text[i];
+        if (c == '"' || c == '\\' || c == '\n')
+            return i;
     }
 
-    return string_literal;
+    return std::string_view::npos;
 }
 
-std::optional<Comment> consume_comment(UFILE *file)
+static void append_utf8(std::string &out, UChar32 rune)
 {
-    if (!matches(file, U'/')) {
-        return std::nullopt;
-    }
+    // Escapes are checked to be code points when they are lexed
+    char buffer[U8_MAX_LENGTH];
+    int32_t length = 0;
+    U8_APPEND_UNSAFE(buffer, length, rune);
+    out.append(buffer, length);
+}
 
-    bool multiline = false;
-    if (auto ch = matches(file, U'/', U'*')) {
-        multiline = *ch == U'*';
-    } else {
-        u_fungetc(U'/', file);
+std::optional<TokenVariant> consume_string_literal(Cursor &cursor)
+{
+    auto start = cursor.offset();
+    if (!matches(cursor, U'"')) {
         return std::nullopt;
     }
 
-    icu::UnicodeString comment("", "utf-8");
+    // Without escapes the value is the text itself
+    auto body = cursor.rest();
+    auto end = find_string_special(body);
+    if (end != std::string_view::npos && body[end] == '"') {
+        cursor.advance_bytes(end + 1);
+        return StringLiteral(body.substr(0, end), false);
+    }
 
-    bool multiline_might_end = false;
-    while (auto ch = u_fgetc(file)) {
-        if (ch == U_EOF)
-            break;
+    std::string decoded;
+    auto rest = body;
+    while (end != std::string_view::npos && rest[end] == '\\') {
+        decoded.append(rest.substr(0, end));
+        cursor.advance_bytes(end);
 
-        if (!multiline && ch == U'\n')
+        auto rune = consume_rune_literal_character(cursor, true);
+        if (!rune)
             break;
 
-        if (multiline_might_end) {
-            if (ch == U'/')
-                break;
-
-            multiline_might_end = false;
+        // Byte escapes give single bytes, which need not be valid UTF-8
+        if (rune->kind == RuneLiteral::Kind::HEX_BYTE || rune->kind == RuneLiteral::Kind::OCTAL_BYTE) {
+            decoded.push_back(static_cast<char>(rune->rune));
+        } else {
+            append_utf8(decoded, rune->rune);
         }
 
-        if (multiline && ch == U'*') {
-            multiline_might_end = true;
-            continue;
-        }
+        rest = cursor.rest();
+        end = find_string_special(rest);
+        if (end != std::string_view::npos && rest[end] == '"') {
+            decoded.append(rest.substr(0, end));
+            cursor.advance_bytes(end + 1);
 
-        comment.append(ch);
+            StringLiteral literal(body.substr(0, cursor.offset() - start - 2), false);
+            stats::count_allocation(decoded.capacity());
+            literal.decoded = std::move(decoded);
+            return literal;
+        }
     }
 
-    return Comment(comment, multiline);
+    // Only an escape can have stopped a string that is closed on its line
+    stats::count_backtrack(stats::Consumer::STRING, cursor.offset() - start);
+    cursor.seek(start + 1);
+
+    auto closed = skip_quoted(cursor, '"');
+    return Error(cursor.since(start), closed ? Error::INVALID_ESCAPE : Error::UNTERMINATED_STRING);
 }
 
-TokenStream consume_tokens(UFILE *file)
+std::optional<TokenVariant> consume_raw_string_literal(Cursor &cursor)
 {
-    std::vector<TokenVariant> tokens;
+    if (cursor.peek_byte() != U'`') {
+        return std::nullopt;
+    }
 
-    while (true) {
-        auto peek = u_fgetc(file);
-        if (peek == U_EOF)
-            break;
+    auto body = cursor.rest().substr(1);
+    auto end = body.find('`');
+    if (end == std::string_view::npos) {
+        auto start = cursor.offset();
+        cursor.advance_bytes(body.size() + 1);
+        return Error(cursor.since(start), Error::UNTERMINATED_RAW_STRING);
+    }
 
-        if (u_isspace(peek))
-            continue;
+    cursor.advance_bytes(end + 2);
 
-        u_fungetc(peek, file);
+    StringLiteral literal(body.substr(0, end), true);
 
-        if (auto token = consume_comment(file)) {
-            tokens.push_back(*token);
-            continue;
-        }
+    // Carriage returns are dropped from the value of a raw string
+    if (literal.text.find('\r') != std::string_view::npos) {
+        literal.decoded.emplace();
+        std::copy_if(literal.text.begin(), literal.text.end(), std::back_inserter(*literal.decoded),
+                [](char c) { return c != '\r'; });
+        stats::count_allocation(literal.decoded->capacity());
+    }
 
-        if (auto token = consume_punctuation(file)) {
-            tokens.push_back(*token);
-            continue;
-        }
+    return literal;
+}
 
-        if (auto token = consume_string_literal(file)) {
-            tokens.push_back(*token);
-            continue;
-        }
+std::optional<TokenVariant> consume_comment(Cursor &cursor)
+{
+    if (cursor.peek_byte() != U'/') {
+        return std::nullopt;
+    }
 
-        if (auto token = consume_rune_literal(file)) {
-            tokens.push_back(*token);
-            continue;
-        }
+    bool multiline = false;
+    if (auto ch = cursor.peek_byte(1); ch == U'/' || ch == U'*') {
+        multiline = ch == U'*';
+    } else {
+        return std::nullopt;
+    }
 
-        if (auto token = consume_identifier(file)) {
-            tokens.push_back(*token);
-            continue;
-        }
+    auto start = cursor.offset();
+    cursor.advance_bytes(2);
 
-        if (auto token = consume_numeric_literal(file)) {
-            tokens.push_back(*token);
-            continue;
+    auto rest = cursor.rest();
+    auto text_end = multiline ? rest.find("*/") : rest.find('\n');
+    if (text_end == std::string_view::npos) {
+        cursor.advance_bytes(rest.size());
+        if (multiline) {
+            return Error(cursor.since(start), Error::UNTERMINATED_COMMENT);
         }
-    }
 
-    return TokenStream(tokens);
-}
+        return Comment(rest, false);
+    }
 
-boost::multiprecision::uint256_t IntLiteral::value() const
-{
-    boost::multiprecision::uint256_t value = 0;
-    for (int i = 0; i < lit.length(); ++i) {
-        UChar ch = lit.charAt(i);
-        auto digit = u_digit(ch, radix);
-        if (digit < 0) continue;
+    auto text = rest.substr(0, text_end);
 
-        value *= radix;
-        value += digit;
-    }
+    // Skip the terminator of a block comment, the newline
+    // ending a line comment is left as whitespace
+    cursor.advance_bytes(text_end + (multiline ? 2 : 0));
 
-    return value;
+    return Comment(text, multiline);
 }
 
-std::ostream &Identifier::operator<<(std::ostream &os) const
+// Skips whitespace, returns false at the end of the input
+static bool skip_whitespace(Cursor &cursor)
 {
-    os << "Identifier(ident: "
-        << this->ident
-        << ")";
-    return os;
+    while (true) {
+        auto ch = cursor.peek_byte();
+        if (ch == Cursor::END)
+            return false;
+
+        auto char_class = char_classes[ch];
+        if (char_class == CharClass::SPACE) {
+            cursor.advance_bytes(1);
+        } else if (char_class == CharClass::NON_ASCII && is_space(cursor.peek())) {
+            cursor.next();
+        } else {
+            return true;
+        }
+    }
 }
 
-std::ostream &IntLiteral::operator<<(std::ostream &os) const
+// Skips whitespace like skip_whitespace, returns the line breaks in it
+static size_t skip_whitespace_lines(Cursor &cursor)
 {
-    os << "IntLiteral(lit: "
-        << this->lit
-        << ", value: "
-        << this->value()
-        << ", radix: "
-        << static_cast<unsigned int>(this->radix)
-        << ")";
-    return os;
+    size_t lines = 0;
+    while (true) {
+        auto ch = cursor.peek_byte();
+        if (ch == Cursor::END)
+            return lines;
+
+        auto char_class = char_classes[ch];
+        if (char_class == CharClass::SPACE) {
+            lines += ch == U'\n';
+            cursor.advance_bytes(1);
+        } else if (char_class == CharClass::NON_ASCII && is_space(cursor.peek())) {
+            cursor.next();
+        } else {
+            return lines;
+        }
+    }
 }
 
-std::ostream &FloatLiteral::operator<<(std::ostream &os) const
+// Start of the spaces and tabs before offset on its line
+static size_t indent_start(std::string_view source, size_t offset)
 {
-    os << "FloatLiteral(mantissa: "
-        << this->mantissa
-        << ", exponent: "
-        << this->exponent
-        << ", radix: "
-        << static_cast<unsigned int>(this->radix)
-        << ", negative_exponent: "
-        << (this->negative ? "true" : "false")
-        << ")";
-    return os;
+    while (offset > 0 && (source[offset - 1] == ' ' || source[offset - 1] == '\t')) {
+        --offset;
+    }
+
+    return offset;
 }
 
-std::ostream &ImaginaryLiteral::operator<<(std::ostream &os) const
+static bool at_line_start(std::string_view source, size_t offset)
 {
-    os << "ImaginaryLiteral(inner: ";
-    std::visit([&](auto &arg) { os << arg; }, this->inner);
-    os << ")";
-    return os;
+    auto indent = indent_start(source, offset);
+    return indent == 0 || source[indent - 1] == '\n';
 }
 
-std::ostream &Keyword::operator<<(std::ostream &os) const
+// Text of a comment without its markers
+static std::string_view comment_body(std::string_view text)
 {
-    // This doesn't need to be fast, just needs to work
-    bool found_keyword = false;
-    for (auto &keyword : keyword_map) {
-        if (this->kind == keyword.second) {
-            os << "Keyword(kind: " << keyword.first << ")";
-            found_keyword = true;
-        }
+    auto body = text.substr(2);
+    if (text[1] == '*') {
+        body.remove_suffix(2);
     }
 
-    assert(found_keyword && "Invalid keyword");
-    return os;
+    return body;
 }
 
-std::ostream &Punctuation::operator<<(std::ostream &os) const
+std::optional<Directive> Directive::find(std::string_view source, uint32_t offset, uint32_t length)
 {
-    static const std::string punctuation_map[] = {
-        "+", "-", "*", "/", "%", "&", "|", "^",
-        "<<", ">>", "&^", "+=", "-=", "*=", "/=",
-        "%=", "&=", "|=", "^=", "<<=", ">>=",
-        "&^=", "&&", "||", "<-", "++", "--",
-        "==", "<", ">", "=", "!", "~", "!=",
-        "<=", ">=", ":=", "...", "(", ")", "[",
-        "]", "{", "}", ",", ";", ".", ":",
-    };
+    auto text = source.substr(offset, length);
 
-    os << "Punctuation(kind: ";
-    os << punctuation_map[this->kind];
-    os << ")";
-    return os;
-}
+    if (text.starts_with("/*line ")) {
+        return Directive{LINE, offset, length};
+    }
+
+    if (text.starts_with("//go:") || text.starts_with("//line ")) {
+        if (!at_line_start(source, offset))
+            return std::nullopt;
+
+        return Directive{text[2] == 'g' ? GO : LINE, offset, length};
+    }
+
+    return std::nullopt;
+}
+
+std::string_view Directive::name(std::string_view source) const
+{
+    if (kind == LINE) {
+        return "line";
+    }
+
+    auto body = comment_body(source.substr(offset, length)).substr(3);
+    return body.substr(0, body.find_first_of(" \t\r"));
+}
+
+std::string_view Directive::arguments(std::string_view source) const
+{
+    auto body = comment_body(source.substr(offset, length));
+    auto rest = body.substr(kind == LINE ? 4 : 3 + name(source).size());
+
+    auto first = rest.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+        return std::string_view();
+    }
+
+    auto last = rest.find_last_not_of(" \t\r");
+    return rest.substr(first, last - first + 1);
+}
+
+bool Lexer::keep_comment(size_t offset, size_t length)
+{
+    if (comments != CommentMode::DOC) {
+        return comments == CommentMode::ALL;
+    }
+
+    // Read ahead through the run to the token after it, which the
+    // comments document if it is on the very next line
+    if (offset >= doc_run_end) {
+        Cursor ahead(source);
+        ahead.seek(offset + length);
+
+        bool documents = false;
+        while (true) {
+            auto lines = skip_whitespace_lines(ahead);
+            if (lines > 1 || ahead.at_end())
+                break;
+
+            auto next = ahead.peek_byte(1);
+            if (ahead.peek_byte() == U'/' && (next == U'/' || next == U'*')) {
+                auto comment = consume_comment(ahead);
+                if (comment && std::holds_alternative<Comment>(*comment))
+                    continue;
+
+                break;
+            }
+
+            documents = lines == 1;
+            break;
+        }
+
+        doc_run_end = ahead.offset();
+        doc_run_documents = documents;
+    }
+
+    // Comments after code on the same line are about that code
+    auto indent = indent_start(source, offset);
+    bool own_line = indent == 0 || source[indent - 1] == '\n'
+        || (indent >= 2 && source.substr(indent - 2, 2) == "*/");
+
+    return doc_run_documents && own_line;
+}
+
+static_assert(std::tuple_size_v<decltype(stats::Counters::tokens)> == std::variant_size_v<TokenVariant>);
+
+template<stats::Consumer consumer, typename Consume>
+static auto counted(Consume consume, Cursor &cursor)
+{
+    auto token = consume(cursor);
+    stats::count_call(consumer, token.has_value());
+    return token;
+}
+
+// Lexes the token at the cursor, picking the consume_* function from
+// the first byte alone. Returns nullopt if no token starts there.
+static std::optional<TokenVariant> dispatch_token(Cursor &cursor)
+{
+    auto ch = cursor.peek_byte();
+
+    switch (char_classes[ch]) {
+    case CharClass::LETTER:
+        return counted<stats::Consumer::IDENTIFIER>(consume_identifier, cursor);
+    case CharClass::DIGIT:
+        return counted<stats::Consumer::NUMBER>(consume_numeric_literal, cursor);
+    case CharClass::DOT:
+        if (digit_value(cursor.peek_byte(1), 10) >= 0) {
+            return counted<stats::Consumer::NUMBER>(consume_numeric_literal, cursor);
+        }
+
+        return counted<stats::Consumer::PUNCTUATION>(consume_punctuation, cursor);
+    case CharClass::SLASH:
+        if (auto next = cursor.peek_byte(1); next == U'/' || next == U'*') {
+            return counted<stats::Consumer::COMMENT>(consume_comment, cursor);
+        }
+
+        return counted<stats::Consumer::PUNCTUATION>(consume_punctuation, cursor);
+    case CharClass::PUNCTUATION:
+        return counted<stats::Consumer::PUNCTUATION>(consume_punctuation, cursor);
+    case CharClass::QUOTE:
+        return counted<stats::Consumer::STRING>(consume_string_literal, cursor);
+    case CharClass::BACKTICK:
+        return counted<stats::Consumer::RAW_STRING>(consume_raw_string_literal, cursor);
+    case CharClass::APOSTROPHE:
+        return counted<stats::Consumer::RUNE>(consume_rune_literal, cursor);
+    case CharClass::NON_ASCII:
+        if (is_letter(cursor.peek())) {
+            return counted<stats::Consumer::IDENTIFIER>(consume_identifier, cursor);
+        }
+
+        return std::nullopt;
+    case CharClass::SPACE:
+    case CharClass::OTHER:
+        return std::nullopt;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<LexedToken> Lexer::lex()
+{
+    [[maybe_unused]] auto lex_start = cursor.offset();
+    while (skip_whitespace(cursor)) {
+        auto start = cursor.offset();
+        auto token = dispatch_token(cursor);
+
+        // Nothing accepts this character, it becomes an error of its own
+        // so that every token moves the cursor on
+        if (!token || cursor.offset() == start) {
+            cursor.seek(start);
+            cursor.next();
+            token = Error(cursor.since(start), Error::UNEXPECTED_CHARACTER);
+        }
+
+        auto length = cursor.offset() - start;
+        if (std::holds_alternative<Comment>(*token)) {
+            if (auto directive = Directive::find(source, start, length)) {
+                found_directives.push_back(*directive);
+            }
+
+            if (!keep_comment(start, length))
+                continue;
+        }
+
+        stats::count_token(token->index(), cursor.offset() - lex_start);
+        return LexedToken {
+            .token = std::move(*token),
+            .offset = static_cast<uint32_t>(start),
+            .length = static_cast<uint32_t>(length),
+        };
+    }
+
+    stats::count_bytes(cursor.offset() - lex_start);
+
+    return std::nullopt;
+}
+
+std::optional<LexedToken> Lexer::next()
+{
+    if (lookahead) {
+        auto token = std::move(lookahead);
+        lookahead.reset();
+        return token;
+    }
+
+    return lex();
+}
+
+const std::optional<LexedToken> &Lexer::peek()
+{
+    if (!lookahead) {
+        lookahead = lex();
+    }
+
+    return lookahead;
+}
+
+TokenStream consume_tokens(std::string_view source, CommentMode comments)
+{
+    stats::ScopedPhase phase(stats::Phase::LEX);
+    Lexer lexer(source, 0, comments);
+    TokenStream tokens(source, comments);
+
+    // Go averages a token every five or six bytes of source
+    tokens.reserve(source.size() / 6);
+
+    for (const auto &lexed : lexer) {
+        tokens.push(lexed.token, lexed.offset, lexed.length);
+    }
+
+    for (const auto &directive : lexer.directives()) {
+        tokens.add_directive(directive);
+    }
+
+    return tokens;
+}
+
+std::optional<FileHeader> scan_header(std::string_view source, bool complete)
+{
+    enum class State {
+        PACKAGE,
+        NAME,
+        DECLARATIONS,
+        IMPORT,
+        SPECS,
+    };
+
+    Lexer lexer(source, 0, CommentMode::DROP);
+    FileHeader header;
+    auto state = State::PACKAGE;
+    size_t leading = 0;
+
+    while (true) {
+        auto lexed = lexer.next();
+
+        // A token running up to the end of a prefix may go on past it
+        if (!lexed || (!complete && lexed->offset + lexed->length >= source.size())) {
+            if (!complete)
+                return std::nullopt;
+
+            header.end = source.size();
+            break;
+        }
+
+        header.tokens += 1;
+        const auto &token = lexed->token;
+        auto keyword = std::get_if<Keyword>(&token);
+        auto punctuation = std::get_if<Punctuation>(&token);
+
+        if (state == State::PACKAGE) {
+            leading = lexer.directives().size();
+            if (keyword && keyword->kind == Keyword::PACKAGE) {
+                state = State::NAME;
+                continue;
+            }
+        } else if (state == State::NAME) {
+            state = State::DECLARATIONS;
+            if (auto name = std::get_if<Identifier>(&token)) {
+                header.package = name->ident;
+                continue;
+            }
+        }
+
+        if (state == State::DECLARATIONS) {
+            if (keyword && keyword->kind == Keyword::IMPORT) {
+                state = State::IMPORT;
+                continue;
+            }
+
+            if (punctuation && punctuation->kind == Punctuation::SEMICOLON)
+                continue;
+        } else if (state == State::IMPORT || state == State::SPECS) {
+            if (auto path = std::get_if<StringLiteral>(&token)) {
+                header.imports.emplace_back(path->value());
+                if (state == State::IMPORT) {
+                    state = State::DECLARATIONS;
+                }
+                continue;
+            }
+
+            if (punctuation && punctuation->kind == Punctuation::LPAREN && state == State::IMPORT) {
+                state = State::SPECS;
+                continue;
+            }
+
+            if (punctuation && punctuation->kind == Punctuation::RPAREN && state == State::SPECS) {
+                state = State::DECLARATIONS;
+                continue;
+            }
+
+            // Names and separators between the paths, a keyword means
+            // the imports broke off
+            if (!keyword)
+                continue;
+        }
+
+        header.end = lexed->offset;
+        break;
+    }
+
+    auto directives = lexer.directives();
+    if (state != State::PACKAGE) {
+        directives = directives.first(leading);
+    }
+    header.directives.assign(directives.begin(), directives.end());
+
+    return header;
+}
+
+std::optional<FileHeader> read_header(const std::string &path, std::string &text)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return std::nullopt;
+
+    // Imports nearly always end within the first few kilobytes, a long
+    // doc comment before them takes a couple more reads
+    text.clear();
+    size_t wanted = 4 * 1024;
+    std::optional<FileHeader> header;
+
+    while (!header) {
+        auto start = text.size();
+        text.resize(wanted);
+
+        bool at_end = false;
+        while (start < wanted) {
+            auto n = read(fd, text.data() + start, wanted - start);
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            if (n < 0) {
+                close(fd);
+                return std::nullopt;
+            }
+
+            if (n == 0) {
+                at_end = true;
+                break;
+            }
+
+            start += static_cast<size_t>(n);
+        }
+
+        text.resize(start);
+        header = scan_header(text, at_end);
+        wanted *= 4;
+    }
+
+    close(fd);
+    return header;
+}
+
+// Adds the directives found before end, past it they belong with the
+// tokens from end on, which may come from another lexer
+static void add_directives(TokenStream &tokens, const Lexer &lexer, size_t end)
+{
+    for (const auto &directive : lexer.directives()) {
+        if (directive.offset < end) {
+            tokens.add_directive(directive);
+        }
+    }
+}
+
+// Speculatively lexed piece of a source buffer: the tokens starting in
+// [start, stop), lexed as if start were between two tokens
+struct Chunk {
+    size_t start;
+    size_t stop;
+    TokenStream tokens;
+    // Start of the first token at or past stop
+    size_t handoff;
+};
+
+static void lex_chunk(std::string_view source, Chunk &chunk)
+{
+    stats::ScopedPhase phase(stats::Phase::LEX);
+    Lexer lexer(source, chunk.start, chunk.tokens.comment_mode());
+    chunk.tokens.reserve((chunk.stop - chunk.start) / 6);
+
+    while (const auto &lexed = lexer.peek()) {
+        if (lexed->offset >= chunk.stop)
+            break;
+
+        chunk.tokens.push(lexed->token, lexed->offset, lexed->length);
+        lexer.next();
+    }
+
+    chunk.handoff = lexer.offset();
+    add_directives(chunk.tokens, lexer, chunk.handoff);
+}
+
+TokenStream consume_tokens_parallel(
+        std::string_view source,
+        support::ThreadPool &pool,
+        size_t chunk_size,
+        CommentMode comments
+)
+{
+    if (chunk_size == 0 || source.size() <= chunk_size) {
+        return consume_tokens(source, comments);
+    }
+
+    // Chunks end after the first newline past each chunk_size bytes,
+    // tokens rarely span lines so most guesses will be right
+    std::vector<Chunk> chunks;
+    for (size_t start = 0; start < source.size(); ) {
+        size_t stop = source.size();
+        if (source.size() - start > chunk_size) {
+            auto newline = source.find('\n', start + chunk_size);
+            if (newline != std::string_view::npos) {
+                stop = newline + 1;
+            }
+        }
+
+        chunks.push_back(Chunk{start, stop, TokenStream(source, comments), 0});
+        start = stop;
+    }
+
+    {
+        support::TaskGroup group(pool);
+        for (auto &chunk : chunks) {
+            group.run([&] { lex_chunk(source, chunk); });
+        }
+    }
+
+    stats::ScopedPhase phase(stats::Phase::STITCH);
+    TokenStream tokens(source, comments);
+    tokens.reserve(source.size() / 6);
+
+    // Where the next token of the sequential lexing really starts. The
+    // lexer carries no state between tokens, so once a chunk has a token
+    // starting there, it and everything after it in the chunk is right.
+    size_t expected = 0;
+
+    for (const auto &chunk : chunks) {
+        // A token from an earlier chunk runs past all of this one
+        if (expected >= chunk.stop)
+            continue;
+
+        auto offsets = chunk.tokens.offsets();
+        size_t speculative = std::lower_bound(offsets.begin(), offsets.end(), expected) - offsets.begin();
+        bool synced = false;
+
+        // Lex from the real boundary until a token lines up with the guess,
+        // which for a chunk that was guessed right is the very first one
+        Lexer lexer(source, expected, comments);
+        while (const auto &lexed = lexer.peek()) {
+            if (lexed->offset >= chunk.stop)
+                break;
+
+            while (speculative < offsets.size() && offsets[speculative] < lexed->offset) {
+                ++speculative;
+            }
+
+            if (speculative < offsets.size() && offsets[speculative] == lexed->offset) {
+                synced = true;
+                break;
+            }
+
+            tokens.push(lexed->token, lexed->offset, lexed->length);
+            lexer.next();
+        }
+
+        // Directives before the first token that lined up are the ones
+        // found lexing from the real boundary
+        add_directives(tokens, lexer, lexer.offset());
+
+        if (synced) {
+            tokens.append(chunk.tokens, speculative, offsets.size());
+            tokens.append_directives(chunk.tokens, offsets[speculative], source.size());
+            expected = chunk.handoff;
+        } else {
+            expected = lexer.offset();
+        }
+    }
+
+    return tokens;
+}
+
+// Furthest the lexer looks past the end of a token to decide where it
+// ends: a UTF-8 sequence after an identifier, or the ".." before a
+// character that isn't a third '.'. Errors look no further than a
+// token would, a literal that isn't closed on its line stops before
+// the newline, and a raw string or comment that is never closed runs
+// to the end of the input.
+static constexpr size_t MAX_LOOKAHEAD = 4;
+
+TokenStream relex(const TokenStream &previous, std::string_view source, const Edit &edit)
+{
+    stats::ScopedPhase phase(stats::Phase::RELEX);
+    if (previous.comment_mode() != CommentMode::ALL) {
+        return consume_tokens(source, previous.comment_mode());
+    }
+
+    auto offsets = previous.offsets();
+    auto lengths = previous.lengths();
+    auto edit_end = edit.offset + edit.removed;
+    auto delta = static_cast<int64_t>(edit.inserted.size()) - static_cast<int64_t>(edit.removed);
+
+    // Only tokens can span lines, so the old stream is only known to be
+    // unaffected up to the line of the edit, and the tokens before
+    // restart never looked at it
+    auto line_start = source.substr(0, edit.offset).rfind('\n');
+    line_start = line_start == std::string_view::npos ? 0 : line_start + 1;
+
+    size_t restart = 0;
+    {
+        size_t low = 0, high = previous.size();
+        while (low < high) {
+            auto mid = low + (high - low) / 2;
+            if (offsets[mid] + lengths[mid] + MAX_LOOKAHEAD <= line_start) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        restart = low;
+    }
+
+    // The line might start in whitespace before the restart token
+    size_t start = line_start;
+    if (restart < previous.size()) {
+        start = std::min<size_t>(start, offsets[restart]);
+    }
+
+    // First old token entirely after the edit, the candidates to line up with
+    auto next_old = static_cast<size_t>(
+            std::lower_bound(offsets.begin(), offsets.end(), edit_end) - offsets.begin());
+
+    TokenStream tokens(source);
+    tokens.reserve(previous.size());
+    tokens.append(previous, 0, restart);
+    tokens.append_directives(previous, 0, start);
+
+    Lexer lexer(source, start);
+    while (auto lexed = lexer.next()) {
+        while (next_old < previous.size() && offsets[next_old] + delta < lexed->offset) {
+            ++next_old;
+        }
+
+        // Lexing from the same text gives the same tokens from here on
+        if (next_old < previous.size() && offsets[next_old] + delta == lexed->offset) {
+            add_directives(tokens, lexer, lexed->offset);
+            tokens.append(previous, next_old, previous.size(), delta);
+
+            // Whether a comment is a directive depends on what is before
+            // it on its line, which the edit may have changed
+            auto line_end = source.find('\n', lexed->offset);
+            auto kinds = previous.kinds();
+            auto old = next_old;
+            for (; old < previous.size() && static_cast<size_t>(offsets[old] + delta) < line_end; ++old) {
+                if (kinds[old] != TokenKind::COMMENT)
+                    continue;
+
+                if (auto directive = Directive::find(source, offsets[old] + delta, lengths[old])) {
+                    tokens.add_directive(*directive);
+                }
+            }
+
+            if (old < previous.size()) {
+                tokens.append_directives(previous, offsets[old], std::numeric_limits<size_t>::max(), delta);
+            }
+
+            return tokens;
+        }
+
+        tokens.push(lexed->token, lexed->offset, lexed->length);
+    }
+
+    for (const auto &directive : lexer.directives()) {
+        tokens.add_directive(directive);
+    }
+
+    return tokens;
+}
+
+void TokenStream::reserve(size_t tokens)
+{
+    kind_column.reserve(tokens);
+    offset_column.reserve(tokens);
+    length_column.reserve(tokens);
+    payload_column.reserve(tokens);
+}
+
+// Int literal payloads keep the radix in the low two bits and how the
+// value is stored in the next two, leaving 28 bits for a small value or
+// the index of a larger one in int_values
+enum IntStorage : uint32_t {
+    INT_INLINE,
+    INT_TABLE,
+    INT_UNCACHED,
+};
+
+static constexpr uint8_t int_radixes[] = {2, 8, 10, 16};
+static constexpr uint32_t INT_VALUE_SHIFT = 4;
+
+// Payload of a string literal whose value is its text
+static constexpr uint32_t STRING_UNDECODED = UINT32_MAX;
+static constexpr uint64_t INT_INLINE_LIMIT = uint64_t(1) << (32 - INT_VALUE_SHIFT);
+
+uint32_t TokenStream::int_payload(const IntLiteral &lit)
+{
+    uint32_t radix = std::find(std::begin(int_radixes), std::end(int_radixes), lit.radix) - std::begin(int_radixes);
+
+    if (!lit.cached) {
+        return radix | INT_UNCACHED << 2;
+    }
+
+    if (*lit.cached < INT_INLINE_LIMIT) {
+        return radix | INT_INLINE << 2 | static_cast<uint32_t>(*lit.cached) << INT_VALUE_SHIFT;
+    }
+
+    int_values.push_back(*lit.cached);
+    return radix | INT_TABLE << 2 | static_cast<uint32_t>(int_values.size() - 1) << INT_VALUE_SHIFT;
+}
+
+IntLiteral TokenStream::int_from_payload(uint32_t payload, uint32_t offset, uint32_t length) const
+{
+    IntLiteral lit(source.substr(offset, length), int_radixes[payload & 3]);
+
+    auto value = payload >> INT_VALUE_SHIFT;
+    switch ((payload >> 2) & 3) {
+    case INT_INLINE:
+        lit.cached = value;
+        break;
+    case INT_TABLE:
+        lit.cached = int_values[value];
+        break;
+    }
+
+    return lit;
+}
+
+TokenStream::NumberLayout TokenStream::layout_of(const IntLiteral &lit, uint32_t) const
+{
+    return NumberLayout {
+        .value = 0,
+        .mantissa_length = static_cast<uint32_t>(lit.lit.size()),
+        .exponent_start = 0,
+        .exponent_length = 0,
+        .exponent_char = 0,
+        .radix = lit.radix,
+        .negative = false,
+        .is_float = false,
+    };
+}
+
+TokenStream::NumberLayout TokenStream::layout_of(const FloatLiteral &lit, uint32_t offset) const
+{
+    const char *base = source.data() + offset;
+    assert(lit.mantissa.data() == base);
+
+    uint32_t exponent_start = 0;
+    if (!lit.exponent.empty()) {
+        exponent_start = static_cast<uint32_t>(lit.exponent.data() - base);
+    }
+
+    return NumberLayout {
+        .value = lit.value(),
+        .mantissa_length = static_cast<uint32_t>(lit.mantissa.size()),
+        .exponent_start = exponent_start,
+        .exponent_length = static_cast<uint32_t>(lit.exponent.size()),
+        .exponent_char = lit.exponent_char.value_or(0),
+        .radix = lit.radix,
+        .negative = lit.negative,
+        .is_float = true,
+    };
+}
+
+FloatLiteral TokenStream::float_from_layout(const NumberLayout &layout, uint32_t offset) const
+{
+    FloatLiteral lit(
+            source.substr(offset, layout.mantissa_length),
+            source.substr(offset + layout.exponent_start, layout.exponent_length),
+            layout.radix
+            );
+
+    if (layout.exponent_char) {
+        lit.exponent_char = layout.exponent_char;
+    }
+
+    lit.negative = layout.negative;
+    lit.cached = layout.value;
+    return lit;
+}
+
+void TokenStream::push(const TokenVariant &token, uint32_t offset, uint32_t length)
+{
+    uint32_t payload = 0;
+
+    std::visit([&](const auto &tok) {
+        using T = std::decay_t<decltype(tok)>;
+
+        if constexpr (std::is_same_v<T, Keyword> || std::is_same_v<T, Punctuation>) {
+            payload = tok.kind;
+        } else if constexpr (std::is_same_v<T, Identifier>) {
+            payload = tok.symbol;
+        } else if constexpr (std::is_same_v<T, IntLiteral>) {
+            payload = int_payload(tok);
+        } else if constexpr (std::is_same_v<T, FloatLiteral>) {
+            payload = static_cast<uint32_t>(numbers.size());
+            numbers.push_back(layout_of(tok, offset));
+        } else if constexpr (std::is_same_v<T, ImaginaryLiteral>) {
+            payload = static_cast<uint32_t>(numbers.size());
+            numbers.push_back(std::visit([&](const auto &inner) {
+                return layout_of(inner, offset);
+            }, tok.inner));
+        } else if constexpr (std::is_same_v<T, RuneLiteral>) {
+            // Runes fit in 21 bits, the kind goes in the top byte
+            payload = (static_cast<uint32_t>(tok.rune) & 0xFFFFFF) | (tok.kind << 24);
+        } else if constexpr (std::is_same_v<T, StringLiteral>) {
+            payload = STRING_UNDECODED;
+            if (tok.decoded) {
+                payload = static_cast<uint32_t>(strings.size());
+                auto begin = static_cast<uint32_t>(string_bytes.size());
+                string_bytes.append(*tok.decoded);
+                strings.push_back({begin, static_cast<uint32_t>(string_bytes.size())});
+            }
+        } else if constexpr (std::is_same_v<T, Comment>) {
+            payload = tok.multiline;
+        } else if constexpr (std::is_same_v<T, Error>) {
+            payload = tok.reason;
+        }
+    }, token);
+
+    kind_column.push_back(static_cast<TokenKind>(token.index()));
+    offset_column.push_back(offset);
+    length_column.push_back(length);
+    payload_column.push_back(payload);
+}
+
+void TokenStream::append(const TokenStream &other, size_t first, size_t last, int64_t offset_delta)
+{
+    for (size_t i = first; i < last; ++i) {
+        auto kind = other.kind_column[i];
+        auto payload = other.payload_column[i];
+
+        // Side table entries are relative to the token, so they can be
+        // copied as they are, only the index into the table changes
+        if (kind == TokenKind::INT_LITERAL && ((payload >> 2) & 3) == INT_TABLE) {
+            int_values.push_back(other.int_values[payload >> INT_VALUE_SHIFT]);
+            payload = (payload & ((1 << INT_VALUE_SHIFT) - 1))
+                | static_cast<uint32_t>(int_values.size() - 1) << INT_VALUE_SHIFT;
+        } else if (kind == TokenKind::FLOAT_LITERAL || kind == TokenKind::IMAGINARY_LITERAL) {
+            numbers.push_back(other.numbers[payload]);
+            payload = static_cast<uint32_t>(numbers.size() - 1);
+        } else if (kind == TokenKind::STRING_LITERAL && payload != STRING_UNDECODED) {
+            const auto &range = other.strings[payload];
+            auto begin = static_cast<uint32_t>(string_bytes.size());
+            string_bytes.append(other.string_bytes, range.begin, range.end - range.begin);
+            payload = static_cast<uint32_t>(strings.size());
+            strings.push_back({begin, static_cast<uint32_t>(string_bytes.size())});
+        }
+
+        kind_column.push_back(kind);
+        offset_column.push_back(static_cast<uint32_t>(other.offset_column[i] + offset_delta));
+        length_column.push_back(other.length_column[i]);
+        payload_column.push_back(payload);
+    }
+}
+
+void TokenStream::append_directives(const TokenStream &other, size_t begin, size_t end, int64_t offset_delta)
+{
+    for (const auto &directive : other.directive_table) {
+        if (directive.offset < begin || directive.offset >= end)
+            continue;
+
+        auto moved = directive;
+        moved.offset = static_cast<uint32_t>(directive.offset + offset_delta);
+        directive_table.push_back(moved);
+    }
+}
+
+TokenVariant TokenStream::operator[](size_t index) const
+{
+    auto offset = offset_column[index];
+    auto payload = payload_column[index];
+
+    switch (kind_column[index]) {
+    case TokenKind::KEYWORD:
+        return Keyword(static_cast<Keyword::Kind>(payload));
+    case TokenKind::IDENTIFIER:
+        return Identifier(text(index), payload);
+    case TokenKind::INT_LITERAL:
+        return int_from_payload(payload, offset, length_column[index]);
+    case TokenKind::FLOAT_LITERAL:
+        return float_from_layout(numbers[payload], offset);
+    case TokenKind::IMAGINARY_LITERAL: {
+        const auto &layout = numbers[payload];
+        if (layout.is_float) {
+            return ImaginaryLiteral(float_from_layout(layout, offset));
+        }
+
+        return ImaginaryLiteral(IntLiteral(source.substr(offset, layout.mantissa_length), layout.radix));
+    }
+    case TokenKind::PUNCTUATION:
+        return Punctuation(static_cast<Punctuation::Kind>(payload));
+    case TokenKind::RUNE_LITERAL:
+        return RuneLiteral(payload & 0xFFFFFF, static_cast<RuneLiteral::Kind>(payload >> 24));
+    case TokenKind::STRING_LITERAL: {
+        auto text = this->text(index);
+        StringLiteral lit(text.substr(1, text.size() - 2), text[0] == '`');
+        if (payload != STRING_UNDECODED) {
+            lit.decoded = std::string(string_value(index));
+        }
+
+        return lit;
+    }
+    case TokenKind::COMMENT: {
+        bool multiline = payload;
+        auto comment = text(index).substr(2);
+        if (multiline) {
+            comment.remove_suffix(2);
+        }
+
+        return Comment(comment, multiline);
+    }
+    case TokenKind::ERROR:
+        return Error(text(index), static_cast<Error::Reason>(payload));
+    }
+
+    assert(false && "Invalid token kind");
+    return Keyword(Keyword::Kind::BREAK);
+}
+
+std::string_view TokenStream::string_value(size_t index) const
+{
+    assert(kind_column[index] == TokenKind::STRING_LITERAL && "Not a string literal");
+
+    auto payload = payload_column[index];
+    if (payload == STRING_UNDECODED) {
+        auto text = this->text(index);
+        return text.substr(1, text.size() - 2);
+    }
+
+    const auto &range = strings[payload];
+    return std::string_view(string_bytes).substr(range.begin, range.end - range.begin);
+}
+
+bool TokenStream::ends_statement(size_t index) const
+{
+    auto payload = payload_column[index];
+
+    switch (kind_column[index]) {
+    case TokenKind::IDENTIFIER:
+    case TokenKind::INT_LITERAL:
+    case TokenKind::FLOAT_LITERAL:
+    case TokenKind::IMAGINARY_LITERAL:
+    case TokenKind::RUNE_LITERAL:
+    case TokenKind::STRING_LITERAL:
+        return true;
+    case TokenKind::KEYWORD:
+        return payload == Keyword::BREAK || payload == Keyword::CONTINUE
+            || payload == Keyword::FALLTHROUGH || payload == Keyword::RETURN;
+    case TokenKind::PUNCTUATION:
+        return payload == Punctuation::INCREMENT || payload == Punctuation::DECREMENT
+            || payload == Punctuation::RPAREN || payload == Punctuation::RBRACKET
+            || payload == Punctuation::RBRACE;
+    default:
+        return false;
+    }
+}
+
+bool TokenStream::semicolon_between(size_t index, size_t next) const
+{
+    if (!ends_statement(index))
+        return false;
+
+    if (next == size())
+        return true;
+
+    auto gap_start = offset_column[index] + length_column[index];
+    return std::memchr(source.data() + gap_start, '\n', offset_column[next] - gap_start) != nullptr;
+}
+
+size_t TokenStream::storage_bytes() const
+{
+    return kind_column.capacity() * sizeof(TokenKind)
+        + offset_column.capacity() * sizeof(uint32_t)
+        + length_column.capacity() * sizeof(uint32_t)
+        + payload_column.capacity() * sizeof(uint32_t)
+        + numbers.capacity() * sizeof(NumberLayout)
+        + int_values.capacity() * sizeof(uint64_t)
+        + strings.capacity() * sizeof(StringRange)
+        + string_bytes.capacity()
+        + directive_table.capacity() * sizeof(Directive);
+}
+
+boost::multiprecision::uint256_t IntLiteral::value() const
+{
+    if (cached) {
+        return *cached;
+    }
+
+    if (auto small = int_literal_value(lit, radix)) {
+        return *small;
+    }
+
+    boost::multiprecision::uint256_t value = 0;
+    for (auto ch : lit) {
+        auto digit = digit_value(ch, radix);
+        if (digit < 0) continue;
+
+        value *= radix;
+        value += digit;
+    }
+
+    return value;
+}
+
+std::ostream &Identifier::operator<<(std::ostream &os) const
+{
+    os << "Identifier(ident: "
+        << this->ident
+        << ")";
+    return os;
+}
+
+std::ostream &IntLiteral::operator<<(std::ostream &os) const
+{
+    os << "IntLiteral(lit: " << this->lit << ", value: ";
+
+    // Only values past 64 bits need formatting as a bignum
+    if (cached) {
+        os << *cached;
+    } else {
+        os << this->value();
+    }
+
+    os << ", radix: "
+        << static_cast<unsigned int>(this->radix)
+        << ")";
+    return os;
+}
+
+double FloatLiteral::value() const
+{
+    if (cached) {
+        return *cached;
+    }
+
+    return float_literal_value(mantissa, exponent, negative, radix);
+}
+
+std::ostream &FloatLiteral::operator<<(std::ostream &os) const
+{
+    // Shortest text that reads back as the same double
+    char value_text[32];
+    auto [value_end, _] = std::to_chars(std::begin(value_text), std::end(value_text), value());
+
+    os << "FloatLiteral(mantissa: "
+        << this->mantissa
+        << ", exponent: "
+        << this->exponent
+        << ", radix: "
+        << static_cast<unsigned int>(this->radix)
+        << ", negative_exponent: "
+        << (this->negative ? "true" : "false")
+        << ", value: "
+        << std::string_view(value_text, value_end - value_text)
+        << ")";
+    return os;
+}
+
+std::ostream &ImaginaryLiteral::operator<<(std::ostream &os) const
+{
+    os << "ImaginaryLiteral(inner: ";
+    std::visit([&](auto &arg) { os << arg; }, this->inner);
+    os << ")";
+    return os;
+}
+
+std::optional<Keyword::Kind> Keyword::classify(std::string_view ident)
+{
+    if (ident.size() < keyword_lengths.first || ident.size() > keyword_lengths.second)
+        return std::nullopt;
+
+    auto kind = keyword_table[keyword_hash(ident)];
+    if (kind < 0 || keyword_spellings[kind] != ident)
+        return std::nullopt;
+
+    return static_cast<Kind>(kind);
+}
+
+std::string_view Keyword::spelling(Kind kind)
+{
+    assert(kind < count && "Invalid keyword");
+    return keyword_spellings[kind];
+}
+
+std::ostream &Keyword::operator<<(std::ostream &os) const
+{
+    os << "Keyword(kind: " << spelling(this->kind) << ")";
+    return os;
+}
+
+std::string_view Punctuation::spelling(Kind kind)
+{
+    assert(kind < std::size(punctuation_spellings) && "Invalid punctuation");
+    return punctuation_spellings[kind];
+}
+
+std::ostream &Punctuation::operator<<(std::ostream &os) const
+{
+    os << "Punctuation(kind: ";
+    os << spelling(this->kind);
+    os << ")";
+    return os;
+}
+
+// Writes rune as UTF-8 without going through a UnicodeString,
+// anything that isn't a code point is left to ICU
+static void write_rune(std::ostream &os, UChar32 rune)
+{
+    if (rune < 0 || rune > 0x10FFFF || U_IS_SURROGATE(rune)) {
+        os << icu::UnicodeString(rune);
+        return;
+    }
+
+    char buffer[U8_MAX_LENGTH];
+    int32_t length = 0;
+    U8_APPEND_UNSAFE(buffer, length, rune);
+    os.write(buffer, length);
+}
 
 std::ostream &RuneLiteral::operator<<(std::ostream &os) const
 {
@@ -773,15 +2001,15 @@ std::ostream &RuneLiteral::operator<<(std::ostream &os) const
 
     if (kind == NORMAL) {
         os << "NORMAL, rune: '";
-        os << icu::UnicodeString(rune);
+        write_rune(os, rune);
     } else if (kind == ESCAPED_CHAR) {
         os << "ESCAPED_CHAR, rune: '\\";
-        os << icu::UnicodeString(rune);
+        write_rune(os, rune);
     } else if (kind == LITTLE_U || kind == BIG_U) {
         auto u = kind == LITTLE_U ? 'u' : 'U';
         os << "U, rune: '\\";
         os << u;
-        os << std::hex << static_cast<uint16_t>(rune) << std::dec;
+        os << std::hex << rune << std::dec;
     } else if (kind == HEX_BYTE) {
         os << "HEX, rune: '\\x";
         os << std::hex << static_cast<uint16_t>(rune) << std::dec;
@@ -796,28 +2024,34 @@ std::ostream &RuneLiteral::operator<<(std::ostream &os) const
 
 std::ostream &StringLiteral::operator<<(std::ostream &os) const
 {
-    os << "StringLiteral(literal: \"";
-
-    for (const auto &rune : runes) {
-        if (rune.kind == RuneLiteral::Kind::NORMAL) {
-            os << icu::UnicodeString(rune.rune);
-        } else if (rune.kind == RuneLiteral::Kind::ESCAPED_CHAR) {
-            os << icu::UnicodeString(rune.rune);
-        } else if (rune.kind == RuneLiteral::Kind::LITTLE_U || rune.kind == RuneLiteral::Kind::BIG_U) {
-            auto u = rune.kind == RuneLiteral::Kind::LITTLE_U ? 'u' : 'U';
-            os << "\\";
-            os << u;
-            os << std::hex << static_cast<uint16_t>(rune.rune) << std::dec;
-        } else if (rune.kind == RuneLiteral::Kind::HEX_BYTE) {
-            os << "\\x";
-            os << std::hex << static_cast<uint16_t>(rune.rune) << std::dec;
-        } else if (rune.kind == RuneLiteral::Kind::OCTAL_BYTE) {
-            os << "\\";
-            os << std::oct << static_cast<uint16_t>(rune.rune) << std::dec;
+    auto quote = raw ? '`' : '"';
+    os << "StringLiteral(literal: " << quote << text << quote;
+
+    // Bytes that wouldn't show up as themselves are escaped
+    if (decoded) {
+        os << ", value: \"";
+
+        auto data = decoded->data();
+        auto size = static_cast<int32_t>(decoded->size());
+        for (int32_t i = 0; i < size; ) {
+            auto start = i;
+            UChar32 c;
+            U8_NEXT(data, i, size, c);
+
+            if (c < 0x20 || c == 0x7F) {
+                i = start + 1;
+                os << "\\x" << "0123456789abcdef"[(data[start] >> 4) & 0xF] << "0123456789abcdef"[data[start] & 0xF];
+            } else if (c == '"' || c == '\\') {
+                os << '\\' << static_cast<char>(c);
+            } else {
+                os.write(data + start, i - start);
+            }
         }
+
+        os << '"';
     }
 
-    os << "\")";
+    os << ")";
     return os;
 }
 
@@ -832,6 +2066,29 @@ std::ostream &Comment::operator<<(std::ostream &os) const
     return os;
 }
 
+std::string_view Error::describe(Reason reason)
+{
+    static constexpr std::string_view descriptions[] = {
+        "unexpected character",
+        "invalid number",
+        "invalid rune literal",
+        "invalid escape",
+        "unterminated rune literal",
+        "unterminated string literal",
+        "unterminated raw string literal",
+        "unterminated comment",
+    };
+
+    assert(reason < std::size(descriptions) && "Invalid error reason");
+    return descriptions[reason];
+}
+
+std::ostream &Error::operator<<(std::ostream &os) const
+{
+    os << "Error(reason: " << describe(reason) << ", text: " << text << ")";
+    return os;
+}
+
 std::ostream &operator<<(std::ostream &os, const TokenVariant &v)
 {
     std::visit([&](auto &arg) { os << arg; }, v);
@@ -2,20 +2,34 @@
 #define PARSE_TOKENS_H
 
 #include <map>
+#include <algorithm>
 #include <cstdint>
 #include <istream>
+#include <iterator>
 #include <optional>
 #include <concepts>
 #include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
 #include <unicode/unistr.h>
-#include <unicode/ustdio.h>
 #include <unicode/ustream.h>
+#include <unicode/utf8.h>
 #include <boost/multiprecision/cpp_int.hpp>
+#include "interner.h"
 
 namespace goop
 {
 
+namespace support
+{
+
+class ThreadPool;
+
+}
+
 namespace tokens
 {
 
@@ -53,9 +67,14 @@ struct Keyword final : public Token {
         VAR,
     };
 
+    static constexpr uint32_t count = VAR + 1;
+
     Kind kind;
 
     Keyword(Kind kind): kind{kind} {}
+    // Keyword spelled by ident, if it is one
+    static std::optional<Kind> classify(std::string_view ident);
+    static std::string_view spelling(Kind kind);
     std::ostream &operator<<(std::ostream &) const override;
 };
 
@@ -114,37 +133,44 @@ struct Punctuation final : public Token {
     Kind kind;
 
     Punctuation(Kind kind): kind{kind} {}
+    static std::string_view spelling(Kind kind);
     std::ostream &operator<<(std::ostream &) const override;
 };
 
 struct Identifier final : public Token {
-    icu::UnicodeString ident;
-    Identifier(icu::UnicodeString ident): ident{ident} {}
+    std::string_view ident;
+    Symbol symbol;
+
+    Identifier(std::string_view ident, Symbol symbol): ident{ident}, symbol{symbol} {}
     std::ostream &operator<<(std::ostream &) const override;
 };
 
 struct FloatLiteral final : public Token {
-    icu::UnicodeString mantissa;
-    icu::UnicodeString exponent;
+    std::string_view mantissa;
+    std::string_view exponent;
     std::optional<int32_t> exponent_char;
     bool negative;
     uint8_t radix;
+    // Value worked out by the lexer
+    std::optional<double> cached;
 
-    FloatLiteral(icu::UnicodeString mantissa, icu::UnicodeString exponent, uint8_t radix):
+    FloatLiteral(std::string_view mantissa, std::string_view exponent, uint8_t radix):
         mantissa{mantissa}, exponent{exponent}, negative{false}, radix{radix} {}
 
-    //FIXME
-    //boost::multiprecision::uint256_t value() const;
+    // Correctly rounded to the nearest double
+    double value() const;
     std::ostream &operator<<(std::ostream &) const override;
 };
 
 
 struct IntLiteral final : public Token {
-    icu::UnicodeString lit;
+    std::string_view lit;
     uint8_t radix;
+    // Value worked out by the lexer, when it fits in 64 bits
+    std::optional<uint64_t> cached;
 
-    IntLiteral(icu::UnicodeString lit, uint8_t radix):
-        lit{lit}, radix{radix} {}
+    IntLiteral(std::string_view lit, uint8_t radix, std::optional<uint64_t> cached = std::nullopt):
+        lit{lit}, radix{radix}, cached{cached} {}
 
     boost::multiprecision::uint256_t value() const;
     std::ostream &operator<<(std::ostream &) const override;
@@ -169,54 +195,544 @@ struct RuneLiteral final : public Token {
         ESCAPED_CHAR,
     };
 
-    UChar rune;
+    UChar32 rune;
     Kind kind;
 
-    RuneLiteral(UChar rune, Kind kind): rune{rune}, kind{kind} {}
+    RuneLiteral(UChar32 rune, Kind kind): rune{rune}, kind{kind} {}
 
     std::ostream &operator<<(std::ostream &) const override;
 };
 
 struct StringLiteral final : public Token {
-    std::vector<RuneLiteral> runes;
+    // Source text between the quotes
+    std::string_view text;
+    // UTF-8 contents, only when escapes (or carriage returns in a raw
+    // string) make them differ from the text
+    std::optional<std::string> decoded;
+    bool raw;
+
+    StringLiteral(std::string_view text, bool raw): text{text}, raw{raw} {}
+
+    std::string_view value() const {
+        return decoded ? std::string_view(*decoded) : text;
+    }
 
-    StringLiteral() {}
     std::ostream &operator<<(std::ostream &) const override;
 };
 
 struct Comment final : public Token {
-    icu::UnicodeString comment;
+    std::string_view comment;
     bool multiline;
 
-    Comment(icu::UnicodeString comment, bool multiline):
+    Comment(std::string_view comment, bool multiline):
         comment{comment}, multiline{multiline} {}
     std::ostream &operator<<(std::ostream &) const override;
 };
 
+// Which comments the lexer hands out as tokens
+enum class CommentMode : uint8_t {
+    ALL,
+    // Only comments on lines of their own that end on the line before a
+    // token, so that they come right before the token they document
+    DOC,
+    DROP,
+};
+
+// A //go: or //line compiler directive, or a /*line */ one. They are
+// found whichever comments are kept, a dropped comment can still be a
+// directive.
+struct Directive {
+    enum Kind : uint8_t {
+        GO,
+        LINE,
+    };
+
+    Kind kind;
+    // The comment holding the directive
+    uint32_t offset;
+    uint32_t length;
+
+    // The comment at offset in source, if it is a directive. //go: and
+    // //line directives only count at the start of a line.
+    static std::optional<Directive> find(std::string_view source, uint32_t offset, uint32_t length);
+
+    // "build" for //go:build, "line" for line directives
+    std::string_view name(std::string_view source) const;
+    // Everything after the name
+    std::string_view arguments(std::string_view source) const;
+};
+
+// Text the lexer gave up on. It still covers what was read, up to the
+// end of a malformed literal or of the line an unterminated one is on,
+// so lexing goes on past it.
+struct Error final : public Token {
+    enum Reason {
+        // Nothing starts with this character
+        UNEXPECTED_CHARACTER,
+        INVALID_NUMBER,
+        INVALID_RUNE,
+        INVALID_ESCAPE,
+        UNTERMINATED_RUNE,
+        UNTERMINATED_STRING,
+        // These two run to the end of the input
+        UNTERMINATED_RAW_STRING,
+        UNTERMINATED_COMMENT,
+    };
+
+    std::string_view text;
+    Reason reason;
+
+    Error(std::string_view text, Reason reason): text{text}, reason{reason} {}
+    static std::string_view describe(Reason reason);
+    std::ostream &operator<<(std::ostream &) const override;
+};
+
 typedef std::variant<Keyword, Identifier, IntLiteral,
         FloatLiteral, ImaginaryLiteral, Punctuation,
-        RuneLiteral, StringLiteral, Comment> TokenVariant;
+        RuneLiteral, StringLiteral, Comment, Error> TokenVariant;
+
+// Discriminator for the columnar token stream,
+// in the same order as the TokenVariant alternatives
+enum class TokenKind : uint8_t {
+    KEYWORD,
+    IDENTIFIER,
+    INT_LITERAL,
+    FLOAT_LITERAL,
+    IMAGINARY_LITERAL,
+    PUNCTUATION,
+    RUNE_LITERAL,
+    STRING_LITERAL,
+    COMMENT,
+    ERROR,
+};
 
+// Tokens of a single source buffer, stored as parallel arrays of
+// kind, source offset, length and a 32 bit payload.
+// The payload of a keyword, punctuation or identifier is its
+// Keyword::Kind, Punctuation::Kind or Symbol, which parsers can read from
+// payloads() without materializing the token.
+// Token text is never copied, the stream refers back into the source,
+// which has to outlive it. The payload holds the keyword/punctuation kind
+// directly, packs an int literal's radix with its value (or the value's
+// index, once it needs more than 28 bits), and indexes a side table for
+// anything else that needs more (float layouts, decoded string literals).
+// String literals without escapes aren't copied either, their payload
+// marks the value as being the text between the quotes.
 class TokenStream {
-    std::vector<TokenVariant> tokens;
+    // Where the parts of a float (or imaginary) literal sit,
+    // relative to the start of the token
+    struct NumberLayout {
+        double value;
+        uint32_t mantissa_length;
+        uint32_t exponent_start;
+        uint32_t exponent_length;
+        int32_t exponent_char;
+        uint8_t radix;
+        bool negative;
+        bool is_float;
+    };
+
+    // Decoded contents of a string literal within string_bytes
+    struct StringRange {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    std::string_view source;
+    CommentMode comments;
+
+    std::vector<TokenKind> kind_column;
+    std::vector<uint32_t> offset_column;
+    std::vector<uint32_t> length_column;
+    std::vector<uint32_t> payload_column;
+
+    std::vector<NumberLayout> numbers;
+    std::vector<uint64_t> int_values;
+    std::vector<StringRange> strings;
+    std::string string_bytes;
+    std::vector<Directive> directive_table;
+
+    uint32_t int_payload(const IntLiteral &lit);
+    IntLiteral int_from_payload(uint32_t payload, uint32_t offset, uint32_t length) const;
+    NumberLayout layout_of(const IntLiteral &lit, uint32_t offset) const;
+    NumberLayout layout_of(const FloatLiteral &lit, uint32_t offset) const;
+    FloatLiteral float_from_layout(const NumberLayout &layout, uint32_t offset) const;
+
+    public:
+    class iterator {
+        const TokenStream *stream;
+        size_t index;
+
+        public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = TokenVariant;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = TokenVariant;
+
+        iterator(const TokenStream *stream, size_t index):
+            stream{stream}, index{index} {}
+
+        TokenVariant operator*() const {
+            return (*stream)[index];
+        }
+
+        iterator &operator++() {
+            ++index;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            auto prev = *this;
+            ++index;
+            return prev;
+        }
+
+        bool operator==(const iterator &other) const {
+            return index == other.index;
+        }
+    };
+
+    // Non-owning view over a TokenStream, tokens are materialized
+    // as they are iterated
+    class Range {
+        const TokenStream *stream;
+
+        public:
+        Range(const TokenStream *stream): stream{stream} {}
+
+        iterator begin() const {
+            return iterator(stream, 0);
+        }
+
+        iterator end() const {
+            return iterator(stream, stream->size());
+        }
+    };
+
+    TokenStream(std::string_view source, CommentMode comments = CommentMode::ALL):
+        source{source}, comments{comments} {}
+
+    void reserve(size_t tokens);
+    void push(const TokenVariant &token, uint32_t offset, uint32_t length);
+
+    // Copies tokens [first, last) of another stream, moving them by
+    // offset_delta, which has to place them over the same text in this
+    // stream's source
+    void append(const TokenStream &other, size_t first, size_t last, int64_t offset_delta = 0);
+
+    void add_directive(const Directive &directive) {
+        directive_table.push_back(directive);
+    }
+
+    // Copies the directives of another stream with offsets in
+    // [begin, end), moving them by offset_delta like append
+    void append_directives(const TokenStream &other, size_t begin, size_t end, int64_t offset_delta = 0);
+
+    CommentMode comment_mode() const {
+        return comments;
+    }
+
+    // In source order
+    std::span<const Directive> directives() const {
+        return directive_table;
+    }
+
+    size_t size() const {
+        return kind_column.size();
+    }
+
+    TokenVariant operator[](size_t index) const;
+
+    Range all() const {
+        return Range(this);
+    }
+
+    std::span<const TokenKind> kinds() const {
+        return kind_column;
+    }
+
+    std::span<const uint32_t> offsets() const {
+        return offset_column;
+    }
+
+    std::span<const uint32_t> lengths() const {
+        return length_column;
+    }
+
+    std::span<const uint32_t> payloads() const {
+        return payload_column;
+    }
+
+    std::string_view text(size_t index) const {
+        return source.substr(offset_column[index], length_column[index]);
+    }
+
+    std::string_view source_text() const {
+        return source;
+    }
+
+    // Contents of a string literal, without copying them
+    std::string_view string_value(size_t index) const;
+
+    // Whether a line break after the token ends a statement
+    bool ends_statement(size_t index) const;
+
+    // Whether a semicolon is inserted between the token at index and
+    // next, the first token after it that isn't a comment (or size()).
+    // Comments are in the gap, so a line break in one counts as well.
+    bool semicolon_between(size_t index, size_t next) const;
+
+    // Bytes held by the columns and side tables
+    size_t storage_bytes() const;
+};
+
+// Read position within a contiguous UTF-8 source buffer.
+// All lookahead is done by peeking ahead of the cursor, the consume_*
+// functions leave it untouched when they don't match.
+class Cursor {
+    const char *start;
+    const char *pos;
+    const char *end;
+
+    UChar32 decode(int32_t &length) const {
+        auto byte = static_cast<unsigned char>(*pos);
+        if (byte < 0x80) {
+            length = 1;
+            return byte;
+        }
+
+        int32_t available = static_cast<int32_t>(std::min<ptrdiff_t>(end - pos, 4));
+        UChar32 ch;
+        length = 0;
+        U8_NEXT_OR_FFFD(reinterpret_cast<const uint8_t *>(pos), length, available, ch);
+        return ch;
+    }
+
+    public:
+    static constexpr UChar32 END = U_SENTINEL;
+
+    Cursor(std::string_view source):
+        start{source.data()}, pos{source.data()}, end{source.data() + source.size()} {}
+
+    bool at_end() const {
+        return pos == end;
+    }
+
+    size_t offset() const {
+        return pos - start;
+    }
+
+    void seek(size_t offset) {
+        pos = start + offset;
+    }
+
+    // Unconsumed remainder of the source
+    std::string_view rest() const {
+        return std::string_view(pos, end - pos);
+    }
+
+    // Source text between offset and the cursor
+    std::string_view since(size_t offset) const {
+        return std::string_view(start + offset, pos - (start + offset));
+    }
+
+    // Byte lookahead, enough for the ASCII parts of the grammar
+    int32_t peek_byte(size_t n = 0) const {
+        if (n >= static_cast<size_t>(end - pos))
+            return END;
+
+        return static_cast<unsigned char>(pos[n]);
+    }
+
+    UChar32 peek() const {
+        if (pos == end)
+            return END;
+
+        int32_t length;
+        return decode(length);
+    }
+
+    UChar32 next() {
+        if (pos == end)
+            return END;
+
+        int32_t length;
+        auto ch = decode(length);
+        pos += length;
+        return ch;
+    }
+
+    void advance_bytes(size_t n) {
+        pos += n;
+    }
+};
+
+// A token along with the part of the source it was lexed from
+struct LexedToken {
+    TokenVariant token;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Pull based lexer, tokens are only lexed when they are asked for.
+// At most one token of lookahead is held, so callers can start on the
+// first tokens straight away and stop without lexing the rest.
+// Every token covers at least one character and no text is read more
+// than a bounded number of times, so lexing any input is linear time.
+class Lexer {
+    std::string_view source;
+    Cursor cursor;
+    CommentMode comments;
+    std::optional<LexedToken> lookahead;
+    std::vector<Directive> found_directives;
+
+    // Every comment of a run of comments with at most a line break
+    // between each is followed by the same token, so in DOC mode the
+    // run is only read ahead through once
+    size_t doc_run_end = 0;
+    bool doc_run_documents = false;
+
+    std::optional<LexedToken> lex();
+    bool keep_comment(size_t offset, size_t length);
 
     public:
-    TokenStream(std::vector<TokenVariant> tokens):
-        tokens{tokens} {}
+    class iterator {
+        Lexer *lexer;
+        std::optional<LexedToken> current;
+
+        public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = LexedToken;
+        using difference_type = std::ptrdiff_t;
+
+        iterator(Lexer *lexer): lexer{lexer}, current{lexer->next()} {}
+
+        const LexedToken &operator*() const {
+            return *current;
+        }
 
-    const std::vector<TokenVariant> all() const {
-        return tokens;
+        const LexedToken *operator->() const {
+            return &*current;
+        }
+
+        iterator &operator++() {
+            current = lexer->next();
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool operator==(std::default_sentinel_t) const {
+            return !current.has_value();
+        }
+    };
+
+    Lexer(std::string_view source, size_t start = 0, CommentMode comments = CommentMode::ALL):
+        source{source}, cursor{source}, comments{comments} {
+        cursor.seek(start);
+    }
+
+    // Directives in the comments lexed so far
+    std::span<const Directive> directives() const {
+        return found_directives;
+    }
+
+    // Where the next token will be looked for
+    size_t offset() const {
+        return lookahead ? lookahead->offset : cursor.offset();
+    }
+
+    // Next token, or nullopt at the end of the input
+    std::optional<LexedToken> next();
+
+    // Token next() will return, without consuming it
+    const std::optional<LexedToken> &peek();
+
+    iterator begin() {
+        return iterator(this);
+    }
+
+    std::default_sentinel_t end() const {
+        return {};
     }
 };
 
-std::optional<TokenVariant> consume_punctuation(UFILE *file);
-std::optional<TokenVariant> consume_identifier(UFILE *file);
-std::optional<TokenVariant> consume_numeric_literal(UFILE *file);
-std::optional<RuneLiteral> consume_rune_literal(UFILE *file);
-std::optional<TokenVariant> consume_string_literal(UFILE *file);
-std::optional<Comment> consume_comment(UFILE *file);
+std::optional<TokenVariant> consume_punctuation(Cursor &cursor);
+std::optional<TokenVariant> consume_identifier(Cursor &cursor);
+// Literals and comments that start at the cursor but are malformed or
+// never end come back as an Error, nullopt means none starts there
+std::optional<TokenVariant> consume_numeric_literal(Cursor &cursor);
+std::optional<TokenVariant> consume_rune_literal(Cursor &cursor);
+std::optional<TokenVariant> consume_string_literal(Cursor &cursor);
+std::optional<TokenVariant> consume_raw_string_literal(Cursor &cursor);
+std::optional<TokenVariant> consume_comment(Cursor &cursor);
+
+// Bumped whenever the lexer changes the tokens it gives for any input,
+// so that tokens saved by an older lexer aren't reused
+inline constexpr uint32_t LEXER_VERSION = 3;
+
+TokenStream consume_tokens(std::string_view source, CommentMode comments = CommentMode::ALL);
+
+// What a file's dependencies are found from: its package clause, the
+// directives before it and its imports
+struct FileHeader {
+    // Empty if the file has no package clause
+    std::string package;
+    // Decoded import paths, in the order they appear
+    std::vector<std::string> imports;
+    // Directives before the package clause, such as //go:build lines
+    std::vector<Directive> directives;
+    // Where the first token after the imports starts, or the size of
+    // the source if there is none
+    size_t end = 0;
+    // Tokens lexed, the one at end included
+    size_t tokens = 0;
+};
+
+// Lexes source only as far as the first token after its imports. If
+// source is only the start of a file (complete is false), nothing is
+// returned when the imports could go on past it, or the last token lexed
+// could be cut short.
+std::optional<FileHeader> scan_header(std::string_view source, bool complete = true);
+
+// Reads the file at path a few kilobytes at a time until its header is
+// complete. text is left holding what was read, which the directives
+// refer to. Returns nothing if the file can't be read.
+std::optional<FileHeader> read_header(const std::string &path, std::string &text);
+
+// Replacement of removed bytes at offset by inserted
+struct Edit {
+    size_t offset;
+    size_t removed;
+    std::string_view inserted;
+
+    void apply(std::string &text) const {
+        text.replace(offset, removed, inserted);
+    }
+};
 
-TokenStream consume_tokens(UFILE *file);
+// Lexes source, which is the source of previous with edit applied, by
+// re-lexing only from the last token boundary the edit can't have
+// affected until the new tokens line up with the old ones again. The old
+// tokens on either side are copied over, moved by the size of the edit.
+// Where lexing can restart is only known from the comments, a stream
+// without all of them is lexed again in full.
+TokenStream relex(const TokenStream &previous, std::string_view source, const Edit &edit);
+
+// Lexes chunks of the source in parallel, splitting at newlines. Each
+// chunk is lexed on the guess that it starts between tokens, chunks where
+// that was wrong (it started in a comment or string) are re-lexed from the
+// real token boundary until they line up again. The result is identical
+// to consume_tokens.
+TokenStream consume_tokens_parallel(
+        std::string_view source,
+        support::ThreadPool &pool,
+        size_t chunk_size = 4 * 1024 * 1024,
+        CommentMode comments = CommentMode::ALL
+);
 
 std::ostream &operator<<(std::ostream &os, const TokenVariant &v);
 
@@ -0,0 +1,84 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace goop
+{
+
+namespace support
+{
+
+void Arena::add_block(size_t at_least)
+{
+    // Each block is at least twice the last, so an arena of any size
+    // stays a handful of blocks
+    size_t size = blocks.empty() ? first_block_size : blocks.back().size * 2;
+    size = std::max(size, at_least);
+
+    // Left uninitialized, unlike make_unique
+    blocks.push_back(Block{std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+    cursor = blocks.back().data.get();
+    limit = cursor + size;
+}
+
+void *Arena::allocate(size_t size, size_t align)
+{
+    auto aligned = [&] {
+        auto address = reinterpret_cast<uintptr_t>(cursor);
+        return cursor + ((align - address % align) % align);
+    };
+
+    std::byte *start = cursor ? aligned() : nullptr;
+    if (!start || static_cast<size_t>(limit - start) < size) {
+        add_block(size + align);
+        start = aligned();
+    }
+
+    cursor = start + size;
+    last = start;
+    used += size;
+    return start;
+}
+
+bool Arena::grow(void *pointer, size_t old_size, size_t size)
+{
+    if (pointer != last || last + old_size != cursor || static_cast<size_t>(limit - last) < size)
+        return false;
+
+    cursor = last + size;
+    used += size - old_size;
+    return true;
+}
+
+void Arena::reset()
+{
+    if (blocks.empty())
+        return;
+
+    auto largest = std::max_element(blocks.begin(), blocks.end(), [](const Block &a, const Block &b) {
+        return a.size < b.size;
+    });
+
+    Block kept = std::move(*largest);
+    blocks.clear();
+    blocks.push_back(std::move(kept));
+
+    cursor = blocks.back().data.get();
+    limit = cursor + blocks.back().size;
+    last = nullptr;
+    used = 0;
+}
+
+size_t Arena::capacity() const
+{
+    size_t total = 0;
+    for (const auto &block : blocks) {
+        total += block.size;
+    }
+
+    return total;
+}
+
+}
+
+}
@@ -0,0 +1,159 @@
+#ifndef SUPPORT_ARENA_H
+#define SUPPORT_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace goop
+{
+
+namespace support
+{
+
+// Bump allocator handing out memory from a few large blocks.
+// Nothing is freed on its own, reset() frees everything at once.
+class Arena {
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    std::byte *cursor = nullptr;
+    std::byte *limit = nullptr;
+    // Start of the latest allocation
+    std::byte *last = nullptr;
+    size_t first_block_size;
+    size_t used = 0;
+
+    void add_block(size_t at_least);
+
+    public:
+    explicit Arena(size_t first_block_size = 64 * 1024): first_block_size{first_block_size} {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    Arena(Arena &&) = default;
+    Arena &operator=(Arena &&) = default;
+
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+    // Extends the latest allocation to size bytes if its block has room
+    bool grow(void *pointer, size_t old_size, size_t size);
+
+    // Frees every allocation. The largest block is kept for reuse, so
+    // an arena reset between files of similar size stops allocating.
+    void reset();
+
+    // Bytes handed out, and bytes held in blocks
+    size_t allocated() const {
+        return used;
+    }
+
+    size_t capacity() const;
+
+    size_t block_count() const {
+        return blocks.size();
+    }
+};
+
+// Growable array of trivially copyable values in an Arena. While it is
+// the arena's latest allocation it grows in place, otherwise growing
+// copies it and leaves the old storage until the arena is reset.
+template<typename T>
+class ArenaVector {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    Arena *arena;
+    T *items = nullptr;
+    size_t count = 0;
+    size_t allocated = 0;
+
+    public:
+    explicit ArenaVector(Arena &arena): arena{&arena} {}
+
+    void reserve(size_t capacity) {
+        if (capacity <= allocated)
+            return;
+
+        if (items && arena->grow(items, allocated * sizeof(T), capacity * sizeof(T))) {
+            allocated = capacity;
+            return;
+        }
+
+        auto grown = static_cast<T *>(arena->allocate(capacity * sizeof(T), alignof(T)));
+        if (count) {
+            std::memcpy(grown, items, count * sizeof(T));
+        }
+
+        items = grown;
+        allocated = capacity;
+    }
+
+    void push_back(const T &item) {
+        if (count == allocated) {
+            reserve(std::max<size_t>(16, allocated * 2));
+        }
+
+        items[count++] = item;
+    }
+
+    void append(std::span<const T> more) {
+        if (count + more.size() > allocated) {
+            reserve(std::max(count + more.size(), allocated * 2));
+        }
+
+        if (!more.empty()) {
+            std::memcpy(items + count, more.data(), more.size() * sizeof(T));
+        }
+        count += more.size();
+    }
+
+    // Leaves new items uninitialized
+    void resize(size_t size) {
+        reserve(size);
+        count = size;
+    }
+
+    // Forgets the storage, for when the arena is about to be reset
+    void release() {
+        items = nullptr;
+        count = 0;
+        allocated = 0;
+    }
+
+    T &operator[](size_t index) {
+        return items[index];
+    }
+
+    const T &operator[](size_t index) const {
+        return items[index];
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t capacity() const {
+        return allocated;
+    }
+
+    T *data() {
+        return items;
+    }
+
+    std::span<const T> view() const {
+        return std::span<const T>(items, count);
+    }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include "files.h"
+#include <algorithm>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace goop
+{
+
+namespace support
+{
+
+bool collect_files(std::string_view tool, const std::vector<std::string> &args, std::vector<fs::path> &files)
+{
+    bool ok = true;
+
+    for (const auto &arg : args) {
+        std::error_code error;
+        if (!fs::is_directory(arg, error)) {
+            files.emplace_back(arg);
+            continue;
+        }
+
+        std::vector<fs::path> found;
+        for (auto it = fs::recursive_directory_iterator(arg, error);
+                !error && it != fs::recursive_directory_iterator();
+                it.increment(error)) {
+            if (it->is_regular_file() && it->path().extension() == ".go") {
+                found.push_back(it->path());
+            }
+        }
+
+        if (error) {
+            std::cerr << tool << ": " << arg << ": " << error.message() << std::endl;
+            ok = false;
+        }
+
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+
+    return ok;
+}
+
+}
+
+}
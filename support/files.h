@@ -0,0 +1,29 @@
+#ifndef SUPPORT_FILES_H
+#define SUPPORT_FILES_H
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace goop
+{
+
+namespace support
+{
+
+// Adds each argument to files, with directories expanded into the *.go
+// files below them, sorted so that output order doesn't depend on the
+// file system. Returns false if a directory couldn't be read through,
+// after reporting it on stderr prefixed with the tool's name.
+bool collect_files(
+        std::string_view tool,
+        const std::vector<std::string> &args,
+        std::vector<std::filesystem::path> &files
+);
+
+}
+
+}
+
+#endif
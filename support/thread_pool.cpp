@@ -0,0 +1,162 @@
+#include "thread_pool.h"
+#include <chrono>
+
+namespace goop
+{
+
+namespace support
+{
+
+// Queue of the worker running on this thread, if any
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local size_t current_queue = 0;
+
+ThreadPool::ThreadPool(size_t threads): queued{0}, next_queue{0}, stopping{false}
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this, i] { work(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    // Workers keep what they spawn, everyone else spreads tasks around
+    size_t index;
+    if (current_pool == this) {
+        index = current_queue;
+    } else {
+        index = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    }
+
+    {
+        std::lock_guard lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+
+    queued.fetch_add(1, std::memory_order_release);
+
+    {
+        std::lock_guard lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+std::function<void()> ThreadPool::take(size_t index)
+{
+    {
+        auto &own = *queues[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            auto task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); ++i) {
+        auto &victim = *queues[(index + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            auto task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+bool ThreadPool::run_one()
+{
+    if (queued.load(std::memory_order_acquire) == 0)
+        return false;
+
+    auto index = current_pool == this ? current_queue : 0;
+    if (auto task = take(index)) {
+        task();
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::work(size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+
+    while (true) {
+        if (auto task = take(index)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex);
+        wake.wait(lock, [&] {
+            return stopping || queued.load(std::memory_order_acquire) > 0;
+        });
+
+        if (stopping && queued.load(std::memory_order_acquire) == 0)
+            return;
+    }
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+    pending.fetch_add(1, std::memory_order_relaxed);
+    pool.submit([this, task = std::move(task)] {
+        task();
+
+        // Decrement under the lock, so a waiter that sees zero can't
+        // destroy the group before this is done with it
+        std::lock_guard lock(mutex);
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            done.notify_all();
+        }
+    });
+}
+
+void TaskGroup::wait()
+{
+    while (pending.load(std::memory_order_acquire) > 0) {
+        if (pool.run_one())
+            continue;
+
+        // Everything left is running elsewhere, check back now and
+        // then in case those tasks queue more work we could help with
+        std::unique_lock lock(mutex);
+        done.wait_for(lock, std::chrono::milliseconds(1), [&] {
+            return pending.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    // The last task may still be holding the lock
+    std::lock_guard lock(mutex);
+}
+
+}
+
+}
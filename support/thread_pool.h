@@ -0,0 +1,85 @@
+#ifndef SUPPORT_THREAD_POOL_H
+#define SUPPORT_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace goop
+{
+
+namespace support
+{
+
+// Fixed set of worker threads with one task deque each.
+// Workers push and pop their own tasks at the back of their deque and
+// steal from the front of the others' when they run dry, so tasks
+// spawned by a task stay on the same core while idle workers balance
+// the load.
+class ThreadPool {
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued;
+    std::atomic<size_t> next_queue;
+    bool stopping;
+
+    void work(size_t index);
+    std::function<void()> take(size_t index);
+
+    public:
+    // Defaults to one worker per hardware thread
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Runs one queued task on the calling thread, if there is one.
+    // Lets a thread waiting on other tasks help instead of blocking.
+    bool run_one();
+
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+// Tasks submitted to a pool that can be waited on together.
+// wait() runs queued tasks while it waits, so it is safe to call
+// from inside a task running on the same pool.
+class TaskGroup {
+    ThreadPool &pool;
+    std::atomic<size_t> pending;
+    std::mutex mutex;
+    std::condition_variable done;
+
+    public:
+    TaskGroup(ThreadPool &pool): pool{pool}, pending{0} {}
+    ~TaskGroup() {
+        wait();
+    }
+
+    void run(std::function<void()> task);
+    void wait();
+};
+
+}
+
+}
+
+#endif
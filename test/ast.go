@@ -0,0 +1,110 @@
+// RUN: %goop-ast %s | FileCheck %s
+// RUN: %goop-ast --summary %s | FileCheck --check-prefix=SUMMARY %s
+// RUN: printf 'package p\nfunc f() {\n\tx := \n}\n' | not %goop-ast 2>&1 >/dev/null | FileCheck --check-prefix=ERROR %s
+
+package ast
+
+import (
+	"fmt"
+	str "strings"
+)
+
+type Pair[K comparable, V any] struct {
+	Key   K
+	Value V `json:"value"`
+}
+
+func (p *Pair[K, V]) Swap(a, b int, rest ...string) (int, error) {
+	for i := 0; i < len(rest); i++ {
+		if s := rest[i]; s != "" && a > b {
+			continue
+		}
+	}
+
+	switch v := any(a).(type) {
+	case int:
+		fmt.Println(v + b*2)
+	}
+
+	for k, v := range map[string][]int{"a": {1, 2}} {
+		_ = str.Repeat(k, v[0])
+	}
+
+	return a, nil
+}
+
+// CHECK: File(token: package)
+// CHECK-NEXT:   decls: Package(token: package)
+// CHECK-NEXT:     name: Ident(token: ast)
+// CHECK-NEXT:   decls: GenDecl(token: import)
+// CHECK-NEXT:     specs: ImportSpec(token: "fmt")
+// CHECK-NEXT:     specs: ImportSpec(token: "strings")
+// CHECK-NEXT:       name: Ident(token: str)
+
+// CHECK:          specs: TypeSpec(token: Pair)
+// CHECK-NEXT:       name: Ident(token: Pair)
+// CHECK-NEXT:       params: FieldList(token: [)
+// CHECK-NEXT:         fields: Field(token: K)
+// CHECK-NEXT:           names: Ident(token: K)
+// CHECK-NEXT:           type: Ident(token: comparable)
+// CHECK:            type: StructType(token: struct)
+// CHECK:              tag: BasicLit(token: `json:"value"`)
+
+// CHECK:        decls: FuncDecl(token: func)
+// CHECK-NEXT:     receiver: FieldList(token: ()
+// CHECK-NEXT:       fields: Field(token: p)
+// CHECK-NEXT:         names: Ident(token: p)
+// CHECK-NEXT:         type: Unary(token: *)
+// CHECK-NEXT:           x: IndexList(token: [)
+// CHECK:          name: Ident(token: Swap)
+// CHECK-NEXT:     type: FuncType(token: func)
+// CHECK-NEXT:       params: FieldList(token: ()
+// CHECK-NEXT:         fields: Field(token: a)
+// CHECK-NEXT:           names: Ident(token: a)
+// CHECK-NEXT:           names: Ident(token: b)
+// CHECK-NEXT:           type: Ident(token: int)
+// CHECK-NEXT:         fields: Field(token: rest)
+// CHECK-NEXT:           names: Ident(token: rest)
+// CHECK-NEXT:           type: Ellipsis(token: ...)
+// CHECK-NEXT:             elem: Ident(token: string)
+// CHECK-NEXT:       results: FieldList(token: ()
+// CHECK-NEXT:         fields: Field(token: int)
+// CHECK-NEXT:           type: Ident(token: int)
+
+// CHECK:        statements: For(token: for)
+// CHECK-NEXT:     init: Assign(token: :=)
+// CHECK:          cond: Binary(token: <)
+// CHECK:          post: IncDec(token: ++)
+// CHECK:            statements: If(token: if)
+// CHECK-NEXT:         init: Assign(token: :=)
+// CHECK:              cond: Binary(token: &&)
+// CHECK-NEXT:           x: Binary(token: !=)
+// CHECK:                y: Binary(token: >)
+
+// CHECK:        statements: TypeSwitch(token: switch)
+// CHECK-NEXT:     assign: Assign(token: :=)
+// CHECK-NEXT:       lhs: Ident(token: v)
+// CHECK-NEXT:       rhs: TypeAssert(token: .)
+// CHECK-NEXT:         x: Call(token: (, ellipsis: 0)
+// CHECK:          clauses: CaseClause(token: case)
+// CHECK:                  x: Ident(token: v)
+// CHECK-NEXT:             y: Binary(token: *)
+
+// CHECK:        statements: Range(token: for)
+// CHECK-NEXT:     clause: Assign(token: :=)
+// CHECK-NEXT:       lhs: Ident(token: k)
+// CHECK-NEXT:       lhs: Ident(token: v)
+// CHECK-NEXT:       rhs: Unary(token: range)
+// CHECK-NEXT:         x: CompositeLit(token: {)
+// CHECK-NEXT:           type: MapType(token: map)
+// CHECK:                elements: KeyValue(token: :)
+// CHECK-NEXT:             key: BasicLit(token: "a")
+// CHECK-NEXT:             value: CompositeLit(token: {)
+
+// CHECK:        statements: Return(token: return)
+// CHECK-NEXT:     results: Ident(token: a)
+// CHECK-NEXT:     results: Ident(token: nil)
+
+// SUMMARY: File(path: {{.*}}ast.go, tokens: {{[0-9]+}}, nodes: {{[0-9]+}}, extra: {{[0-9]+}}, bytes: {{[0-9]+}}, blocks: 1)
+
+// ERROR: <stdin>:4:1: expected expression
@@ -0,0 +1,13 @@
+// RUN: %goop-tok -j 2 %s %S/tokens.go | FileCheck %s
+
+package batch
+
+// CHECK: File(path: {{.*}}batch.go, tokens: {{[0-9]+}}, bytes: {{[0-9]+}})
+// CHECK: Keyword(kind: package)
+// CHECK-NEXT: Identifier(ident: batch)
+
+// CHECK: File(path: {{.*}}tokens.go, tokens: {{[0-9]+}}, bytes: {{[0-9]+}})
+// CHECK: Keyword(kind: package)
+// CHECK-NEXT: Identifier(ident: main)
+
+// CHECK: Total(files: 2, tokens: {{[0-9]+}}, bytes: {{[0-9]+}})
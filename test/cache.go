@@ -0,0 +1,27 @@
+// RUN: rm -rf %t && mkdir -p %t && cp %s %t/copy.go
+// RUN: %goop-tok --cache %t/cache %s | FileCheck %s
+// RUN: %goop-tok --cache %t/cache %s | FileCheck %s
+// RUN: %goop-tok --cache %t/cache %t/copy.go | FileCheck %s
+
+// Identical files share a single entry
+// RUN: find %t/cache -name '*.tok' | count 1
+
+// A damaged entry is lexed again, never cut short, and then replaced
+// RUN: %goop-tok %s > %t/lexed.txt
+// RUN: for entry in $(find %t/cache -name '*.tok'); do printf '\377' | dd of=$entry bs=1 seek=$(($(wc -c < $entry) - 4)) conv=notrunc 2>/dev/null; done
+// RUN: %goop-tok --cache %t/cache %s | diff %t/lexed.txt -
+// RUN: %goop-tok --cache %t/cache %s | diff %t/lexed.txt -
+
+package cache
+
+const greeting = "hello\tworld" + `raw`
+var x = 1.5e3i + 0x10 + 'a'
+
+// CHECK: Keyword(kind: package)
+// CHECK-NEXT: Identifier(ident: cache)
+// CHECK: StringLiteral(literal: "hello\tworld", value: "hello\x09world")
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: StringLiteral(literal: `raw`)
+// CHECK: ImaginaryLiteral(inner: FloatLiteral(mantissa: 1.5, exponent: 3, radix: 10, negative_exponent: false, value: 1500))
+// CHECK: IntLiteral(lit: 0x10, value: 16, radix: 16)
+// CHECK: RuneLiteral(kind: NORMAL, rune: 'a')
@@ -0,0 +1,47 @@
+// RUN: %goop-tok --comments doc --directives < %s | FileCheck --check-prefix=DOC %s
+// RUN: %goop-tok --comments doc --directives --chunk-size 16 < %s | FileCheck --check-prefix=DOC %s
+// RUN: %goop-tok --comments drop --directives < %s | FileCheck --check-prefix=DROP %s
+// RUN: %goop-tok --comments drop --summary %s | FileCheck --check-prefix=SUMMARY %s
+
+//go:build linux
+
+// Package comments is documented.
+package comments
+
+import "fmt" // about the import
+
+// Not followed by anything
+
+/* First line of the doc */
+// and the second
+//go:noinline
+func f() {
+	x := 1 /* inside */ + 2 //go:notadirective
+	//line f.go:10
+	fmt.Println(x /*line g.go:1:1*/)
+}
+
+// DOC-NOT: Comment(multiline: false, text:  RUN
+// DOC: Comment(multiline: false, text:  Package comments is documented.)
+// DOC-NEXT: Keyword(kind: package)
+// DOC-NOT: about the import
+// DOC-NOT: Not followed
+// DOC: Comment(multiline: true, text:  First line of the doc )
+// DOC-NEXT: Comment(multiline: false, text:  and the second)
+// DOC-NEXT: Comment(multiline: false, text: go:noinline)
+// DOC-NEXT: Keyword(kind: func)
+// DOC-NOT: inside
+// DOC: Comment(multiline: false, text: line f.go:10)
+// DOC-NEXT: Identifier(ident: fmt)
+// DOC: Directive(kind: go, name: build, arguments: linux)
+// DOC-NEXT: Directive(kind: go, name: noinline, arguments: )
+// DOC-NEXT: Directive(kind: line, name: line, arguments: f.go:10)
+// DOC-NEXT: Directive(kind: line, name: line, arguments: g.go:1:1)
+
+// DROP-NOT: Comment
+// DROP: Directive(kind: go, name: build, arguments: linux)
+// DROP-NEXT: Directive(kind: go, name: noinline, arguments: )
+// DROP-NEXT: Directive(kind: line, name: line, arguments: f.go:10)
+// DROP-NEXT: Directive(kind: line, name: line, arguments: g.go:1:1)
+
+// SUMMARY: Kinds({{.*}}, comment: 0, error: 0)
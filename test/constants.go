@@ -0,0 +1,99 @@
+// RUN: %goop-ast --constants %s | FileCheck %s
+
+package constants
+
+const (
+	Zero, Double = iota, iota * 2
+	One, Two
+	_, Four
+)
+
+const (
+	Sum        = 1 + 2*3 - 4
+	Quotient   = 7 / 2
+	Remainder  = -7 % 2
+	Mask       = 0xF0 &^ 0x30 | 1 ^ 3
+	Complement = ^0
+)
+
+const (
+	Max      = 1<<63 - 1
+	Overflow = Max + 1
+	Back     = Overflow - 1
+	Wide     = 1 << 100
+	Narrow   = Wide >> 98
+	Negative = -Overflow
+)
+
+const (
+	Third  = 1.0 / 3
+	Whole  = Third * 3
+	Exact  = 1e30 / 1e28
+	Half   = 0x1p-1
+	Tiny   = 1e-300 * 1e-300 * 1e300
+	Letter = 'a' + 1
+	Mixed  = 'a' * 1.5
+)
+
+const (
+	Root    = 2i * 2i
+	Product = (1 + 2i) * (3 - 1i)
+	Ratio   = (1 + 2i) / (1 - 1i)
+)
+
+const (
+	ByZero      = 1 / 0
+	FloatByZero = 1.5 / 0.0
+	Modulo      = 1.5 % 2
+	NegativeCount = 1 << -1
+	FractionCount = 1 << 1.5
+	FloatShift    = 1.5 << 1
+	Text          = "not a number"
+	Unknown       = len("x")
+	Later         = Defined + 1
+	Defined       = 1
+)
+
+// CHECK:      Constant(name: Zero, kind: int, value: 0, inline: true)
+// CHECK-NEXT: Constant(name: Double, kind: int, value: 0, inline: true)
+// CHECK-NEXT: Constant(name: One, kind: int, value: 1, inline: true)
+// CHECK-NEXT: Constant(name: Two, kind: int, value: 2, inline: true)
+// CHECK-NEXT: Constant(name: _, kind: int, value: 2, inline: true)
+// CHECK-NEXT: Constant(name: Four, kind: int, value: 4, inline: true)
+
+// CHECK-NEXT: Constant(name: Sum, kind: int, value: 3, inline: true)
+// CHECK-NEXT: Constant(name: Quotient, kind: int, value: 3, inline: true)
+// CHECK-NEXT: Constant(name: Remainder, kind: int, value: -1, inline: true)
+// CHECK-NEXT: Constant(name: Mask, kind: int, value: 194, inline: true)
+// CHECK-NEXT: Constant(name: Complement, kind: int, value: -1, inline: true)
+
+// Results past int64 move to the heap, and back once they fit again
+// CHECK-NEXT: Constant(name: Max, kind: int, value: 9223372036854775807, inline: true)
+// CHECK-NEXT: Constant(name: Overflow, kind: int, value: 9223372036854775808, inline: false)
+// CHECK-NEXT: Constant(name: Back, kind: int, value: 9223372036854775807, inline: true)
+// CHECK-NEXT: Constant(name: Wide, kind: int, value: 1267650600228229401496703205376, inline: false)
+// CHECK-NEXT: Constant(name: Narrow, kind: int, value: 4, inline: true)
+// CHECK-NEXT: Constant(name: Negative, kind: int, value: -9223372036854775808, inline: true)
+
+// CHECK-NEXT: Constant(name: Third, kind: float, value: 0.3333333333333333, inline: false)
+// CHECK-NEXT: Constant(name: Whole, kind: float, value: 1, inline: true)
+// CHECK-NEXT: Constant(name: Exact, kind: float, value: 100, inline: true)
+// CHECK-NEXT: Constant(name: Half, kind: float, value: 0.5, inline: false)
+// CHECK-NEXT: Constant(name: Tiny, kind: float, value: 1e-300, inline: false)
+// CHECK-NEXT: Constant(name: Letter, kind: rune, value: 98, inline: true)
+// CHECK-NEXT: Constant(name: Mixed, kind: float, value: 145.5, inline: false)
+
+// CHECK-NEXT: Constant(name: Root, kind: complex, value: (-4 + 0i), inline: false)
+// CHECK-NEXT: Constant(name: Product, kind: complex, value: (5 + 5i), inline: false)
+// CHECK-NEXT: Constant(name: Ratio, kind: complex, value: (-0.5 + 1.5i), inline: false)
+
+// CHECK-NEXT: Constant(name: ByZero, error: cannot fold)
+// CHECK-NEXT: Constant(name: FloatByZero, error: cannot fold)
+// CHECK-NEXT: Constant(name: Modulo, error: cannot fold)
+// CHECK-NEXT: Constant(name: NegativeCount, error: cannot fold)
+// CHECK-NEXT: Constant(name: FractionCount, error: cannot fold)
+// CHECK-NEXT: Constant(name: FloatShift, error: cannot fold)
+// CHECK-NEXT: Constant(name: Text, error: cannot fold)
+// CHECK-NEXT: Constant(name: Unknown, error: cannot fold)
+// CHECK-NEXT: Constant(name: Later, error: cannot fold)
+// CHECK-NEXT: Constant(name: Defined, kind: int, value: 1, inline: true)
@@ -0,0 +1,54 @@
+// RUN: rm -rf %t && mkdir -p %t/app %t/lib/internal %t/vendor/golang.org/x/text %t/testdata %t/nested
+// RUN: printf 'module example.com/m\n\ngo 1.21\n' > %t/go.mod
+// RUN: cp %s %t/app/main.go
+// RUN: printf 'package lib\n\nimport "example.com/m/lib/internal"\n\nfunc Run() int { return internal.Answer }\n' > %t/lib/lib.go
+// RUN: printf '//go:build ignore\n\npackage main\n\nimport "example.com/m/app"\n' > %t/lib/gen.go
+// RUN: printf 'package lib\n\nimport "example.com/m/app"\n' > %t/lib/lib_windows.go
+// RUN: printf 'package internal\n\nimport "golang.org/x/text"\n\nconst Answer = text.N\n' > %t/lib/internal/internal.go
+// RUN: printf 'package text\n\nconst N = 42\n' > %t/vendor/golang.org/x/text/text.go
+// RUN: printf 'package broken\n\nvar = \n' > %t/testdata/broken.go
+// RUN: printf 'module example.com/nested\n' > %t/nested/go.mod
+// RUN: printf 'package nested\n\nvar = \n' > %t/nested/nested.go
+// RUN: %goop --graph %t | FileCheck %s
+// RUN: %goop -j 1 --summary %t | FileCheck --check-prefix=SUMMARY %s
+// RUN: %goop --imports --graph %t | FileCheck --check-prefix=IMPORTS %s
+
+// RUN: printf 'package lib\n\nimport "example.com/m/app"\n' > %t/lib/cycle.go
+// RUN: printf 'package text\n\nvar = \n' > %t/vendor/golang.org/x/text/bad.go
+// RUN: printf 'package text\n\nfunc f() {\n\tx := \n}\n' > %t/vendor/golang.org/x/text/worse.go
+// RUN: not %goop %t 2>&1 >/dev/null | FileCheck --check-prefix=ERROR %s
+
+package main
+
+import (
+	"fmt"
+
+	"example.com/m/lib"
+)
+
+func main() {
+	fmt.Println(lib.Run())
+}
+
+// CHECK:      Package(path: example.com/m/app, files: 1, tokens: {{[0-9]+}}, nodes: {{[0-9]+}}, level: 3)
+// CHECK-NEXT:   import: example.com/m/lib
+// CHECK-NEXT: Package(path: example.com/m/lib, files: 1, tokens: 15, nodes: {{[0-9]+}}, level: 2)
+// CHECK-NEXT:   import: example.com/m/lib/internal
+// CHECK-NEXT: Package(path: example.com/m/lib/internal, files: 1, tokens: {{[0-9]+}}, nodes: {{[0-9]+}}, level: 1)
+// CHECK-NEXT:   import: golang.org/x/text
+// CHECK-NEXT: Package(path: golang.org/x/text, files: 1, tokens: 6, nodes: {{[0-9]+}}, level: 0)
+// CHECK-NEXT: Build(packages: 4, files: 4, tokens: {{[0-9]+}}, nodes: {{[0-9]+}})
+
+// SUMMARY-NOT: Package
+// SUMMARY:     Build(packages: 4, files: 4, tokens: {{[0-9]+}}, nodes: {{[0-9]+}})
+
+// IMPORTS:      Package(path: example.com/m/app, files: 1, level: 3)
+// IMPORTS-NEXT:   import: example.com/m/lib
+// IMPORTS:      Package(path: golang.org/x/text, files: 1, level: 0)
+// IMPORTS-NEXT: Build(packages: 4, files: 4)
+
+// ERROR:      goop: example.com/m/app: import cycle
+// ERROR-NEXT: goop: example.com/m/lib: import cycle
+// ERROR-NEXT: {{.*}}bad.go:3:5: expected identifier
+// ERROR-NEXT: {{.*}}bad.go:4:1: expected expression
+// ERROR-NEXT: {{.*}}worse.go:5:1: expected expression
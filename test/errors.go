@@ -0,0 +1,82 @@
+// RUN: %goop-tok < %s | FileCheck %s
+// RUN: %goop-tok --chunk-size 16 < %s | FileCheck %s
+// RUN: %goop-tok --format json < %s | FileCheck --check-prefix=JSON %s
+
+package errors
+
+var a = x @ $ y ∑ z
+var b = 0b102 + 08 + 1e+x + 3
+var c = 'ab' + '' + 'c
+var d = "a\qb" + "\"
+var e = 1
+var h = 0x + 0b + 0o + 0xg + 0x.p1 + 0x1.8 + 0b_ + 0_x
+var i = 1_ + 1__2 + 1_.5 + 1._5 + 0.5_ + 1e_5
+var j = 1_000 + 0x_1F + 0_7 + 0x.8p1
+
+// CHECK: Identifier(ident: x)
+// CHECK-NEXT: Error(reason: unexpected character, text: @)
+// CHECK-NEXT: Error(reason: unexpected character, text: $)
+// CHECK-NEXT: Identifier(ident: y)
+// CHECK-NEXT: Error(reason: unexpected character, text: ∑)
+// CHECK-NEXT: Identifier(ident: z)
+// CHECK: Error(reason: invalid number, text: 0b102)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 08)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 1e+x)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: IntLiteral(lit: 3, value: 3, radix: 10)
+// CHECK: Error(reason: invalid rune literal, text: 'ab')
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid rune literal, text: '')
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: unterminated rune literal, text: 'c)
+// CHECK-NEXT: Keyword(kind: var)
+// CHECK: Error(reason: invalid escape, text: "a\qb")
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: unterminated string literal, text: "\")
+// CHECK-NEXT: Keyword(kind: var)
+// CHECK-NEXT: Identifier(ident: e)
+// CHECK-NEXT: Punctuation(kind: =)
+// CHECK-NEXT: IntLiteral(lit: 1, value: 1, radix: 10)
+// CHECK: Error(reason: invalid number, text: 0x)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0b)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0o)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0xg)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0x.p1)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0x1.8)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0b_)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0_x)
+// CHECK: Error(reason: invalid number, text: 1_)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 1__2)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 1_.5)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 1._5)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 0.5_)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: Error(reason: invalid number, text: 1e_5)
+// CHECK: IntLiteral(lit: 1_000, value: 1000, radix: 10)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: IntLiteral(lit: 0x_1F, value: 31, radix: 16)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: IntLiteral(lit: 0_7, value: 7, radix: 8)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: FloatLiteral(mantissa: 0x.8, exponent: 1, radix: 16, negative_exponent: false, value: 1)
+
+// JSON: {"kind":"error","offset":{{[0-9]+}},"length":1,"text":"@","reason":"unexpected character"}
+// JSON: {"kind":"error","offset":{{[0-9]+}},"length":3,"text":"\"\\\"","reason":"unterminated string literal"}
+
+// The rest of the input is an unterminated comment
+// CHECK: {{^}}Error(reason: unterminated comment, text: /*
+// CHECK-NEXT: {{^}})
+/*
@@ -0,0 +1,42 @@
+// RUN: %goop-tok --header < %s | FileCheck %s
+// RUN: %goop-tok --header --format json < %s | FileCheck --check-prefix=JSON %s
+// RUN: cp %s %t.go && seq 1 2000 | sed 's|^|// |' >> %t.go
+// RUN: %goop-tok --header %t.go | FileCheck --check-prefix=FILE %s
+
+// Copyright line, not a directive
+
+//go:build linux && !cgo
+
+// Package header has its imports in two declarations.
+package header // trailing
+
+import "fmt"
+
+import (
+	str "strings"
+	. "unicode\x2Futf8"
+	_ "embed"
+)
+
+//go:noinline
+func f() {
+	fmt.Println(str.ToUpper("x"), RuneLen('x'))
+}
+
+import "never/read"
+
+// CHECK:      Directive(kind: go, name: build, arguments: linux && !cgo)
+// CHECK-NEXT: Package(name: header, end: {{[0-9]+}})
+// CHECK-NEXT: Import(path: fmt)
+// CHECK-NEXT: Import(path: strings)
+// CHECK-NEXT: Import(path: unicode/utf8)
+// CHECK-NEXT: Import(path: embed)
+
+// JSON:      {"directive":"go","offset":{{[0-9]+}},"name":"build","arguments":"linux && !cgo"}
+// JSON-NEXT: {"package":"header","end":{{[0-9]+}}}
+// JSON-NEXT: {"import":"fmt"}
+
+// Only the first few kilobytes of a larger file are read
+// FILE:      File(path: {{.*}}.go, tokens: 14, bytes: 4096)
+// FILE:      Import(path: embed)
+// FILE-NEXT: Total(files: 1, tokens: 14, bytes: 4096)
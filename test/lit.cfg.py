@@ -8,6 +8,17 @@ config.suffixes = ['.go', '.c']
 config.test_source_root = os.path.dirname(__file__)
 config.test_exec_root = os.path.join(config.goop_bin_root, 'test')
 
+if config.goop_stats == 'ON':
+    config.available_features.add('stats')
+
 config.substitutions.append(
         ('%goop-tok', os.path.join(config.goop_bin_root, 'goop-tok'))
 )
+
+config.substitutions.append(
+        ('%goop-ast', os.path.join(config.goop_bin_root, 'goop-ast'))
+)
+
+config.substitutions.append(
+        ('%goop', os.path.join(config.goop_bin_root, 'goop'))
+)
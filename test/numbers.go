@@ -0,0 +1,23 @@
+// RUN: %goop-tok < %s | FileCheck %s
+// RUN: %goop-tok --chunk-size 16 < %s | FileCheck %s
+
+var x = 0x1F + 017 + 06978i + 0i + 1.5e3
+var y = 1_000_000_000_000 + 0xFFFF_FFFF_FFFF_FFFF + 0x1_0000_0000_0000_0000
+var z = 0x1.8p-3 + 4.9406564584124654e-324 + 9007199254740993.0000000000000000001 + 1e400
+var w = 0e0 + 0E-5i
+
+// CHECK: IntLiteral(lit: 0x1F, value: 31, radix: 16)
+// CHECK: IntLiteral(lit: 017, value: 15, radix: 8)
+// CHECK: ImaginaryLiteral(inner: IntLiteral(lit: 06978, value: 6978, radix: 10))
+// CHECK: ImaginaryLiteral(inner: IntLiteral(lit: 0, value: 0, radix: 10))
+// CHECK: FloatLiteral(mantissa: 1.5, exponent: 3, radix: 10, negative_exponent: false, value: 1500)
+// CHECK: IntLiteral(lit: 1_000_000_000_000, value: 1000000000000, radix: 10)
+// CHECK: IntLiteral(lit: 0xFFFF_FFFF_FFFF_FFFF, value: 18446744073709551615, radix: 16)
+// CHECK: IntLiteral(lit: 0x1_0000_0000_0000_0000, value: 18446744073709551616, radix: 16)
+// CHECK: FloatLiteral(mantissa: 0x1.8, {{.*}}, value: 0.1875)
+// CHECK: FloatLiteral(mantissa: 4.9406564584124654, {{.*}}, value: 5e-324)
+// CHECK: FloatLiteral(mantissa: 9007199254740993.0000000000000000001, {{.*}}, value: 9007199254740994)
+// CHECK: FloatLiteral(mantissa: 1, exponent: 400, {{.*}}, value: inf)
+// CHECK: FloatLiteral(mantissa: 0, exponent: 0, radix: 10, negative_exponent: false, value: 0)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: ImaginaryLiteral(inner: FloatLiteral(mantissa: 0, exponent: 5, radix: 10, negative_exponent: true, value: 0))
@@ -0,0 +1,54 @@
+// RUN: %goop-ast --outline %s | FileCheck %s
+// RUN: %goop-ast --lazy %s | FileCheck --check-prefix=LAZY %s
+
+package outline
+
+import "fmt"
+
+const (
+	A, B = iota, iota * 2
+	C
+)
+
+var table = map[string]struct{ x, y int }{
+	"a": {1, 2},
+}
+
+type List[T any] struct {
+	next *List[T]
+	value T
+}
+
+func (l *List[T]) Len() int {
+	if l == nil {
+		return 0
+	}
+	return 1 + l.next.Len()
+}
+
+func Printf(format string, args ...any) interface{ String() string } {
+	fmt.Printf(format, args...)
+	return nil
+}
+
+//go:linkname now runtime.nanotime
+func now() int64
+
+// CHECK: Package(name: outline)
+// CHECK-NEXT: Declaration(kind: import, name: "fmt", line: 6, tokens: 2, body: 0)
+// CHECK-NEXT: Declaration(kind: const, name: A, line: 9, tokens: 9, body: 5)
+// CHECK-NEXT: Declaration(kind: const, name: B, line: 9, tokens: 9, body: 5)
+// CHECK-NEXT: Declaration(kind: const, name: C, line: 10, tokens: 1, body: 0)
+// CHECK-NEXT: Declaration(kind: var, name: table, line: 13, tokens: 24, body: 21)
+// CHECK-NEXT: Declaration(kind: type, name: List, line: 17, tokens: 17, body: 15)
+// CHECK-NEXT: Declaration(kind: method, name: Len, receiver: List, line: 22, tokens: 33, body: 20)
+// CHECK-NEXT: Declaration(kind: func, name: Printf, line: 29, tokens: 30, body: 13)
+// CHECK-NEXT: Declaration(kind: func, name: now, line: 35, tokens: 5, body: 0)
+
+// LAZY:      decls: FuncDecl(token: func)
+// LAZY:        name: Ident(token: Len)
+// LAZY:        body: LazyBlock(token: {, end: {{[0-9]+}})
+// LAZY:      decls: FuncDecl(token: func)
+// LAZY:        name: Ident(token: Printf)
+// LAZY:        body: LazyBlock(token: {, end: {{[0-9]+}})
+// LAZY-NOT:  Call
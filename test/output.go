@@ -0,0 +1,21 @@
+// RUN: %goop-tok --format json < %s | FileCheck --check-prefix=JSON %s
+// RUN: %goop-tok --summary %s | FileCheck --check-prefix=SUMMARY %s
+// RUN: %goop-tok --count %s %s | FileCheck --check-prefix=COUNT %s
+
+package output
+
+var s = "tab\there" + 'é' + 0x1F + 1e400
+
+// JSON: {"kind":"keyword","offset":{{[0-9]+}},"length":7,"text":"package"}
+// JSON-NEXT: {"kind":"identifier","offset":{{[0-9]+}},"length":6,"text":"output"}
+// JSON: {"kind":"string","offset":{{[0-9]+}},"length":11,"text":"\"tab\\there\"","raw":false,"value":"tab\there"}
+// JSON: {"kind":"rune","offset":{{[0-9]+}},"length":4,"text":"'é'","value":233}
+// JSON: {"kind":"int","offset":{{[0-9]+}},"length":4,"text":"0x1F","radix":16,"value":31}
+// JSON: {"kind":"float","offset":{{[0-9]+}},"length":5,"text":"1e400","radix":10,"value":null}
+
+// SUMMARY: File(path: {{.*}}output.go, tokens: 26, bytes: {{[0-9]+}})
+// SUMMARY-NEXT: Total(files: 1, tokens: 26, bytes: {{[0-9]+}})
+// SUMMARY-NEXT: Kinds(keyword: 2, identifier: 2, int: 1, float: 1, imaginary: 0, punctuation: 4, rune: 1, string: 1, comment: 14, error: 0)
+
+// COUNT-NOT: File
+// COUNT: Total(files: 2, tokens: 52, bytes: {{[0-9]+}})
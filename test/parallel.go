@@ -0,0 +1,58 @@
+// RUN: %goop-ast %s > %t.serial
+// RUN: %goop-ast -j 3 --batch-size 8 %s > %t.parallel
+// RUN: diff %t.serial %t.parallel
+// RUN: %goop-ast %s %S/ast.go > %t.serial-package
+// RUN: %goop-ast -j 3 --batch-size 8 %s %S/ast.go > %t.parallel-package
+// RUN: diff %t.serial-package %t.parallel-package
+// RUN: %goop-ast -j 3 --batch-size 8 %s | FileCheck %s
+// RUN: printf 'package p\nfunc f() {\n\tx := \n}\nfunc g() {\n\ty := \n}\nvar v = \n' | not %goop-ast -j 2 --batch-size 1 2>&1 >/dev/null | FileCheck --check-prefix=ERROR %s
+
+package parallel
+
+type Shape interface {
+	Area() float64
+}
+
+type Rect struct{ w, h float64 }
+
+func (r Rect) Area() float64 {
+	return r.w * r.h
+}
+
+func Sum(shapes ...Shape) (total float64) {
+	for _, s := range shapes {
+		total += s.Area()
+	}
+	return
+}
+
+func Largest(shapes []Shape) Shape {
+	var best Shape
+	for i, s := range shapes {
+		if i == 0 || s.Area() > best.Area() {
+			best = s
+		}
+	}
+	return best
+}
+
+func Scale(r Rect, by float64) Rect {
+	return Rect{w: r.w * by, h: func() float64 { return r.h * by }()}
+}
+
+// CHECK:      name: Ident(token: Area)
+// CHECK:      body: Block(token: {)
+// CHECK-NEXT:   statements: Return(token: return)
+// CHECK:      name: Ident(token: Sum)
+// CHECK:      body: Block(token: {)
+// CHECK-NEXT:   statements: Range(token: for)
+// CHECK:      name: Ident(token: Largest)
+// CHECK:      body: Block(token: {)
+// CHECK:      name: Ident(token: Scale)
+// CHECK:      body: Block(token: {)
+// CHECK:      fun: FuncLit(token: func)
+
+// Errors come out in source order, however the bodies were split
+// ERROR:      <stdin>:4:1: expected expression
+// ERROR-NEXT: <stdin>:7:1: expected expression
+// ERROR-NEXT: <stdin>:9:1: expected expression
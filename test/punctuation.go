@@ -0,0 +1,23 @@
+// RUN: %goop-tok < %s | FileCheck %s
+
+x /= y / z // c
+f(a...) &^= .5
+..
+
+// CHECK: Identifier(ident: x)
+// CHECK-NEXT: Punctuation(kind: /=)
+// CHECK-NEXT: Identifier(ident: y)
+// CHECK-NEXT: Punctuation(kind: /)
+// CHECK-NEXT: Identifier(ident: z)
+// CHECK-NEXT: Comment(multiline: false, text:  c)
+
+// CHECK-NEXT: Identifier(ident: f)
+// CHECK-NEXT: Punctuation(kind: ()
+// CHECK-NEXT: Identifier(ident: a)
+// CHECK-NEXT: Punctuation(kind: ...)
+// CHECK-NEXT: Punctuation(kind: ))
+// CHECK-NEXT: Punctuation(kind: &^=)
+// CHECK-NEXT: FloatLiteral(mantissa: .5, exponent: , radix: 10, negative_exponent: false, value: 0.5)
+
+// CHECK-NEXT: Punctuation(kind: .)
+// CHECK-NEXT: Punctuation(kind: .)
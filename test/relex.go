@@ -0,0 +1,48 @@
+// RUN: printf 'package p\n\nvar ab = cd /* c */ + `raw` // note //go:embed x\n//go:noinline\nfunc f() { x := 1.5 }\n' > %t.go
+
+// Each EDIT below is offset, removed and the text put in their place.
+// The tokens relexed after the edit have to be the ones a full lex of
+// the edited text gives, directives included.
+// RUN: grep '^// EDIT:' %s | while read -r _ _ offset removed text; do \
+// RUN:     %goop-tok --directives --edit "$offset,$removed,$text" < %t.go > %t.relexed || exit 1; \
+// RUN:     { head -c $offset %t.go; printf '%%b' "$text"; tail -c +$((offset + removed + 1)) %t.go; } > %t.edited; \
+// RUN:     %goop-tok --directives < %t.edited | diff - %t.relexed || { echo "edit $offset,$removed,$text"; exit 1; }; \
+// RUN: done
+
+// Without every comment the tokens are lexed again in full
+// RUN: %goop-tok --comments drop --directives --edit 47,0,'\n' < %t.go | FileCheck --check-prefix=DROP %s
+
+// Splitting and joining identifiers
+// EDIT: 16 0 +
+// EDIT: 17 3
+
+// Opening a block comment, and taking away the end of one
+// EDIT: 15 0 /*
+// EDIT: 28 2
+// EDIT: 95 0 /*
+
+// Opening a raw string, and taking away the end of one
+// EDIT: 11 0 `
+// EDIT: 37 1
+
+// Directives appear and disappear with the start of their line
+// EDIT: 47 0 \n
+// EDIT: 11 0 //go:build linux\n
+// EDIT: 60 0 x
+// EDIT: 59 1
+// EDIT: 62 4
+
+// Numbers the edit runs into
+// EDIT: 91 0 .
+// EDIT: 92 0 e
+// EDIT: 93 0 e
+
+// Across lines, and at either end
+// EDIT: 23 40 1\n2
+// EDIT: 0 0 //x\n
+// EDIT: 0 96
+// EDIT: 96 0 var y = 2
+
+// DROP-NOT:  Comment
+// DROP:      Directive(kind: go, name: embed, arguments: x)
+// DROP-NEXT: Directive(kind: go, name: noinline, arguments: )
@@ -0,0 +1,22 @@
+// RUN: %goop-tok < %s > %t.seq
+// RUN: %goop-tok -j 4 --chunk-size 16 < %s > %t.split
+// RUN: diff %t.seq %t.split
+// RUN: FileCheck %s < %t.split
+
+/* A block comment spanning
+   several lines, so the chunks starting inside
+   it guess wrong */
+var s = "a string // that looks like a comment"
+x := 0x1F + 'y' /* trailing */
+
+// CHECK: Comment(multiline: true, text:  A block comment spanning
+// CHECK: Keyword(kind: var)
+// CHECK-NEXT: Identifier(ident: s)
+// CHECK-NEXT: Punctuation(kind: =)
+// CHECK-NEXT: StringLiteral(literal: "a string // that looks like a comment")
+// CHECK-NEXT: Identifier(ident: x)
+// CHECK-NEXT: Punctuation(kind: :=)
+// CHECK-NEXT: IntLiteral(lit: 0x1F, value: 31, radix: 16)
+// CHECK-NEXT: Punctuation(kind: +)
+// CHECK-NEXT: RuneLiteral(kind: NORMAL, rune: 'y')
+// CHECK-NEXT: Comment(multiline: true, text:  trailing )
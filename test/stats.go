@@ -0,0 +1,23 @@
+// REQUIRES: stats
+// RUN: %goop-tok --count --stats %s 2>&1 | FileCheck %s
+
+package stats
+
+// Each of these but 1_ (one invalid number) looks past the token it lexes
+var a = "d\te" + 1_ + b..c
+var f = 'ab'
+var g = "a\qb"
+
+// CHECK: Total(files: 1, tokens: 37, bytes: {{[0-9]+}})
+// CHECK-NEXT: Stats(tokens: 37, bytes: {{[0-9]+}})
+// CHECK-NEXT: Tokens(keyword: 4, identifier: 6, int: 0, float: 0, imaginary: 0, punctuation: 7, rune: 0, string: 1, comment: 16, error: 3)
+// CHECK-NEXT: Consumer(name: punctuation, calls: 7, matches: 7, backtracks: 1, backtracked_bytes: 1)
+// CHECK-NEXT: Consumer(name: identifier, calls: 10, matches: 10, backtracks: 0, backtracked_bytes: 0)
+// CHECK-NEXT: Consumer(name: number, calls: 1, matches: 1, backtracks: 0, backtracked_bytes: 0)
+// CHECK-NEXT: Consumer(name: rune, calls: 1, matches: 1, backtracks: 1, backtracked_bytes: 2)
+// CHECK-NEXT: Consumer(name: string, calls: 2, matches: 2, backtracks: 1, backtracked_bytes: 3)
+// CHECK-NEXT: Consumer(name: raw_string, calls: 0, matches: 0, backtracks: 0, backtracked_bytes: 0)
+// CHECK-NEXT: Consumer(name: comment, calls: 16, matches: 16, backtracks: 0, backtracked_bytes: 0)
+// CHECK-NEXT: Allocated(count: 1, bytes: {{[0-9]+}})
+// CHECK-NEXT: Phases(read_ns: {{[0-9]+}}, lex_ns: {{[0-9]+}}
+// CHECK-NEXT: Memory(peak_rss_kb: {{[0-9]+}}, token_storage: {{[0-9]+}}, storage_per_source_byte: {{[0-9.]+}})
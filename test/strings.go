@@ -0,0 +1,18 @@
+// RUN: %goop-tok < %s | FileCheck %s
+// RUN: %goop-tok --chunk-size 16 < %s | FileCheck %s
+
+var plain = "no escapes, just text"
+var escaped = "tab\t\"quoted\" \u00e9 \U0001F600 \x80\377"
+var raw = `C:\path\n "quoted"
+second line`
+var invalid = "\U00110000" + 1
+
+// CHECK: StringLiteral(literal: "no escapes, just text")
+// CHECK: StringLiteral(literal: "tab\t\"quoted\" \u00e9 \U0001F600 \x80\377", value: "tab\x09\"quoted\" é 😀 \x80\xff")
+// CHECK: StringLiteral(literal: `C:\path\n "quoted"
+// CHECK-NEXT: second line`)
+// CHECK-NEXT: Keyword(kind: var)
+// CHECK-NEXT: Identifier(ident: invalid)
+// CHECK-NEXT: Punctuation(kind: =)
+// CHECK-NEXT: Error(reason: invalid escape, text: "\U00110000")
+// CHECK-NEXT: Punctuation(kind: +)
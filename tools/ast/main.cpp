@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "constant.h"
+#include "parser.h"
+#include "skim.h"
+#include "files.h"
+#include "source.h"
+#include "thread_pool.h"
+#include "tokens.h"
+
+namespace fs = std::filesystem;
+
+struct Options {
+    // Only the size of each tree, not the tree
+    bool summary = false;
+    // The top level declarations, from skimming rather than parsing
+    bool outline = false;
+    // Function bodies are left unparsed
+    bool lazy = false;
+    // The value of each constant declared at the top level, folded
+    bool constants = false;
+    // Threads to parse files and function bodies on, 0 for one per
+    // hardware thread. Everything is parsed on the calling thread without.
+    std::optional<size_t> threads;
+    // Tokens of function bodies per parallel task
+    size_t batch_size = 16 * 1024;
+};
+
+static void usage()
+{
+    std::cerr << "usage: goop-ast [-j threads] [--batch-size tokens] [--summary | --outline | --constants] [--lazy]\n"
+        << "                [file or directory...]\n"
+        << "Parses stdin, or every given file and every *.go file under the given directories,\n"
+        << "and writes the syntax tree of each\n"
+        << "--summary only writes the number of nodes and the memory each tree takes\n"
+        << "--outline writes each top level declaration with the size of its body, without parsing\n"
+        << "--constants writes the value of each top level numeric constant, folded exactly\n"
+        << "--lazy leaves function bodies unparsed, as LazyBlock nodes\n"
+        << "-j parses the files of each directory, and the function bodies of large files, in parallel,\n"
+        << "   0 threads for one per core, bodies in batches of --batch-size tokens, files smaller\n"
+        << "   than two batches in one go\n"
+        << "Syntax errors are reported on stderr, and make the exit status 1"
+        << std::endl;
+}
+
+static void write_outline(const goop::source::SourceManager &sources, goop::source::FileId file,
+        const goop::tokens::TokenStream &tokens)
+{
+    using goop::parser::BracketIndex;
+
+    auto outline = goop::parser::skim(tokens);
+    auto text = [&](goop::parser::TokenIndex token) {
+        return token == BracketIndex::NONE ? std::string_view("-") : tokens.text(token);
+    };
+
+    std::cout << "Package(name: " << text(outline.package) << ")\n";
+    for (const auto &decl : outline.declarations) {
+        auto line = sources.line_column(sources.location(file, tokens.offsets()[decl.begin])).line;
+        std::cout << "Declaration(kind: " << goop::parser::name(decl.kind)
+            << ", name: " << text(decl.name);
+        if (decl.kind == goop::parser::Declaration::METHOD) {
+            std::cout << ", receiver: " << text(decl.receiver);
+        }
+
+        std::cout << ", line: " << line
+            << ", tokens: " << decl.end - decl.begin
+            << ", body: " << decl.body_end - decl.body_begin << ")\n";
+    }
+}
+
+using Constants = std::map<std::string_view, goop::constant::Value, std::less<>>;
+
+// Folds the constant expression at id, where names are the constants
+// declared before it. Only numeric literals, iota, those constants and
+// arithmetic on them can be folded.
+static std::optional<goop::constant::Value> fold(
+        const goop::parser::Ast &ast,
+        goop::parser::NodeId id,
+        int64_t iota,
+        const Constants &names
+)
+{
+    using namespace goop::tokens;
+    using goop::constant::Value;
+    using goop::parser::NodeKind;
+
+    const auto &node = ast.node(id);
+    auto token = ast.tokens()[node.token];
+
+    switch (node.kind) {
+    case NodeKind::BASIC_LIT:
+        return std::visit([](const auto &literal) -> std::optional<Value> {
+            using T = std::decay_t<decltype(literal)>;
+            if constexpr (std::is_same_v<T, IntLiteral> || std::is_same_v<T, RuneLiteral>
+                    || std::is_same_v<T, FloatLiteral> || std::is_same_v<T, ImaginaryLiteral>) {
+                return Value::of(literal);
+            } else {
+                return std::nullopt;
+            }
+        }, token);
+    case NodeKind::IDENT: {
+        auto name = ast.text(node.token);
+        if (auto found = names.find(name); found != names.end())
+            return found->second;
+
+        if (name == "iota")
+            return Value(iota);
+
+        return std::nullopt;
+    }
+    case NodeKind::PAREN:
+        return fold(ast, node.lhs, iota, names);
+    case NodeKind::UNARY: {
+        auto x = fold(ast, node.lhs, iota, names);
+        if (!x)
+            return std::nullopt;
+
+        return goop::constant::unary(std::get<Punctuation>(token).kind, *x);
+    }
+    case NodeKind::BINARY: {
+        auto x = fold(ast, node.lhs, iota, names);
+        auto y = fold(ast, node.rhs, iota, names);
+        if (!x || !y)
+            return std::nullopt;
+
+        auto op = std::get<Punctuation>(token).kind;
+        if (op != Punctuation::LSHIFT && op != Punctuation::RSHIFT)
+            return goop::constant::binary(*x, op, *y);
+
+        // The count has to be a non-negative integer
+        auto count = y->to_kind(Value::Kind::INT);
+        auto small = count ? count->to_int64() : std::nullopt;
+        if (!small || *small < 0)
+            return std::nullopt;
+
+        return goop::constant::shift(*x, op, static_cast<uint64_t>(*small));
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+static std::string_view kind_name(goop::constant::Value::Kind kind)
+{
+    using Kind = goop::constant::Value::Kind;
+
+    switch (kind) {
+    case Kind::INT:
+        return "int";
+    case Kind::RUNE:
+        return "rune";
+    case Kind::FLOAT:
+        return "float";
+    case Kind::COMPLEX:
+        return "complex";
+    }
+
+    return "";
+}
+
+// Writes every top level constant with its value. A spec without values
+// repeats the ones before it, with the next iota, like Go does.
+static void write_constants(const goop::parser::Ast &ast)
+{
+    using goop::parser::NodeKind;
+
+    Constants names;
+    const auto &file = ast.node(0);
+
+    for (auto decl : ast.list(file.lhs, file.rhs)) {
+        const auto &node = ast.node(decl);
+        if (node.kind != NodeKind::GEN_DECL || ast.text(node.token) != "const")
+            continue;
+
+        std::span<const goop::parser::NodeId> values;
+        int64_t iota = 0;
+        for (auto spec : ast.list(node.lhs, node.rhs)) {
+            // names, type, values
+            const auto &fields = ast.node(spec);
+            auto spec_names = ast.list(ast.extra(fields.lhs), ast.extra(fields.lhs + 1));
+            auto spec_values = ast.list(ast.extra(fields.lhs + 3), ast.extra(fields.lhs + 4));
+            if (!spec_values.empty()) {
+                values = spec_values;
+            }
+
+            for (size_t i = 0; i < spec_names.size(); ++i) {
+                auto name = ast.text(ast.node(spec_names[i]).token);
+                std::cout << "Constant(name: " << name;
+
+                auto value = i < values.size() ? fold(ast, values[i], iota, names) : std::nullopt;
+                if (!value) {
+                    std::cout << ", error: cannot fold)\n";
+                    continue;
+                }
+
+                std::cout << ", kind: " << kind_name(value->kind())
+                    << ", value: " << *value
+                    << ", inline: " << (value->is_small() ? "true" : "false") << ")\n";
+                names.insert_or_assign(name, *value);
+            }
+
+            iota += 1;
+        }
+    }
+}
+
+// Writes the tree of a parsed file, or what options ask for instead, and
+// reports its syntax errors, returning whether it had none
+static bool write_file(
+        const goop::source::SourceManager &sources,
+        goop::source::FileId file,
+        const goop::tokens::TokenStream &tokens,
+        const goop::parser::Ast &ast,
+        const Options &options
+)
+{
+    if (options.constants) {
+        write_constants(ast);
+    } else if (options.summary) {
+        std::cout << "File(path: " << sources.path(file)
+            << ", tokens: " << tokens.size()
+            << ", nodes: " << ast.size()
+            << ", extra: " << ast.extras().size()
+            << ", bytes: " << ast.storage_bytes()
+            << ", blocks: " << ast.memory().block_count() << ")\n";
+    } else {
+        goop::parser::dump(std::cout, ast);
+    }
+
+    for (const auto &error : ast.errors()) {
+        auto offset = error.token < tokens.size() ? tokens.offsets()[error.token] : sources.text(file).size();
+        auto position = sources.line_column(sources.location(file, static_cast<uint32_t>(offset)));
+        std::cerr << position.path << ':' << position.line << ':' << position.column
+            << ": expected " << error.expected << '\n';
+    }
+
+    return ast.errors().empty();
+}
+
+// Parses one loaded file, returning whether it had no syntax errors
+static bool parse_file(
+        const goop::source::SourceManager &sources,
+        goop::source::FileId file,
+        const Options &options,
+        goop::support::ThreadPool *pool
+)
+{
+    auto tokens = goop::tokens::consume_tokens(sources.text(file), goop::tokens::CommentMode::DROP);
+
+    if (options.outline) {
+        write_outline(sources, file, tokens);
+        return true;
+    }
+
+    std::optional<goop::parser::BracketIndex> brackets;
+    if (options.lazy) {
+        brackets.emplace(tokens);
+    }
+
+    auto ast = pool && !options.lazy
+        ? goop::parser::parse_parallel(tokens, *pool, options.batch_size)
+        : goop::parser::parse(tokens, brackets ? &*brackets : nullptr);
+
+    return write_file(sources, file, tokens, ast, options);
+}
+
+// Parses the loaded files of one directory, a package, all at once on
+// the pool, and writes them in order. Returns whether none had syntax
+// errors.
+static bool parse_package(
+        const goop::source::SourceManager &sources,
+        std::span<const goop::source::FileId> files,
+        const Options &options,
+        goop::support::ThreadPool &pool
+)
+{
+    std::vector<goop::tokens::TokenStream> streams;
+    std::vector<const goop::tokens::TokenStream *> pointers;
+    streams.reserve(files.size());
+    for (auto file : files) {
+        streams.push_back(goop::tokens::consume_tokens(sources.text(file), goop::tokens::CommentMode::DROP));
+        pointers.push_back(&streams.back());
+    }
+
+    auto trees = goop::parser::parse_parallel(pointers, pool, options.batch_size);
+
+    bool ok = true;
+    for (size_t i = 0; i < files.size(); ++i) {
+        ok &= write_file(sources, files[i], streams[i], trees[i], options);
+    }
+
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            options.threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--batch-size" && i + 1 < argc) {
+            options.batch_size = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (arg == "--summary") {
+            options.summary = true;
+        } else if (arg == "--outline") {
+            options.outline = true;
+        } else if (arg == "--constants") {
+            options.constants = true;
+        } else if (arg == "--lazy") {
+            options.lazy = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] == '-') {
+            usage();
+            return 1;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    std::ios::sync_with_stdio(false);
+
+    goop::source::SourceManager sources;
+    int status = 0;
+
+    std::optional<goop::support::ThreadPool> pool;
+    if (options.threads) {
+        pool.emplace(*options.threads);
+    }
+
+    if (args.empty()) {
+        auto buffer = goop::source::SourceBuffer::from_file(stdin);
+        std::optional<goop::source::FileId> file;
+        if (buffer) {
+            file = sources.add("<stdin>", std::move(*buffer));
+        }
+
+        if (!file) {
+            std::cerr << "goop-ast: failed to read input" << std::endl;
+            return 1;
+        }
+
+        return parse_file(sources, *file, options, pool ? &*pool : nullptr) ? 0 : 1;
+    }
+
+    std::vector<fs::path> files;
+    if (!goop::support::collect_files("goop-ast", args, files)) {
+        status = 1;
+    }
+
+    // With a pool, the files of each directory are parsed together, as
+    // a package
+    bool by_package = pool && !options.lazy && !options.outline;
+    std::vector<goop::source::FileId> package;
+    auto flush = [&] {
+        if (!package.empty() && !parse_package(sources, package, options, *pool)) {
+            status = 1;
+        }
+        package.clear();
+    };
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const auto &path = files[i];
+        auto file = sources.load(path.string());
+        if (!file) {
+            std::cerr << "goop-ast: " << path.string() << ": failed to read" << std::endl;
+            status = 1;
+        } else if (!by_package) {
+            if (!parse_file(sources, *file, options, pool ? &*pool : nullptr)) {
+                status = 1;
+            }
+        } else {
+            package.push_back(*file);
+        }
+
+        if (i + 1 == files.size() || files[i + 1].parent_path() != path.parent_path()) {
+            flush();
+        }
+    }
+
+    return status;
+}
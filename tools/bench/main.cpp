@@ -0,0 +1,569 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "source.h"
+#include "tokens.h"
+
+namespace fs = std::filesystem;
+
+// Every allocation in the process goes through these, so the benchmarks
+// can report how many each token costs
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto *p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// Deterministic generator, so every run lexes the same bytes
+class Random {
+    uint64_t state;
+
+    public:
+    Random(uint64_t seed): state{seed} {}
+
+    // splitmix64
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    size_t below(size_t n) {
+        return next() % n;
+    }
+
+    bool chance(size_t percent) {
+        return below(100) < percent;
+    }
+
+    template<typename T, size_t N>
+    const T &pick(const T (&options)[N]) {
+        return options[below(N)];
+    }
+};
+
+enum class Fragment {
+    IDENTIFIER,
+    NUMBER,
+    RUNE,
+    STRING,
+    COMMENT,
+    PUNCTUATION,
+};
+
+static void append_identifier(std::string &out, Random &random)
+{
+    static const char *keywords[] = {
+        "func", "return", "if", "else", "for", "range", "var", "type", "struct", "package",
+    };
+
+    // Names come from a fixed vocabulary, mostly short and with a few
+    // used far more than the rest, like real code
+    static const auto vocabulary = [] {
+        static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+        static const char rest[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+
+        Random random(2);
+        std::vector<std::string> names(4096);
+        for (auto &name : names) {
+            auto length = 1 + random.below(random.chance(80) ? 6 : 20);
+            name += first[random.below(sizeof(first) - 1)];
+            for (size_t i = 1; i < length; ++i) {
+                name += rest[random.below(sizeof(rest) - 1)];
+            }
+
+            if (random.chance(2)) {
+                name += "été";
+            }
+        }
+
+        return names;
+    }();
+
+    if (random.chance(15)) {
+        out += random.pick(keywords);
+        return;
+    }
+
+    auto a = random.below(vocabulary.size());
+    auto b = random.below(vocabulary.size());
+    out += vocabulary[a * b / vocabulary.size()];
+}
+
+static void append_digits(std::string &out, Random &random, const char *digits, size_t radix)
+{
+    auto length = 1 + random.below(8);
+    for (size_t i = 0; i < length; ++i) {
+        if (i > 0 && random.chance(5)) {
+            out += '_';
+        }
+
+        out += digits[random.below(radix)];
+    }
+}
+
+static void append_number(std::string &out, Random &random)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    switch (random.below(8)) {
+    case 0:
+        out += "0x";
+        append_digits(out, random, digits, 16);
+        break;
+    case 1:
+        out += "0o";
+        append_digits(out, random, digits, 8);
+        break;
+    case 2:
+        out += "0b";
+        append_digits(out, random, digits, 2);
+        break;
+    case 3:
+        append_digits(out, random, digits, 10);
+        out += '.';
+        append_digits(out, random, digits, 10);
+        if (random.chance(50)) {
+            out += random.chance(50) ? "e-" : "E+";
+            append_digits(out, random, digits, 10);
+        }
+        break;
+    case 4:
+        out += "0x1.";
+        append_digits(out, random, digits, 16);
+        out += "p-3";
+        break;
+    case 5:
+        append_digits(out, random, digits, 10);
+        out += 'i';
+        break;
+    default:
+        out += digits[1 + random.below(9)];
+        append_digits(out, random, digits, 10);
+        break;
+    }
+}
+
+static void append_character(std::string &out, Random &random, char quote)
+{
+    static const char *escapes[] = {"\\n", "\\t", "\\\\", "\\x41", "\\u00e9", "\\101"};
+    static const char plain[] = "abcdefghijklmnopqrstuvwxyz0123456789 .,:;!?-+=";
+
+    if (random.chance(10)) {
+        out += random.pick(escapes);
+    } else if (random.chance(3)) {
+        out += "é";
+    } else if (random.chance(1)) {
+        out += '\\';
+        out += quote;
+    } else {
+        out += plain[random.below(sizeof(plain) - 1)];
+    }
+}
+
+static void append_rune(std::string &out, Random &random)
+{
+    out += '\'';
+    append_character(out, random, '\'');
+    out += '\'';
+}
+
+static void append_string(std::string &out, Random &random)
+{
+    out += '"';
+    auto length = random.below(random.chance(80) ? 16 : 80);
+    for (size_t i = 0; i < length; ++i) {
+        append_character(out, random, '"');
+    }
+    out += '"';
+}
+
+static void append_comment(std::string &out, Random &random)
+{
+    static const char *words[] = {
+        "the", "value", "returns", "a", "of", "is", "if", "nil", "error", "for", "each", "TODO:",
+    };
+
+    bool block = random.chance(25);
+    out += block ? "/*" : "//";
+    auto length = 1 + random.below(block ? 40 : 12);
+    for (size_t i = 0; i < length; ++i) {
+        out += ' ';
+        out += random.pick(words);
+        if (block && random.chance(10)) {
+            out += "\n *";
+        }
+    }
+    out += block ? " */" : "\n";
+}
+
+static void append_punctuation(std::string &out, Random &random)
+{
+    static const char *common[] = {"(", ")", "{", "}", ",", ".", "=", ":=", "[", "]", ";", "*", "&"};
+    static const char *rare[] = {
+        "+", "-", "/", "%", "|", "^", "<<", ">>", "&^", "+=", "-=", "*=", "/=", "%=", "&=", "|=",
+        "^=", "<<=", ">>=", "&^=", "&&", "||", "<-", "++", "--", "==", "<", ">", "!", "~", "!=",
+        "<=", ">=", "...", ":",
+    };
+
+    out += random.chance(70) ? random.pick(common) : random.pick(rare);
+}
+
+static void append_fragment(std::string &out, Random &random, Fragment fragment)
+{
+    switch (fragment) {
+    case Fragment::IDENTIFIER:
+        return append_identifier(out, random);
+    case Fragment::NUMBER:
+        return append_number(out, random);
+    case Fragment::RUNE:
+        return append_rune(out, random);
+    case Fragment::STRING:
+        return append_string(out, random);
+    case Fragment::COMMENT:
+        return append_comment(out, random);
+    case Fragment::PUNCTUATION:
+        return append_punctuation(out, random);
+    }
+}
+
+struct Weight {
+    Fragment fragment;
+    size_t weight;
+};
+
+// Fragments drawn by weight and separated by whitespace until the
+// corpus reaches size bytes
+static std::string generate(std::span<const Weight> weights, size_t size, uint64_t seed)
+{
+    Random random(seed);
+    size_t total = 0;
+    for (auto [fragment, weight] : weights) {
+        total += weight;
+    }
+
+    std::string out;
+    out.reserve(size + 256);
+    while (out.size() < size) {
+        auto roll = random.below(total);
+        for (auto [fragment, weight] : weights) {
+            if (roll < weight) {
+                append_fragment(out, random, fragment);
+                break;
+            }
+            roll -= weight;
+        }
+
+        if (random.chance(12)) {
+            out += '\n';
+            out.append(random.below(4), '\t');
+        } else {
+            out += ' ';
+        }
+    }
+
+    return out;
+}
+
+struct Profile {
+    const char *name;
+    std::vector<Weight> weights;
+};
+
+static const std::vector<Profile> profiles = {
+    {"identifiers", {{Fragment::IDENTIFIER, 70}, {Fragment::PUNCTUATION, 25}, {Fragment::NUMBER, 5}}},
+    {"literals", {
+        {Fragment::NUMBER, 30}, {Fragment::STRING, 25}, {Fragment::RUNE, 15}, {Fragment::PUNCTUATION, 30},
+    }},
+    {"comments", {{Fragment::COMMENT, 60}, {Fragment::IDENTIFIER, 25}, {Fragment::PUNCTUATION, 15}}},
+    {"punctuation", {{Fragment::PUNCTUATION, 75}, {Fragment::IDENTIFIER, 25}}},
+};
+
+// Each consume_* function on a corpus of nothing but its own tokens
+struct Path {
+    const char *name;
+    Fragment fragment;
+    std::function<bool(goop::tokens::Cursor &)> consume;
+};
+
+static const std::vector<Path> paths = {
+    {"identifier", Fragment::IDENTIFIER,
+        [](auto &cursor) { return goop::tokens::consume_identifier(cursor).has_value(); }},
+    {"numeric", Fragment::NUMBER,
+        [](auto &cursor) { return goop::tokens::consume_numeric_literal(cursor).has_value(); }},
+    {"rune", Fragment::RUNE,
+        [](auto &cursor) { return goop::tokens::consume_rune_literal(cursor).has_value(); }},
+    {"string", Fragment::STRING,
+        [](auto &cursor) { return goop::tokens::consume_string_literal(cursor).has_value(); }},
+    {"comment", Fragment::COMMENT,
+        [](auto &cursor) { return goop::tokens::consume_comment(cursor).has_value(); }},
+    {"punctuation", Fragment::PUNCTUATION,
+        [](auto &cursor) { return goop::tokens::consume_punctuation(cursor).has_value(); }},
+};
+
+struct Options {
+    std::vector<size_t> sizes = {1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    std::vector<std::string> dirs;
+    std::string filter;
+    double min_time = 0.5;
+};
+
+struct Result {
+    double seconds;
+    size_t tokens;
+    size_t allocations;
+};
+
+// Runs body until min_time has passed and at least three times, keeping
+// the fastest run. Allocations are counted on the last run, after the
+// first has warmed up the interner.
+static Result measure(const Options &options, const std::function<size_t()> &body)
+{
+    Result best{0, 0, 0};
+    double elapsed = 0;
+
+    for (size_t run = 0; run < 3 || elapsed < options.min_time; ++run) {
+        auto before = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        auto tokens = body();
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        elapsed += seconds.count();
+        best.tokens = tokens;
+        best.allocations = allocations.load(std::memory_order_relaxed) - before;
+        if (run == 0 || seconds.count() < best.seconds) {
+            best.seconds = seconds.count();
+        }
+    }
+
+    return best;
+}
+
+static void report(const std::string &name, size_t bytes, const Result &result)
+{
+    std::printf("%-28s %10zu %10.1f %10.2f %12.3f\n",
+            name.c_str(),
+            bytes,
+            bytes / result.seconds / 1e6,
+            result.tokens / result.seconds / 1e6,
+            result.tokens ? static_cast<double>(result.allocations) / result.tokens : 0.0);
+    std::fflush(stdout);
+}
+
+static bool selected(const Options &options, const std::string &name)
+{
+    return name.find(options.filter) != std::string::npos;
+}
+
+static void bench_tokens(const Options &options, const std::string &name, std::string_view source)
+{
+    auto result = measure(options, [&] {
+        return goop::tokens::consume_tokens(source).size();
+    });
+
+    report(name, source.size(), result);
+}
+
+static bool bench_path(const Options &options, const Path &path, size_t size)
+{
+    auto source = generate(std::vector<Weight>{{path.fragment, 1}}, size, 1);
+
+    bool ok = true;
+    auto result = measure(options, [&] {
+        goop::tokens::Cursor cursor(source);
+        size_t tokens = 0;
+        while (true) {
+            while (cursor.peek_byte() == ' ' || cursor.peek_byte() == '\n' || cursor.peek_byte() == '\t') {
+                cursor.advance_bytes(1);
+            }
+
+            if (cursor.at_end())
+                break;
+
+            if (!path.consume(cursor)) {
+                ok = false;
+                break;
+            }
+            tokens += 1;
+        }
+
+        return tokens;
+    });
+
+    if (!ok) {
+        std::cerr << "goop-bench: " << path.name << " failed to lex its own corpus" << std::endl;
+        return false;
+    }
+
+    report(std::string("path/") + path.name, source.size(), result);
+    return true;
+}
+
+// Every *.go file below dir, joined into one buffer
+static std::string read_dir(const std::string &dir)
+{
+    std::vector<fs::path> files;
+    std::error_code error;
+    for (auto it = fs::recursive_directory_iterator(dir, error);
+            !error && it != fs::recursive_directory_iterator();
+            it.increment(error)) {
+        if (it->is_regular_file() && it->path().extension() == ".go") {
+            files.push_back(it->path());
+        }
+    }
+
+    if (error) {
+        std::cerr << "goop-bench: " << dir << ": " << error.message() << std::endl;
+    }
+
+    std::sort(files.begin(), files.end());
+
+    std::string source;
+    for (const auto &file : files) {
+        if (auto buffer = goop::source::SourceBuffer::map_file(file)) {
+            source += buffer->view();
+            source += '\n';
+        }
+    }
+
+    return source;
+}
+
+static std::optional<size_t> parse_size(std::string_view text)
+{
+    size_t value = 0;
+    size_t i = 0;
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+        value = value * 10 + (text[i] - '0');
+    }
+
+    if (i == 0)
+        return std::nullopt;
+
+    auto suffix = text.substr(i);
+    if (suffix == "K" || suffix == "k") {
+        return value * 1024;
+    } else if (suffix == "M" || suffix == "m") {
+        return value * 1024 * 1024;
+    } else if (suffix.empty()) {
+        return value;
+    }
+
+    return std::nullopt;
+}
+
+static void usage()
+{
+    std::cerr << "usage: goop-bench [--sizes 1K,64K,1M,16M] [--dir path]... [--filter name] [--min-time seconds]\n"
+        << "Measures the lexer on generated corpora of each size, and on the *.go files under each directory"
+        << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            options.sizes.clear();
+            std::string_view list = argv[++i];
+            while (!list.empty()) {
+                auto comma = list.find(',');
+                auto size = parse_size(list.substr(0, comma));
+                if (!size) {
+                    usage();
+                    return 1;
+                }
+
+                options.sizes.push_back(*size);
+                list = comma == std::string_view::npos ? "" : list.substr(comma + 1);
+            }
+        } else if (arg == "--dir" && i + 1 < argc) {
+            options.dirs.push_back(argv[++i]);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.min_time = std::strtod(argv[++i], nullptr);
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+#ifndef __OPTIMIZE__
+    std::cerr << "goop-bench: built without optimizations, configure with -DCMAKE_BUILD_TYPE=Release"
+        << std::endl;
+#endif
+
+    std::printf("%-28s %10s %10s %10s %12s\n", "benchmark", "bytes", "MB/s", "Mtokens/s", "allocs/token");
+
+    int status = 0;
+    for (auto size : options.sizes) {
+        for (const auto &path : paths) {
+            if (selected(options, std::string("path/") + path.name) && !bench_path(options, path, size)) {
+                status = 1;
+            }
+        }
+
+        for (const auto &profile : profiles) {
+            auto name = std::string("tokens/") + profile.name;
+            if (selected(options, name)) {
+                bench_tokens(options, name, generate(profile.weights, size, 1));
+            }
+        }
+    }
+
+    for (const auto &dir : options.dirs) {
+        auto name = "tokens/dir:" + fs::path(dir).filename().string();
+        if (selected(options, name)) {
+            bench_tokens(options, name, read_dir(dir));
+        }
+    }
+
+    return status;
+}
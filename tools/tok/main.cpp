@@ -1,18 +1,821 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <variant>
+#include <vector>
 #include <unicode/ustream.h>
 #include <unicode/unistr.h>
-#include <unicode/ustdio.h>
+#include <unicode/utf8.h>
+#include <sys/resource.h>
+#include "files.h"
+#include "source.h"
+#include "stats.h"
+#include "token_cache.h"
+#include "thread_pool.h"
 #include "tokens.h"
 
+namespace fs = std::filesystem;
 
-int main() {
-    auto *u_stdin = u_finit(stdin, nullptr, nullptr);
+// What is written for each token
+enum class Format {
+    TEXT,
+    // One JSON object per line
+    JSON,
+    // The token cache encoding of each file after its path,
+    // each prefixed with its size as a native 64 bit integer
+    BINARY,
+    // Only the number of tokens of each kind, nothing is formatted
+    SUMMARY,
+    // Only the totals
+    COUNT,
+};
 
-    auto tokens = goop::tokens::consume_tokens(u_stdin);
-    for (const auto &token : tokens.all()) {
-        std::cout << token << std::endl;
+struct Counts {
+    size_t tokens = 0;
+    size_t bytes = 0;
+    // Size of the token streams, only measured for --stats
+    size_t storage_bytes = 0;
+    // Indexed by TokenKind
+    std::array<size_t, std::variant_size_v<goop::tokens::TokenVariant>> kinds{};
+
+    void add(const Counts &other) {
+        tokens += other.tokens;
+        bytes += other.bytes;
+        storage_bytes += other.storage_bytes;
+        for (size_t i = 0; i < kinds.size(); ++i) {
+            kinds[i] += other.kinds[i];
+        }
+    }
+};
+
+struct FileResult {
+    // Written before the output, once the counts are known
+    std::string header;
+    std::string output;
+    Counts counts;
+    bool failed = false;
+    bool done = false;
+};
+
+// An edit from the command line, which has to own the inserted text
+struct EditOption {
+    size_t offset = 0;
+    size_t removed = 0;
+    std::string inserted;
+
+    goop::tokens::Edit edit() const {
+        return {offset, removed, inserted};
+    }
+};
+
+struct Options {
+    size_t threads = 0;
+    // Inputs larger than this are split and lexed in parallel
+    size_t chunk_size = 4 * 1024 * 1024;
+    // Where tokens of files lexed before are kept, if anywhere
+    std::optional<goop::tokens::TokenCache> cache;
+    Format format = Format::TEXT;
+    goop::tokens::CommentMode comments = goop::tokens::CommentMode::ALL;
+    // Write the directives of each file after its tokens
+    bool directives = false;
+    // Only scan each file's package clause, leading directives and
+    // imports, reading no more of it than they take
+    bool header = false;
+    // Edit applied to stdin, whose tokens are then relexed from the
+    // tokens it had before
+    std::optional<EditOption> edit;
+    // Report what the lexer did on stderr
+    bool stats = false;
+};
+
+static constexpr std::string_view kind_names[] = {
+    "keyword",
+    "identifier",
+    "int",
+    "float",
+    "imaginary",
+    "punctuation",
+    "rune",
+    "string",
+    "comment",
+    "error",
+};
+
+static_assert(std::size(kind_names) == std::variant_size_v<goop::tokens::TokenVariant>);
+
+static void usage()
+{
+    std::cerr << "usage: goop-tok [-j threads] [--chunk-size bytes] [--cache directory]\n"
+        << "                [--format text|json|binary] [--summary] [--count] [--stats]\n"
+        << "                [--comments all|doc|drop] [--directives] [--header]\n"
+        << "                [--edit offset,removed,text] [file or directory...]\n"
+        << "Lexes stdin, or every given file and every *.go file under the given directories\n"
+        << "With --cache, tokens are saved under directory and reused for files with the same contents\n"
+        << "--summary only counts the tokens of each kind, --count only prints the totals\n"
+        << "--stats reports lexer counters, time per phase and memory use on stderr\n"
+        << "--comments doc keeps only comments right before the token they document\n"
+        << "--directives writes the //go: and //line directives after the tokens\n"
+        << "--header writes only the directives before the package clause, the package name and\n"
+        << "the imports, and stops reading each file once they are over\n"
+        << "--edit replaces removed bytes of stdin at offset by text, where \\n, \\t and \\\\ are\n"
+        << "escapes, and writes the tokens of the result relexed from the tokens before the edit"
+        << std::endl;
+}
+
+// Calls emit with every token of source and returns its directives. The
+// tokens come from the cache when it has them, are lexed in parallel
+// when the source is large enough, and are otherwise emitted as they
+// are lexed rather than collected. With --stats the tokens are always
+// collected first, so that lexing and formatting are timed apart, and
+// their storage size is added to counts. Tokens already relexed after an
+// edit are emitted as they are.
+template<typename Emit>
+static std::vector<goop::tokens::Directive> for_each_token(
+        std::string_view source,
+        const Options &options,
+        goop::support::ThreadPool *pool,
+        Counts &counts,
+        Emit &&emit,
+        const goop::tokens::TokenStream *relexed
+)
+{
+    using goop::stats::Phase;
+    using goop::stats::ScopedPhase;
+
+    auto emit_stream = [&](const goop::tokens::TokenStream &tokens) {
+        ScopedPhase phase(Phase::FORMAT);
+        auto offsets = tokens.offsets();
+        auto lengths = tokens.lengths();
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            emit(goop::tokens::LexedToken{tokens[i], offsets[i], lengths[i]});
+        }
+
+        auto directives = tokens.directives();
+        return std::vector<goop::tokens::Directive>(directives.begin(), directives.end());
+    };
+
+    if (relexed) {
+        if (options.stats) {
+            counts.storage_bytes += relexed->storage_bytes();
+        }
+
+        return emit_stream(*relexed);
+    }
+
+    // Entries hold every comment, other modes don't use the cache
+    bool use_cache = options.cache && options.comments == goop::tokens::CommentMode::ALL;
+
+    std::optional<goop::tokens::ContentHash> hash;
+    if (use_cache) {
+        std::optional<goop::tokens::CachedTokens> cached;
+        {
+            ScopedPhase phase(Phase::CACHE);
+            hash = goop::tokens::hash_content(source);
+            cached = options.cache->load(source, *hash);
+        }
+
+        if (cached && options.stats) {
+            counts.storage_bytes += cached->to_stream().storage_bytes();
+        }
+
+        if (cached) {
+            ScopedPhase phase(Phase::FORMAT);
+            std::vector<goop::tokens::Directive> directives;
+            for (const auto &lexed : *cached) {
+                emit(lexed);
+
+                if (std::holds_alternative<goop::tokens::Comment>(lexed.token)) {
+                    if (auto directive = goop::tokens::Directive::find(source, lexed.offset, lexed.length)) {
+                        directives.push_back(*directive);
+                    }
+                }
+            }
+
+            return directives;
+        }
+    }
+
+    bool parallel = pool && source.size() > options.chunk_size;
+    if (parallel || use_cache || options.stats) {
+        auto tokens = parallel
+            ? goop::tokens::consume_tokens_parallel(source, *pool, options.chunk_size, options.comments)
+            : goop::tokens::consume_tokens(source, options.comments);
+
+        // Failing to save an entry only costs the next run a lex
+        if (use_cache) {
+            ScopedPhase phase(Phase::CACHE);
+            options.cache->store(tokens, source, *hash);
+        }
+
+        if (options.stats) {
+            counts.storage_bytes += tokens.storage_bytes();
+        }
+
+        return emit_stream(tokens);
+    }
+
+    goop::tokens::Lexer lexer(source, 0, options.comments);
+    for (const auto &lexed : lexer) {
+        emit(lexed);
+    }
+
+    auto directives = lexer.directives();
+    return {directives.begin(), directives.end()};
+}
+
+// Writes text as a JSON string, with invalid UTF-8 replaced by U+FFFD
+static void write_json_string(std::ostream &os, std::string_view text)
+{
+    static constexpr char digits[] = "0123456789abcdef";
+
+    os << '"';
+
+    auto data = text.data();
+    auto size = static_cast<int32_t>(text.size());
+    int32_t plain = 0;
+    for (int32_t i = 0; i < size; ) {
+        auto start = i;
+        UChar32 c;
+        U8_NEXT(data, i, size, c);
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // Everything up to here needed no escaping
+        os.write(data + plain, start - plain);
+        plain = i;
+
+        if (c < 0) {
+            os << "\\ufffd";
+        } else if (c == '"' || c == '\\') {
+            os << '\\' << static_cast<char>(c);
+        } else if (c == '\n') {
+            os << "\\n";
+        } else if (c == '\t') {
+            os << "\\t";
+        } else if (c == '\r') {
+            os << "\\r";
+        } else {
+            os << "\\u00" << digits[c >> 4] << digits[c & 0xF];
+        }
+    }
+
+    os.write(data + plain, size - plain);
+    os << '"';
+}
+
+static void write_json_number(std::ostream &os, const goop::tokens::IntLiteral &lit)
+{
+    os << ",\"radix\":" << static_cast<unsigned int>(lit.radix) << ",\"value\":";
+    if (lit.cached) {
+        os << *lit.cached;
+    } else {
+        os << lit.value();
+    }
+}
+
+static void write_json_number(std::ostream &os, const goop::tokens::FloatLiteral &lit)
+{
+    os << ",\"radix\":" << static_cast<unsigned int>(lit.radix) << ",\"value\":";
+
+    // JSON has no infinity, literals too large for a double have no value
+    auto value = lit.value();
+    if (std::isinf(value)) {
+        os << "null";
+        return;
+    }
+
+    char text[32];
+    auto [end, _] = std::to_chars(std::begin(text), std::end(text), value);
+    os << std::string_view(text, end - text);
+}
+
+static void write_json(std::ostream &os, const goop::tokens::LexedToken &lexed, std::string_view source)
+{
+    using namespace goop::tokens;
+
+    os << "{\"kind\":\"" << kind_names[lexed.token.index()]
+        << "\",\"offset\":" << lexed.offset
+        << ",\"length\":" << lexed.length
+        << ",\"text\":";
+    write_json_string(os, source.substr(lexed.offset, lexed.length));
+
+    std::visit([&](const auto &tok) {
+        using T = std::decay_t<decltype(tok)>;
+
+        if constexpr (std::is_same_v<T, IntLiteral> || std::is_same_v<T, FloatLiteral>) {
+            write_json_number(os, tok);
+        } else if constexpr (std::is_same_v<T, ImaginaryLiteral>) {
+            std::visit([&](const auto &inner) { write_json_number(os, inner); }, tok.inner);
+        } else if constexpr (std::is_same_v<T, RuneLiteral>) {
+            os << ",\"value\":" << tok.rune;
+        } else if constexpr (std::is_same_v<T, StringLiteral>) {
+            os << ",\"raw\":" << (tok.raw ? "true" : "false") << ",\"value\":";
+            write_json_string(os, tok.value());
+        } else if constexpr (std::is_same_v<T, Comment>) {
+            os << ",\"multiline\":" << (tok.multiline ? "true" : "false");
+        } else if constexpr (std::is_same_v<T, Error>) {
+            os << ",\"reason\":\"" << Error::describe(tok.reason) << '"';
+        }
+    }, lexed.token);
+
+    os << "}\n";
+}
+
+static void write_directive(
+        std::ostream &os,
+        const goop::tokens::Directive &directive,
+        std::string_view source,
+        Format format
+)
+{
+    std::string_view kind = directive.kind == goop::tokens::Directive::GO ? "go" : "line";
+
+    if (format == Format::JSON) {
+        os << "{\"directive\":\"" << kind << "\",\"offset\":" << directive.offset << ",\"name\":";
+        write_json_string(os, directive.name(source));
+        os << ",\"arguments\":";
+        write_json_string(os, directive.arguments(source));
+        os << "}\n";
+    } else {
+        os << "Directive(kind: " << kind
+            << ", name: " << directive.name(source)
+            << ", arguments: " << directive.arguments(source) << ")\n";
+    }
+}
+
+static void write_binary(std::ostream &os, std::string_view encoded)
+{
+    uint64_t size = encoded.size();
+    os.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    os.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+}
+
+// Writes the tokens of source to os in the chosen format, which are
+// relexed if given
+static Counts write_tokens(
+        std::string_view source,
+        std::ostream &os,
+        const Options &options,
+        goop::support::ThreadPool *pool,
+        const goop::tokens::TokenStream *relexed = nullptr
+)
+{
+    Counts counts;
+    counts.bytes = source.size();
+
+    if (options.format == Format::BINARY) {
+        goop::tokens::TokenStream tokens(source);
+        for_each_token(source, options, pool, counts, [&](const goop::tokens::LexedToken &lexed) {
+            tokens.push(lexed.token, lexed.offset, lexed.length);
+            counts.kinds[lexed.token.index()] += 1;
+        }, relexed);
+
+        counts.tokens = tokens.size();
+        write_binary(os, goop::tokens::encode_tokens(tokens, source, goop::tokens::hash_content(source)));
+        return counts;
+    }
+
+    auto directives = for_each_token(source, options, pool, counts, [&](const goop::tokens::LexedToken &lexed) {
+        counts.tokens += 1;
+        counts.kinds[lexed.token.index()] += 1;
+
+        if (options.format == Format::TEXT) {
+            os << lexed.token << '\n';
+        } else if (options.format == Format::JSON) {
+            write_json(os, lexed, source);
+        }
+    }, relexed);
+
+    if (options.directives && (options.format == Format::TEXT || options.format == Format::JSON)) {
+        for (const auto &directive : directives) {
+            write_directive(os, directive, source, options.format);
+        }
+    }
+
+    return counts;
+}
+
+// Parses offset,removed,text. The text is taken as it is, apart from
+// the escapes \n, \t and \\ for a backslash.
+static std::optional<EditOption> parse_edit(std::string_view arg)
+{
+    EditOption edit;
+
+    auto first = arg.find(',');
+    auto second = first == std::string_view::npos ? first : arg.find(',', first + 1);
+    if (second == std::string_view::npos)
+        return std::nullopt;
+
+    auto number = [](std::string_view digits, size_t &value) {
+        auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+        return error == std::errc() && end == digits.data() + digits.size();
+    };
+
+    if (!number(arg.substr(0, first), edit.offset) || !number(arg.substr(first + 1, second - first - 1), edit.removed))
+        return std::nullopt;
+
+    auto text = arg.substr(second + 1);
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\\' || i + 1 == text.size()) {
+            edit.inserted.push_back(text[i]);
+            continue;
+        }
+
+        auto escaped = text[++i];
+        if (escaped == 'n') {
+            edit.inserted.push_back('\n');
+        } else if (escaped == 't') {
+            edit.inserted.push_back('\t');
+        } else if (escaped == '\\') {
+            edit.inserted.push_back('\\');
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    return edit;
+}
+
+// Writes what scan_header found in source, which is all that was read
+// of it. The counts only cover the tokens lexed for the header.
+static Counts write_header(
+        std::string_view source,
+        const goop::tokens::FileHeader &header,
+        std::ostream &os,
+        Format format
+)
+{
+    for (const auto &directive : header.directives) {
+        write_directive(os, directive, source, format);
+    }
+
+    if (format == Format::JSON) {
+        os << "{\"package\":";
+        write_json_string(os, header.package);
+        os << ",\"end\":" << header.end << "}\n";
+        for (const auto &path : header.imports) {
+            os << "{\"import\":";
+            write_json_string(os, path);
+            os << "}\n";
+        }
+    } else if (format == Format::TEXT) {
+        os << "Package(name: " << header.package << ", end: " << header.end << ")\n";
+        for (const auto &path : header.imports) {
+            os << "Import(path: " << path << ")\n";
+        }
+    }
+
+    Counts counts;
+    counts.tokens = header.tokens;
+    counts.bytes = source.size();
+    return counts;
+}
+
+static void write_file_header(std::ostream &os, const fs::path &path, const Counts &counts, Format format)
+{
+    if (format == Format::JSON) {
+        os << "{\"file\":";
+        write_json_string(os, path.string());
+        os << ",\"tokens\":" << counts.tokens << ",\"bytes\":" << counts.bytes << "}\n";
+    } else if (format == Format::BINARY) {
+        write_binary(os, path.string());
+    } else if (format != Format::COUNT) {
+        os << "File(path: " << path.string()
+            << ", tokens: " << counts.tokens
+            << ", bytes: " << counts.bytes << ")\n";
+    }
+}
+
+static void write_totals(std::ostream &os, size_t files, const Counts &counts, Format format)
+{
+    if (format == Format::BINARY)
+        return;
+
+    if (format == Format::JSON) {
+        os << "{\"files\":" << files << ",\"tokens\":" << counts.tokens << ",\"bytes\":" << counts.bytes << "}\n";
+        return;
+    }
+
+    os << "Total(files: " << files
+        << ", tokens: " << counts.tokens
+        << ", bytes: " << counts.bytes << ")\n";
+
+    if (format == Format::SUMMARY) {
+        os << "Kinds(";
+        for (size_t i = 0; i < counts.kinds.size(); ++i) {
+            os << (i ? ", " : "") << kind_names[i] << ": " << counts.kinds[i];
+        }
+
+        os << ")\n";
+    }
+}
+
+static void write_stats(std::ostream &os, const Counts &counts)
+{
+    using namespace goop::stats;
+
+    if constexpr (enabled) {
+        auto stats = snapshot();
+
+        // Tokens and bytes include what parallel lexing threw away
+        uint64_t tokens = 0;
+        for (auto count : stats.tokens) {
+            tokens += count;
+        }
+
+        os << "Stats(tokens: " << tokens << ", bytes: " << stats.bytes << ")\n";
+
+        os << "Tokens(";
+        for (size_t i = 0; i < stats.tokens.size(); ++i) {
+            os << (i ? ", " : "") << kind_names[i] << ": " << stats.tokens[i];
+        }
+        os << ")\n";
+
+        for (size_t i = 0; i < stats.consumers.size(); ++i) {
+            const auto &consumer = stats.consumers[i];
+            os << "Consumer(name: " << name(static_cast<Consumer>(i))
+                << ", calls: " << consumer.calls
+                << ", matches: " << consumer.matches
+                << ", backtracks: " << consumer.backtracks
+                << ", backtracked_bytes: " << consumer.backtracked_bytes << ")\n";
+        }
+
+        os << "Allocated(count: " << stats.allocations << ", bytes: " << stats.allocated_bytes << ")\n";
+
+        os << "Phases(";
+        for (size_t i = 0; i < stats.phase_ns.size(); ++i) {
+            os << (i ? ", " : "") << name(static_cast<Phase>(i)) << "_ns: " << stats.phase_ns[i];
+        }
+        os << ")\n";
+    } else {
+        os << "Stats(disabled: built without GOOP_STATS)\n";
+    }
+
+    // Peak resident set size, which Linux reports in kilobytes
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    auto per_byte = counts.bytes ? static_cast<double>(counts.storage_bytes) / counts.bytes : 0.0;
+    os << "Memory(peak_rss_kb: " << usage.ru_maxrss
+        << ", token_storage: " << counts.storage_bytes
+        << ", storage_per_source_byte: " << per_byte << ")\n";
+}
+
+static void lex_file(
+        const fs::path &path,
+        FileResult &result,
+        const Options &options,
+        goop::support::ThreadPool &pool
+)
+{
+    if (options.header) {
+        std::string text;
+        auto header = goop::tokens::read_header(path, text);
+        if (!header) {
+            result.failed = true;
+            return;
+        }
+
+        std::ostringstream os;
+        result.counts = write_header(text, *header, os, options.format);
+        result.output = std::move(os).str();
+
+        std::ostringstream file;
+        write_file_header(file, path, result.counts, options.format);
+        result.header = std::move(file).str();
+        return;
+    }
+
+    std::optional<goop::source::SourceBuffer> source;
+    {
+        goop::stats::ScopedPhase phase(goop::stats::Phase::READ);
+        source = goop::source::SourceBuffer::map_file(path);
+    }
+
+    if (!source) {
+        result.failed = true;
+        return;
+    }
+
+    std::ostringstream os;
+    result.counts = write_tokens(source->view(), os, options, &pool);
+    result.output = std::move(os).str();
+
+    std::ostringstream header;
+    write_file_header(header, path, result.counts, options.format);
+    result.header = std::move(header).str();
+}
+
+static int lex_files(const std::vector<fs::path> &files, const Options &options)
+{
+    std::vector<FileResult> results(files.size());
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    goop::support::ThreadPool pool(options.threads);
+    goop::support::TaskGroup group(pool);
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        group.run([&, i] {
+            FileResult result;
+            lex_file(files[i], result, options, pool);
+
+            std::lock_guard lock(mutex);
+            results[i] = std::move(result);
+            results[i].done = true;
+            finished.notify_all();
+        });
+    }
+
+    // Print in the order the files were given as soon as each is done,
+    // dropping the output once it's written
+    int status = 0;
+    Counts totals;
+    for (size_t i = 0; i < files.size(); ++i) {
+        FileResult result;
+        {
+            std::unique_lock lock(mutex);
+            finished.wait(lock, [&] { return results[i].done; });
+            result = std::move(results[i]);
+        }
+
+        if (result.failed) {
+            std::cerr << "goop-tok: " << files[i].string() << ": failed to read" << std::endl;
+            status = 1;
+            continue;
+        }
+
+        std::cout << result.header << result.output;
+        totals.add(result.counts);
+    }
+
+    group.wait();
+
+    write_totals(std::cout, files.size(), totals, options.format);
+    std::cout.flush();
+
+    if (options.stats) {
+        write_stats(std::cerr, totals);
+    }
+
+    return status;
+}
+
+static int lex_stdin(const Options &options)
+{
+    std::optional<goop::source::SourceBuffer> source;
+    {
+        goop::stats::ScopedPhase phase(goop::stats::Phase::READ);
+        source = goop::source::SourceBuffer::from_file(stdin);
+    }
+
+    if (!source) {
+        std::cerr << "goop-tok: failed to read input" << std::endl;
+        return 1;
+    }
+
+    Counts counts;
+    if (options.edit) {
+        auto edit = options.edit->edit();
+        if (edit.offset + edit.removed > source->size()) {
+            std::cerr << "goop-tok: edit past the end of the input" << std::endl;
+            return 1;
+        }
+
+        auto previous = goop::tokens::consume_tokens(source->view(), options.comments);
+        std::string text(source->view());
+        edit.apply(text);
+        auto tokens = goop::tokens::relex(previous, text, edit);
+        counts = write_tokens(text, std::cout, options, nullptr, &tokens);
+    } else if (options.header) {
+        auto header = goop::tokens::scan_header(source->view());
+        counts = write_header(source->view().substr(0, header->end), *header, std::cout, options.format);
+    } else {
+        std::optional<goop::support::ThreadPool> pool;
+        if (source->size() > options.chunk_size) {
+            pool.emplace(options.threads);
+        }
+
+        counts = write_tokens(source->view(), std::cout, options, pool ? &*pool : nullptr);
+    }
+
+    // A single input has no totals unless they are all there is
+    if (options.format == Format::SUMMARY || options.format == Format::COUNT) {
+        write_totals(std::cout, 1, counts, options.format);
+    }
+
+    std::cout.flush();
+
+    if (options.stats) {
+        write_stats(std::cerr, counts);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            options.threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--chunk-size" && i + 1 < argc) {
+            options.chunk_size = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            options.cache.emplace(argv[++i]);
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string_view format = argv[++i];
+            if (format == "text") {
+                options.format = Format::TEXT;
+            } else if (format == "json") {
+                options.format = Format::JSON;
+            } else if (format == "binary") {
+                options.format = Format::BINARY;
+            } else {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--summary") {
+            options.format = Format::SUMMARY;
+        } else if (arg == "--count") {
+            options.format = Format::COUNT;
+        } else if (arg == "--comments" && i + 1 < argc) {
+            std::string_view comments = argv[++i];
+            if (comments == "all") {
+                options.comments = goop::tokens::CommentMode::ALL;
+            } else if (comments == "doc") {
+                options.comments = goop::tokens::CommentMode::DOC;
+            } else if (comments == "drop") {
+                options.comments = goop::tokens::CommentMode::DROP;
+            } else {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--directives") {
+            options.directives = true;
+        } else if (arg == "--edit" && i + 1 < argc) {
+            options.edit = parse_edit(argv[++i]);
+            if (!options.edit) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--header") {
+            options.header = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] == '-') {
+            usage();
+            return 1;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    // The binary encoding can't leave comments out
+    if (options.format == Format::BINARY && options.comments != goop::tokens::CommentMode::ALL) {
+        usage();
+        return 1;
+    }
+
+    // Only stdin is edited, and its tokens aren't cached
+    if (options.edit && (!args.empty() || options.header || options.cache)) {
+        usage();
+        return 1;
+    }
+
+    // Headers are written as text or JSON, or only counted
+    if (options.header && (options.format == Format::BINARY || options.format == Format::SUMMARY)) {
+        usage();
+        return 1;
+    }
+
+    // Output is only ever written through cout, which can then buffer
+    // it rather than passing every write on to stdio
+    std::ios::sync_with_stdio(false);
+
+    if (args.empty()) {
+        return lex_stdin(options);
     }
 
-    u_fflush(u_stdin);
+    std::vector<fs::path> files;
+    bool ok = goop::support::collect_files("goop-tok", args, files);
+    int status = lex_files(files, options);
+    return ok ? status : 1;
 }